@@ -0,0 +1,1890 @@
+// host benchmark for the DEM lookup path
+//
+// generates synthetic Terrain-RGB MBTiles archives (PNG and lossless WebP)
+// covering disjoint areas, loads both via addDEM() and reports
+// cold-miss latency split into SQLite fetch and decode, cached-hit latency,
+// random-lookup throughput for a given cache size, with and without the blob
+// cache tier, the same for a batch
+// lookup, bilinear and bicubic accuracy against a reference implementation
+// the float projection against the double one, lookup stalls along a
+// simulated flight with and without the prefetch worker, non-blocking
+// lookups, partial decodes, blob streaming, lookups on several threads,
+// a raw container converted from MBTiles, an archive transcoded to DPK
+// tiles, cache snapshots, uniform tiles,
+// peak tile memory and the hit rates of the cache eviction policies
+// replayed on synthetic or recorded tracks.
+//
+// usage: bench [-d dir] [-t tiles] [-n hits] [-r random] [-c cachesize] [-s seed]
+//              [-T track.csv] [-z zoom] [-k] [-v]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+
+#include <zlib.h>
+#include <sqlite3.h>
+
+#include "webp/encode.h"
+
+#include "platform.hpp"
+#include "logging.hpp"
+#include "mbtiles.hpp"
+#include "slippytiles.hpp"
+
+#define BENCH_ZOOM  13
+#define BENCH_X0    4400
+#define BENCH_Y0    2860
+
+typedef struct {
+    std::string name;
+    encoding_t encoding;
+    int32_t x0;
+    int32_t y0;
+    uint32_t zoom;
+    int ntiles;         // square
+    bool empty = false;         // all NODATA
+    bool deduplicated = false;  // tiles is a view over map and images tables
+    int32_t flat = 0;           // dm of every pixel, 0: synthetic terrain
+    bool raw = false;           // converted to a raw container
+    std::string path = "";
+    demInfo_t *di = NULL;
+    size_t blob_bytes = 0;
+    int levels = 0;             // lower zooms, each pixel the terrain at its centre
+} archive_t;
+
+static int ntiles = 8;
+static int nextra = 0;
+static int nlookups = 100000;
+static int nrandom = 2000;
+static uint64_t rng_state = 42;
+
+static uint64_t xorshift(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// smooth synthetic terrain in decimetres, a function of the global pixel position
+static int32_t synthElevation(int64_t gx, int64_t gy) {
+    double e = 1200.0 + 900.0 * sin(gx * 2.0 * M_PI / 6000.0) * cos(gy * 2.0 * M_PI / 8000.0)
+               + 40.0 * sin(gx / 37.0) * cos(gy / 53.0);
+    return (int32_t)lround(e * 10.0);
+}
+
+// the terrain at global pixel gx/gy of zoom z of an archive: at its zoom
+// synthElevation(), below at the centre of the area the pixel covers
+static int32_t zoomElevation(const archive_t *a, int z, int64_t gx, int64_t gy) {
+    int64_t s = (int64_t)1 << (a->zoom - z);
+    return synthElevation(gx * s + s / 2, gy * s + s / 2);
+}
+
+// tiles an archive with lower zooms lacks: one at its zoom on the middle
+// row, and another there with the one above it at the next zoom down
+static bool zoomHole(const archive_t *a, int z, int64_t x, int64_t y) {
+    int shift = a->zoom - z;
+    int64_t row = a->y0 + a->ntiles / 2;
+    if (a->levels == 0)
+        return false;
+    if ((shift == 0) && (x == a->x0 + 1) && (y == row))
+        return true;
+    return (shift <= 1) && (x == (a->x0 + a->ntiles - 2) >> shift) && (y == row >> shift);
+}
+
+static void elevationToRGB(int32_t dm, uint8_t *px) {
+    uint32_t code = (uint32_t)(dm + 100000);
+    px[0] = (code >> 16) & 0xff;
+    px[1] = (code >> 8) & 0xff;
+    px[2] = code & 0xff;
+}
+
+static void pngChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, uint32_t len) {
+    uint8_t hdr[8] = { (uint8_t)(len >> 24), (uint8_t)(len >> 16), (uint8_t)(len >> 8), (uint8_t)len };
+    memcpy(hdr + 4, type, 4);
+    out.insert(out.end(), hdr, hdr + 8);
+    if (len)
+        out.insert(out.end(), data, data + len);
+    uint32_t crc = crc32(0, hdr + 4, 4);
+    if (len)
+        crc = crc32(crc, data, len);
+    uint8_t c[4] = { (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc };
+    out.insert(out.end(), c, c + 4);
+}
+
+// 8bit RGB, Sub filter on every row, zlib level 9
+static void encodePNG(const uint8_t *rgb, int w, int h, std::vector<uint8_t> &out) {
+    static const uint8_t sig[] = { 0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A };
+    uint8_t ihdr[13] = { (uint8_t)(w >> 24), (uint8_t)(w >> 16), (uint8_t)(w >> 8), (uint8_t)w,
+                         (uint8_t)(h >> 24), (uint8_t)(h >> 16), (uint8_t)(h >> 8), (uint8_t)h,
+                         8, 2, 0, 0, 0
+                       };
+    std::vector<uint8_t> raw((size_t)(w * 3 + 1) * h);
+    for (int y = 0; y < h; y++) {
+        uint8_t *dst = &raw[(size_t)(w * 3 + 1) * y];
+        const uint8_t *src = rgb + (size_t)w * 3 * y;
+        dst[0] = 1;
+        for (int i = 0; i < w * 3; i++)
+            dst[i + 1] = src[i] - (i >= 3 ? src[i - 3] : 0);
+    }
+    uLongf zlen = compressBound(raw.size());
+    std::vector<uint8_t> z(zlen);
+    compress2(z.data(), &zlen, raw.data(), raw.size(), 9);
+
+    out.assign(sig, sig + sizeof(sig));
+    pngChunk(out, "IHDR", ihdr, sizeof(ihdr));
+    // 8k IDAT chunks like libpng
+    for (uLongf off = 0; off < zlen; off += 8192)
+        pngChunk(out, "IDAT", z.data() + off, std::min<uLongf>(8192, zlen - off));
+    pngChunk(out, "IEND", NULL, 0);
+}
+
+static int writeArchive(archive_t *a) {
+    sqlite3 *db;
+    sqlite3_stmt *stmt, *images = NULL;
+    uint8_t *rgb = (uint8_t *)malloc(TILESIZE * TILESIZE * 3);
+
+    unlink(a->path.c_str());
+    int rc = sqlite3_open(a->path.c_str(), &db);
+    if (rc != SQLITE_OK) {
+        LOG_ERROR("can't create %s: %s", a->path.c_str(), sqlite3_errmsg(db));
+        return rc;
+    }
+    if (a->deduplicated) {
+        sqlite3_exec(db, "CREATE TABLE metadata (name text, value text);"
+                     "CREATE TABLE map (zoom_level integer, tile_column integer,"
+                     " tile_row integer, tile_id text);"
+                     "CREATE TABLE images (tile_data blob, tile_id text);"
+                     "CREATE UNIQUE INDEX map_index on map (zoom_level, tile_column, tile_row);"
+                     "CREATE UNIQUE INDEX images_id on images (tile_id);"
+                     "CREATE VIEW tiles AS SELECT map.zoom_level AS zoom_level,"
+                     " map.tile_column AS tile_column, map.tile_row AS tile_row,"
+                     " images.tile_data AS tile_data FROM map JOIN images ON images.tile_id = map.tile_id;"
+                     "BEGIN;", NULL, NULL, NULL);
+        sqlite3_prepare_v2(db, "INSERT INTO map VALUES (?1, ?2, ?3, ?1 || '/' || ?2 || '/' || ?3);"
+                           , -1, &stmt, NULL);
+        sqlite3_prepare_v2(db, "INSERT INTO images VALUES (?4, ?1 || '/' || ?2 || '/' || ?3)",
+                           -1, &images, NULL);
+    } else {
+        sqlite3_exec(db, "CREATE TABLE metadata (name text, value text);"
+                     "CREATE TABLE tiles (zoom_level integer, tile_column integer,"
+                     " tile_row integer, tile_data blob);"
+                     "CREATE UNIQUE INDEX tile_index on tiles (zoom_level, tile_column, tile_row);"
+                     "BEGIN;", NULL, NULL, NULL);
+        sqlite3_prepare_v2(db, "INSERT INTO tiles VALUES (?, ?, ?, ?)", -1, &stmt, NULL);
+    }
+
+    a->blob_bytes = 0;
+    for (int z = a->zoom - a->levels; z <= (int)a->zoom; z++) {
+        int shift = a->zoom - z;
+        for (int ty = a->y0 >> shift; ty <= (a->y0 + a->ntiles - 1) >> shift; ty++) {
+            for (int tx = a->x0 >> shift; tx <= (a->x0 + a->ntiles - 1) >> shift; tx++) {
+                int64_t gx0 = (int64_t)tx * TILESIZE;
+                int64_t gy0 = (int64_t)ty * TILESIZE;
+                if (zoomHole(a, z, tx, ty))
+                    continue;
+                if (a->empty)
+                    memset(rgb, 0, TILESIZE * TILESIZE * 3);
+                else if (a->flat != 0)
+                    for (int i = 0; i < TILESIZE * TILESIZE; i++)
+                        elevationToRGB(a->flat, &rgb[i * 3]);
+                else
+                    for (int y = 0; y < TILESIZE; y++)
+                        for (int x = 0; x < TILESIZE; x++)
+                            elevationToRGB(zoomElevation(a, z, gx0 + x, gy0 + y), &rgb[(y * TILESIZE + x) * 3]);
+
+                std::vector<uint8_t> blob;
+                if (a->encoding == ENC_PNG) {
+                    encodePNG(rgb, TILESIZE, TILESIZE, blob);
+                } else {
+                    uint8_t *out = NULL;
+                    size_t len = WebPEncodeLosslessRGB(rgb, TILESIZE, TILESIZE, TILESIZE * 3, &out);
+                    blob.assign(out, out + len);
+                    WebPFree(out);
+                }
+                a->blob_bytes += blob.size();
+                sqlite3_bind_int(stmt, 1, z);
+                sqlite3_bind_int(stmt, 2, tx);
+                sqlite3_bind_int(stmt, 3, ty);
+                if (images != NULL) {
+                    sqlite3_bind_int(images, 1, z);
+                    sqlite3_bind_int(images, 2, tx);
+                    sqlite3_bind_int(images, 3, ty);
+                    sqlite3_bind_blob(images, 4, blob.data(), blob.size(), SQLITE_TRANSIENT);
+                    sqlite3_step(images);
+                    sqlite3_reset(images);
+                } else {
+                    sqlite3_bind_blob(stmt, 4, blob.data(), blob.size(), SQLITE_TRANSIENT);
+                }
+                sqlite3_step(stmt);
+                sqlite3_reset(stmt);
+            }
+        }
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(images);
+    if (!a->deduplicated) {
+        // the deduplicated archive has no metadata: addDEM() scans it
+        char meta[256];
+        snprintf(meta, sizeof(meta), "INSERT INTO metadata VALUES ('bounds', '%.9f,%.9f,%.9f,%.9f'),"
+                 " ('minzoom', '%u'), ('maxzoom', '%u'), ('format', '%s');",
+                 tilex2long(a->x0, a->zoom), tiley2lat(a->y0 + a->ntiles, a->zoom),
+                 tilex2long(a->x0 + a->ntiles, a->zoom), tiley2lat(a->y0, a->zoom),
+                 a->zoom - a->levels, a->zoom, (a->encoding == ENC_PNG) ? "png" : "webp");
+        sqlite3_exec(db, meta, NULL, NULL, NULL);
+    }
+    sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+    sqlite3_close(db);
+    free(rgb);
+    return SQLITE_OK;
+}
+
+static void pixelToLatLon(double gx, double gy, double &lat, double &lon, uint32_t zoom = BENCH_ZOOM) {
+    double world = (double)TILESIZE * (1 << zoom);
+    lon = gx / world * 360.0 - 180.0;
+    lat = to_degrees(atan(sinh(M_PI * (1.0 - 2.0 * gy / world))));
+}
+
+// a point a quarter pixel into pixel (px, py) of tile (tx, ty) of the archive
+static void archivePoint(const archive_t *a, int tx, int ty, int px, int py, double &lat, double &lon) {
+    pixelToLatLon((double)(a->x0 + tx) * TILESIZE + px + 0.25,
+                  (double)(a->y0 + ty) * TILESIZE + py + 0.25, lat, lon);
+}
+
+static bool checkElevation(const archive_t *a, int tx, int ty, int px, int py, const locInfo_t *li) {
+    int32_t dm = synthElevation((int64_t)(a->x0 + tx) * TILESIZE + px,
+                                (int64_t)(a->y0 + ty) * TILESIZE + py);
+    return (li->status == LS_VALID) && (fabs(li->elevation - dm / 10.0) < 0.05);
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty())
+        return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(p * (v.size() - 1))];
+}
+
+static double mean(const std::vector<double> &v) {
+    double sum = 0.0;
+    for (auto x : v)
+        sum += x;
+    return v.empty() ? 0.0 : sum / v.size();
+}
+
+static void benchCold(archive_t *a) {
+    std::vector<double> total, fetch, decode;
+    locInfo_t li;
+    int64_t start;
+    int bad = 0;
+
+    flushCache();
+    hostHeapResetPeak();
+    for (int ty = 0; ty < ntiles; ty++) {
+        for (int tx = 0; tx < ntiles; tx++) {
+            double lat, lon;
+            int px = xorshift() % TILESIZE, py = xorshift() % TILESIZE;
+            archivePoint(a, tx, ty, px, py, lat, lon);
+            uint64_t f = a->di->fetch_us, d = a->di->decode_us;
+            li = {};
+            STARTTIME(start);
+            getLocInfo(lat, lon, &li);
+            total.push_back(LAPTIME(start) / 1000.0);
+            fetch.push_back((a->di->fetch_us - f) / 1000.0);
+            decode.push_back((a->di->decode_us - d) / 1000.0);
+            if (!checkElevation(a, tx, ty, px, py, &li))
+                bad++;
+        }
+    }
+    printf("%-5s cold   %4zu misses  total mean %7.3f p50 %7.3f p99 %7.3f ms"
+           "  fetch mean %6.3f ms  decode mean %7.3f ms  blob avg %zu bytes\n",
+           a->name.c_str(), total.size(), mean(total), percentile(total, 0.5), percentile(total, 0.99),
+           mean(fetch), mean(decode), a->blob_bytes / (ntiles * ntiles));
+    printf("%-5s cold   peak tile memory %zu bytes, %d wrong elevations\n",
+           a->name.c_str(), hostHeapPeak(), bad);
+}
+
+static size_t fileSize(const std::string &path) {
+    struct stat st;
+    return (stat(path.c_str(), &st) == 0) ? st.st_size : 0;
+}
+
+// decode half a cache of tiles and save them, then the rest and save again
+// over the first snapshot, as a periodic save does; flush, load them back
+// from the snapshot as addDEM() does after a restart and look them up again
+static void benchSnapshot(archive_t *a, size_t cachesize) {
+    int n = std::min((int)cachesize, ntiles * ntiles);
+    std::vector<double> decode;
+    locInfo_t li;
+    int64_t start;
+    int bad = 0, first = 0;
+
+    flushCache();
+    for (int i = 0; i < n; i++) {
+        double lat, lon;
+        archivePoint(a, i % ntiles, i / ntiles, 30, 30, lat, lon);
+        li = {};
+        STARTTIME(start);
+        getLocInfo(lat, lon, &li);
+        decode.push_back(LAPTIME(start) / 1000.0);
+        if (i == n / 2)
+            first = saveCacheSnapshot();
+    }
+    STARTTIME(start);
+    int saved = saveCacheSnapshot();
+    double save_ms = LAPTIME(start) / 1000.0;
+    flushCache();
+    STARTTIME(start);
+    int loaded = loadCacheSnapshot(a->di);
+    double load_ms = LAPTIME(start) / 1000.0;
+    uint32_t misses = a->di->cache_misses;
+    for (int i = 0; i < n; i++) {
+        double lat, lon;
+        archivePoint(a, i % ntiles, i / ntiles, 200, 200, lat, lon);
+        li = {};
+        getLocInfo(lat, lon, &li);
+        bad += !checkElevation(a, i % ntiles, i / ntiles, 200, 200, &li);
+    }
+    // the second save replaced the first: all of its tiles come back
+    bool replaced = (first > 0) && (saved > first) && (loaded == n);
+    printf("%-5s snapshot %d tiles saved in %.3f ms over %d saved before %s, %zu bytes, %d loaded in %.3f ms:"
+           " %.3f ms/tile against %.3f ms/tile decoding, %u misses after, %d wrong elevations\n", a->name.c_str(),
+           saved, save_ms, first, replaced ? "ok" : "WRONG", fileSize(a->path + DEM_SNAPSHOT), loaded, load_ms,
+           loaded ? load_ms / loaded : 0.0, mean(decode), (uint32_t)a->di->cache_misses - misses, bad);
+}
+
+static void benchHit(archive_t *a) {
+    locInfo_t li = {};
+    double lat, lon;
+    int64_t start;
+    int n = nlookups;
+
+    archivePoint(a, ntiles / 2, ntiles / 2, 100, 100, lat, lon);
+    getLocInfo(lat, lon, &li);
+    size_t allocs = hostHeapAllocs();
+    STARTTIME(start);
+    for (int i = 0; i < n; i++)
+        getLocInfo(lat, lon, &li);
+    double us = LAPTIME(start);
+    printf("%-5s hit    %d lookups  %.1f ns/lookup  %zu tile allocations  %s\n", a->name.c_str(), n,
+           us * 1000.0 / n, hostHeapAllocs() - allocs,
+           checkElevation(a, ntiles / 2, ntiles / 2, 100, 100, &li) ? "ok" : "WRONG");
+}
+
+static void benchThroughput(archive_t *a, size_t cachesize) {
+    locInfo_t li;
+    int64_t start;
+    int n = nrandom;
+    int bad = 0;
+    uint32_t hits = a->di->cache_hits, misses = a->di->cache_misses;
+
+    flushCache();
+    size_t allocs = hostHeapAllocs();
+    STARTTIME(start);
+    for (int i = 0; i < n; i++) {
+        double lat, lon;
+        int tx = xorshift() % ntiles, ty = xorshift() % ntiles;
+        int px = xorshift() % TILESIZE, py = xorshift() % TILESIZE;
+        archivePoint(a, tx, ty, px, py, lat, lon);
+        li = {};
+        getLocInfo(lat, lon, &li);
+        if (!checkElevation(a, tx, ty, px, py, &li))
+            bad++;
+    }
+    double secs = LAPTIME(start) / 1e6;
+    hits = a->di->cache_hits - hits;
+    misses = a->di->cache_misses - misses;
+    allocs = hostHeapAllocs() - allocs;
+    printf("%-5s random %d lookups over %d tiles, cache %zu: %.0f lookups/s"
+           "  hit ratio %.3f  %d wrong elevations\n",
+           a->name.c_str(), n, ntiles * ntiles, cachesize, n / secs,
+           (double)hits / (hits + misses), bad);
+    printf("%-5s random %u misses: %.2f heap_caps allocations per miss\n",
+           a->name.c_str(), misses, misses ? (double)allocs / misses : 0.0);
+}
+
+// random lookups with the blob cache off and on: tile misses found there
+// cost a decode but no database read
+#define TIERS_BLOB_BYTES (256 * 1024)
+static void benchTiers(archive_t *a, size_t cachesize) {
+    cacheStats_t stats;
+
+    getCacheStats(&stats);
+    for (int pass = 0; pass < 2; pass++) {
+        cacheStats_t before, after;
+        int64_t start;
+        int n = nrandom;
+        int bad = 0;
+
+        setCacheBytes(cachesize * (sizeof(tile_t) + TILESIZE * TILESIZE * sizeof(int16_t)),
+                      pass ? TIERS_BLOB_BYTES : 0);
+        flushCache();
+        getCacheStats(&before);
+        STARTTIME(start);
+        for (int i = 0; i < n; i++) {
+            double lat, lon;
+            locInfo_t li = {};
+            int tx = xorshift() % ntiles, ty = xorshift() % ntiles;
+            int px = xorshift() % TILESIZE, py = xorshift() % TILESIZE;
+            archivePoint(a, tx, ty, px, py, lat, lon);
+            getLocInfo(lat, lon, &li);
+            bad += !checkElevation(a, tx, ty, px, py, &li);
+        }
+        double secs = LAPTIME(start) / 1e6;
+        getCacheStats(&after);
+        uint32_t hits = after.tile_hits - before.tile_hits, misses = after.tile_misses - before.tile_misses;
+        printf("%-5s tiers  blob cache %4zu kB: %.0f lookups/s  tile hit ratio %.3f  %u misses: %u from blobs,"
+               " %u database reads, %u demoted %u evicted, %d wrong elevations\n",
+               a->name.c_str(), after.blob_bytes / 1024, n / secs, (double)hits / (hits + misses), misses,
+               after.blob_hits - before.blob_hits, after.blob_misses - before.blob_misses,
+               after.blob_demotions - before.blob_demotions, after.blob_evictions - before.blob_evictions, bad);
+    }
+    setCacheBytes(stats.tile_bytes, stats.blob_bytes);
+}
+
+static void benchBatch(archive_t *a) {
+    int n = nrandom;
+    std::vector<double> lat(n), lon(n);
+    std::vector<int> tx(n), ty(n), px(n), py(n);
+    std::vector<locInfo_t> li(n);
+    int64_t start;
+    int bad = 0;
+    uint32_t misses = a->di->cache_misses, fetches = a->di->fetches;
+    uint32_t prepares = a->di->stmt_prepares, waits = a->di->pool_waits;
+    uint64_t fetch_us = a->di->fetch_us;
+
+    for (int i = 0; i < n; i++) {
+        tx[i] = xorshift() % ntiles;
+        ty[i] = xorshift() % ntiles;
+        px[i] = xorshift() % TILESIZE;
+        py[i] = xorshift() % TILESIZE;
+        archivePoint(a, tx[i], ty[i], px[i], py[i], lat[i], lon[i]);
+    }
+    flushCache();
+    STARTTIME(start);
+    getLocInfoBatch(lat.data(), lon.data(), n, li.data());
+    double secs = LAPTIME(start) / 1e6;
+    for (int i = 0; i < n; i++) {
+        if (!checkElevation(a, tx[i], ty[i], px[i], py[i], &li[i]))
+            bad++;
+    }
+    fetches = a->di->fetches - fetches;
+    printf("%-5s batch  %d lookups over %d tiles: %.0f lookups/s  %u tile decodes  %d wrong elevations\n",
+           a->name.c_str(), n, ntiles * ntiles, n / secs, a->di->cache_misses - misses, bad);
+    printf("%-5s batch  %u fetches, fetch mean %.3f ms, %u statements prepared, %u pool connections, %u waits\n",
+           a->name.c_str(), fetches, fetches ? (a->di->fetch_us - fetch_us) / 1000.0 / fetches : 0.0,
+           a->di->stmt_prepares - prepares, (uint32_t)a->di->pool_opens, a->di->pool_waits - waits);
+}
+
+// lookups on several threads at once: hit throughput with every tile cached,
+// then threads missing the same tile together, which should load it once
+static void benchThreads(archive_t *a, size_t cachesize) {
+    demInfo_t *di = a->di;
+    int counts[] = { 1, 2, 4, 8 };
+    double base = 0.0;
+
+    // room to spare: the tiles don't spread evenly over the shards
+    setCacheSize(2 * ntiles * ntiles);
+    for (int ty = 0; ty < ntiles; ty++) {
+        for (int tx = 0; tx < ntiles; tx++) {
+            locInfo_t li = {};
+            double lat, lon;
+            archivePoint(a, tx, ty, 0, 0, lat, lon);
+            getLocInfo(lat, lon, &li);
+        }
+    }
+    for (int nthreads : counts) {
+        std::vector<std::thread> threads;
+        std::atomic<int> bad(0);
+        uint32_t misses = di->cache_misses;
+        int n = nlookups / nthreads;
+        int64_t start;
+
+        STARTTIME(start);
+        for (int t = 0; t < nthreads; t++) {
+            threads.emplace_back([a, n, t, &bad]() {
+                uint64_t rng = 0x9E3779B97F4A7C15ull * (t + 1);
+                for (int i = 0; i < n; i++) {
+                    locInfo_t li = {};
+                    double lat, lon;
+                    rng ^= rng << 13;
+                    rng ^= rng >> 7;
+                    rng ^= rng << 17;
+                    int tx = rng % ntiles, ty = (rng >> 8) % ntiles;
+                    int px = (rng >> 16) % TILESIZE, py = (rng >> 32) % TILESIZE;
+                    archivePoint(a, tx, ty, px, py, lat, lon);
+                    getLocInfo(lat, lon, &li);
+                    if (!checkElevation(a, tx, ty, px, py, &li))
+                        bad++;
+                }
+            });
+        }
+        for (auto &th: threads) {
+            th.join();
+        }
+        double secs = LAPTIME(start) / 1e6;
+        double rate = n * nthreads / secs;
+        if (nthreads == 1)
+            base = rate;
+        printf("%-5s threads %d: %d hits each, %.0f lookups/s, %.2fx one thread, %u misses, %d wrong elevations\n",
+               a->name.c_str(), nthreads, n, rate, rate / base, di->cache_misses - misses, bad.load());
+    }
+
+    std::vector<std::thread> threads;
+    std::atomic<int> ready(0), bad(0);
+    int nthreads = 8;
+    double lat, lon;
+    uint32_t fetches = di->fetches, coalesced = di->coalesced;
+
+    flushCache();
+    archivePoint(a, ntiles / 2, ntiles / 2, 100, 100, lat, lon);
+    for (int t = 0; t < nthreads; t++) {
+        threads.emplace_back([a, lat, lon, nthreads, &ready, &bad]() {
+            locInfo_t li = {};
+            ready++;
+            while (ready < nthreads)
+                std::this_thread::yield();
+            getLocInfo(lat, lon, &li);
+            if (!checkElevation(a, ntiles / 2, ntiles / 2, 100, 100, &li))
+                bad++;
+        });
+    }
+    for (auto &th: threads) {
+        th.join();
+    }
+    printf("%-5s threads %d missing one tile: %u fetches, %u waited for another's load, %d wrong elevations\n",
+           a->name.c_str(), nthreads, di->fetches - fetches, di->coalesced - coalesced, bad.load());
+
+    // batches missing the same tiles together, which should load each once
+    int nbatches = 4, npoints = ntiles * ntiles;
+    std::vector<double> blat(npoints), blon(npoints);
+    for (int i = 0; i < npoints; i++) {
+        archivePoint(a, i % ntiles, i / ntiles, 100, 100, blat[i], blon[i]);
+    }
+    threads.clear();
+    ready = 0;
+    bad = 0;
+    fetches = di->fetches;
+    coalesced = di->coalesced;
+    flushCache();
+    for (int t = 0; t < nbatches; t++) {
+        threads.emplace_back([a, npoints, nbatches, &blat, &blon, &ready, &bad]() {
+            std::vector<locInfo_t> li(npoints);
+            ready++;
+            while (ready < nbatches)
+                std::this_thread::yield();
+            getLocInfoBatch(blat.data(), blon.data(), npoints, li.data());
+            for (int i = 0; i < npoints; i++) {
+                if (!checkElevation(a, i % ntiles, i / ntiles, 100, 100, &li[i]))
+                    bad++;
+            }
+        });
+    }
+    for (auto &th: threads) {
+        th.join();
+    }
+    printf("%-5s threads %d batches missing %d tiles: %u fetches %s, %u waited for another's load, %d wrong elevations\n",
+           a->name.c_str(), nbatches, npoints, di->fetches - fetches,
+           (di->fetches - fetches == (uint32_t)npoints) ? "ok" : "WRONG", di->coalesced - coalesced, bad.load());
+    setCacheSize(cachesize);
+}
+
+static double synthMetres(int64_t gx, int64_t gy) {
+    return synthElevation(gx, gy) / 10.0;
+}
+
+static void keysWeights(double t, double *w) {
+    w[0] = ((-0.5 * t + 1.0) * t - 0.5) * t;
+    w[1] = (1.5 * t - 2.5) * t * t + 1.0;
+    w[2] = ((-1.5 * t + 2.0) * t + 0.5) * t;
+    w[3] = (0.5 * t - 0.5) * t * t;
+}
+
+// reference interpolation at a global pixel position, pixel centres at .5
+// like gdallocationinfo -r bilinear / -r cubic
+static double referenceElevation(interp_t mode, double gx, double gy) {
+    double u = gx - 0.5, v = gy - 0.5;
+    int64_t x0 = (int64_t)floor(u), y0 = (int64_t)floor(v);
+    double fx = u - x0, fy = v - y0;
+
+    if (mode == INTERP_BILINEAR) {
+        return (1 - fx) * (1 - fy) * synthMetres(x0, y0) + fx * (1 - fy) * synthMetres(x0 + 1, y0) +
+               (1 - fx) * fy * synthMetres(x0, y0 + 1) + fx * fy * synthMetres(x0 + 1, y0 + 1);
+    }
+    double wx[4], wy[4], e = 0.0;
+    keysWeights(fx, wx);
+    keysWeights(fy, wy);
+    for (int j = 0; j < 4; j++)
+        for (int i = 0; i < 4; i++)
+            e += wy[j] * wx[i] * synthMetres(x0 - 1 + i, y0 - 1 + j);
+    return e;
+}
+
+// interpolated lookups against the reference, single and batch, with half of
+// the samples within two pixels of a tile edge so the kernel crosses tiles
+static void benchInterp(archive_t *a, interp_t mode, const char *name) {
+    int n = nrandom;
+    int span = ntiles * TILESIZE;
+    std::vector<double> lat(n), lon(n), ref(n);
+    std::vector<locInfo_t> li(n);
+    double maxerr = 0.0, maxerr_batch = 0.0;
+    int64_t start;
+    int bad = 0;
+
+    for (int i = 0; i < n; i++) {
+        double x = 2.0 + (xorshift() % ((span - 4) * 100)) / 100.0;
+        double y = 2.0 + (xorshift() % ((span - 4) * 100)) / 100.0;
+        if (i & 1) {
+            // snap to within +-2 pixels of a tile edge
+            x = (lround(x / TILESIZE) * TILESIZE) + ((xorshift() % 400) - 200) / 100.0;
+            x = (x < 2.0) ? 2.0 : ((x > span - 2) ? span - 2 : x);
+        }
+        double gx = (double)a->x0 * TILESIZE + x, gy = (double)a->y0 * TILESIZE + y;
+        pixelToLatLon(gx, gy, lat[i], lon[i]);
+        ref[i] = referenceElevation(mode, gx, gy);
+    }
+    for (int i = 0; i < n; i++) {
+        locInfo_t r = {};
+        getLocInfo(lat[i], lon[i], &r, mode);
+        if (r.status != LS_VALID)
+            bad++;
+        maxerr = std::max(maxerr, fabs(r.elevation - ref[i]));
+    }
+    STARTTIME(start);
+    getLocInfoBatch(lat.data(), lon.data(), n, li.data(), mode);
+    double secs = LAPTIME(start) / 1e6;
+    for (int i = 0; i < n; i++) {
+        if (li[i].status != LS_VALID)
+            bad++;
+        maxerr_batch = std::max(maxerr_batch, fabs(li[i].elevation - ref[i]));
+    }
+    printf("%-5s %-8s %d lookups: max error %.4f m single, %.4f m batch, batch %.0f lookups/s,"
+           " %d not valid\n", a->name.c_str(), name, n, maxerr, maxerr_batch, n / secs, bad);
+}
+
+// an elevation profile along three legs across the archive, half a pixel
+// apart, against a getLocInfo() per sample: time and tile accesses from a
+// cold cache, then bilinear against the reference and line of sight at the
+// highest sample and just above it
+static void benchProfile(archive_t *a, size_t cachesize) {
+    demInfo_t *di = a->di;
+    int span = ntiles * TILESIZE;
+    double gx[] = { 2.0, span - 3.0, span / 2.0 }, gy[] = { 2.0, span / 2.0, span - 3.0 };
+    double lat[3], lon[3];
+    int64_t start;
+
+    for (int i = 0; i < 3; i++)
+        pixelToLatLon((double)a->x0 * TILESIZE + gx[i], (double)a->y0 * TILESIZE + gy[i], lat[i], lon[i]);
+    double spacing = resolution(lat[0], BENCH_ZOOM) / 2;
+    size_t max = 4 * span;
+    std::vector<pathSample_t> profile(max), bilinear(max);
+
+    setCacheSize(cachesize);
+    flushCache();
+    uint32_t accesses = di->cache_hits + di->cache_misses;
+    STARTTIME(start);
+    size_t n = getProfile(lat, lon, 3, spacing, profile.data(), max);
+    double profile_ms = LAPTIME(start) / 1000.0;
+    accesses = di->cache_hits + di->cache_misses - accesses;
+
+    flushCache();
+    uint32_t point_accesses = di->cache_hits + di->cache_misses;
+    int differ = 0, invalid = 0;
+    STARTTIME(start);
+    for (size_t i = 0; i < n; i++) {
+        locInfo_t li = {};
+        getLocInfo(profile[i].lat, profile[i].lon, &li);
+        differ += (li.status != profile[i].locinfo.status) || (li.elevation != profile[i].locinfo.elevation);
+    }
+    double point_ms = LAPTIME(start) / 1000.0;
+    point_accesses = di->cache_hits + di->cache_misses - point_accesses;
+    printf("%-5s profile %zu samples %.0f m apart over %.1f km: %.3f ms %u tile accesses, a lookup each %.3f ms"
+           " %u tile accesses, %d differ\n", a->name.c_str(), n, spacing, profile[n - 1].distance / 1000.0,
+           profile_ms, accesses, point_ms, point_accesses, differ);
+    // again with the tiles cached: what is left is the cost per sample
+    setCacheSize(2 * ntiles * ntiles);
+    getProfile(lat, lon, 3, spacing, bilinear.data(), max);
+    STARTTIME(start);
+    getProfile(lat, lon, 3, spacing, bilinear.data(), max);
+    profile_ms = LAPTIME(start) / 1000.0;
+    STARTTIME(start);
+    for (size_t i = 0; i < n; i++) {
+        locInfo_t li = {};
+        getLocInfo(profile[i].lat, profile[i].lon, &li);
+    }
+    point_ms = LAPTIME(start) / 1000.0;
+    printf("%-5s profile cached: %.1f ns/sample, a lookup each %.1f ns/sample\n", a->name.c_str(),
+           profile_ms * 1e6 / n, point_ms * 1e6 / n);
+    setCacheSize(cachesize);
+
+    double maxerr = 0.0;
+    size_t nb = getProfile(lat, lon, 3, spacing, bilinear.data(), max, INTERP_BILINEAR);
+    for (size_t i = 0; i < nb; i++) {
+        double x, y;
+        lat_lon_to_pixel(bilinear[i].lat, bilinear[i].lon, BENCH_ZOOM, TILESIZE, x, y);
+        invalid += (bilinear[i].locinfo.status != LS_VALID);
+        maxerr = std::max(maxerr, fabs(bilinear[i].locinfo.elevation - referenceElevation(INTERP_BILINEAR, x, y)));
+    }
+
+    // a level path at the highest sample's elevation hits the first sample above it
+    size_t top = 0, first = n;
+    for (size_t i = 0; i < n; i++) {
+        if (profile[i].locinfo.elevation > profile[top].locinfo.elevation)
+            top = i;
+    }
+    double level = profile[top].locinfo.elevation - 1.0;
+    for (size_t i = 0; (i < n) && (first == n); i++) {
+        if ((profile[i].locinfo.status == LS_VALID) && (profile[i].locinfo.elevation > level))
+            first = i;
+    }
+    pathSample_t hit = {}, none = {};
+    STARTTIME(start);
+    bool hits = getTerrainIntersection(lat, lon, 3, spacing, level, level, &hit);
+    double los_ms = LAPTIME(start) / 1000.0;
+    bool above = getTerrainIntersection(lat, lon, 3, spacing, level + 2.0, level + 2.0, &none);
+    bool right = hits && (first < n) && (fabs(hit.distance - profile[first].distance) < 0.01);
+    printf("%-5s profile bilinear max error %.4f m, %d not valid; line of sight at %.1f m hits at %.0f m %s in %.3f ms,"
+           " 2 m higher %s\n", a->name.c_str(), maxerr, invalid, level, hits ? hit.distance : 0.0,
+           right ? "as expected" : "WRONG", los_ms, above ? "hits: WRONG" : "clear");
+}
+
+// the highest elevation in dm any archive holds in bbox, from the terrain
+// itself; with a radius only pixels whose centre is that close to lat/lon
+static int32_t bruteMax(const std::vector<archive_t> &archives, const bbox_t &bbox,
+                        double lat = 0.0, double lon = 0.0, double radius = 0.0) {
+    int32_t best = INT32_MIN;
+    for (auto &a : archives) {
+        if (a.empty)
+            continue;
+        double x0, y0, x1, y1;
+        lat_lon_to_pixel(bbox.tr_lat, bbox.ll_lon, a.zoom, TILESIZE, x0, y0);
+        lat_lon_to_pixel(bbox.ll_lat, bbox.tr_lon, a.zoom, TILESIZE, x1, y1);
+        int64_t ax0 = (int64_t)a.x0 * TILESIZE, ay0 = (int64_t)a.y0 * TILESIZE;
+        int64_t gx0 = std::max<int64_t>(floor(x0), ax0), gx1 = std::min<int64_t>(ceil(x1), ax0 + a.ntiles * TILESIZE);
+        int64_t gy0 = std::max<int64_t>(floor(y0), ay0), gy1 = std::min<int64_t>(ceil(y1), ay0 + a.ntiles * TILESIZE);
+        for (int64_t gy = gy0; gy < gy1; gy++) {
+            for (int64_t gx = gx0; gx < gx1; gx++) {
+                if (radius > 0.0) {
+                    double plat, plon;
+                    pixelToLatLon(gx + 0.5, gy + 0.5, plat, plon, a.zoom);
+                    double dn = (plat - lat) * 111320.0, de = (plon - lon) * 111320.0 * cos(to_radians(lat));
+                    if (dn * dn + de * de > radius * radius)
+                        continue;
+                }
+                best = std::max(best, a.flat ? a.flat : synthElevation(gx, gy));
+            }
+        }
+    }
+    return best;
+}
+
+// getAreaMaxElevation() over a bbox across tile edges, a circle and all of
+// the archive: cold (summaries only as far as the archive has them) and
+// warm, against the terrain
+static void benchArea(const std::vector<archive_t> &archives, const archive_t *a, size_t cachesize) {
+    int span = ntiles * TILESIZE;
+    int64_t ax = (int64_t)a->x0 * TILESIZE, ay = (int64_t)a->y0 * TILESIZE;
+    bbox_t box, all = a->di->bbox;
+    double clat, clon, radius = 1.5 * TILESIZE * resolution(all.ll_lat, BENCH_ZOOM);
+    int64_t start;
+
+    pixelToLatLon(ax + span * 0.2, ay + span * 0.75, box.ll_lat, box.ll_lon);
+    pixelToLatLon(ax + span * 0.7, ay + span * 0.3, box.tr_lat, box.tr_lon);
+    pixelToLatLon(ax + span * 0.5, ay + span * 0.5, clat, clon);
+    double dlat = radius / 111320.0, dlon = dlat / cos(to_radians(clat));
+    bbox_t square = { clat - dlat, clon - dlon, clat + dlat, clon + dlon };
+    int32_t want = bruteMax(archives, box), want_all = bruteMax(archives, all);
+    int32_t inner = bruteMax(archives, square, clat, clon, radius * 0.99), outer = bruteMax(archives, square);
+
+    setCacheSize(2 * ntiles * ntiles);
+    flushCache();
+    auto misses = [&]() {
+        uint32_t m = 0;
+        for (auto &b : archives)
+            m += b.di->cache_misses;
+        return m;
+    };
+    locInfo_t li = {}, circle = {}, whole = {};
+    uint32_t m = misses();
+    STARTTIME(start);
+    getAreaMaxElevation(&box, &li);
+    double cold_ms = LAPTIME(start) / 1000.0;
+    uint32_t cold_decodes = misses() - m;
+    m = misses();
+    STARTTIME(start);
+    getAreaMaxElevation(&box, &li);
+    double warm_ms = LAPTIME(start) / 1000.0;
+    uint32_t warm_decodes = misses() - m;
+    STARTTIME(start);
+    getAreaMaxElevation(clat, clon, radius, &circle);
+    double circle_ms = LAPTIME(start) / 1000.0;
+    STARTTIME(start);
+    getAreaMaxElevation(&all, &whole);
+    double all_ms = LAPTIME(start) / 1000.0;
+
+    bool right = (li.status == LS_VALID) && (fabs(li.elevation - want / 10.0) < 0.05);
+    bool bounded = (circle.status == LS_VALID) && (circle.elevation >= inner / 10.0 - 0.05) &&
+                   (circle.elevation <= outer / 10.0 + 0.05);
+    bool right_all = (whole.status == LS_VALID) && (fabs(whole.elevation - want_all / 10.0) < 0.05);
+    printf("%-5s area   bbox max %.1f m %s: cold %.3f ms %u tile decodes, warm %.3f ms %u decodes;"
+           " circle %.0f m max %.1f m %s in %.3f ms; all of it %.1f m %s in %.3f ms, %d wrong\n",
+           a->name.c_str(), li.elevation, right ? "as expected" : "WRONG", cold_ms, cold_decodes, warm_ms,
+           warm_decodes, radius, circle.elevation, bounded ? "within bounds" : "WRONG", circle_ms,
+           whole.elevation, right_all ? "as expected" : "WRONG", all_ms, !right + !bounded + !right_all);
+    setCacheSize(cachesize);
+}
+
+// float projection against the double path on a grid over a bbox: max pixel
+// error, tile and nearest pixel disagreements away from boundaries, cost per point
+static void benchProjection(const char *name, bbox_t bbox, uint32_t zoom) {
+    const int grid = 400;
+    const double eps = 0.01;
+    projection_t proj;
+    double maxerr = 0.0;
+    int tile_diff = 0, pixel_diff = 0;
+    volatile double sink = 0.0;
+    int64_t start;
+
+    projection_init(&proj, bbox.ll_lat, bbox.ll_lon, bbox.tr_lat, bbox.tr_lon, zoom, TILESIZE);
+    for (int j = 0; j < grid; j++) {
+        for (int i = 0; i < grid; i++) {
+            double lat = bbox.ll_lat + (bbox.tr_lat - bbox.ll_lat) * (j + 0.5) / grid;
+            double lon = bbox.ll_lon + (bbox.tr_lon - bbox.ll_lon) * (i + 0.5) / grid;
+            int32_t tx, ty, ftx, fty;
+            double ox, oy;
+            float fox, foy;
+            compute_pixel_offset(lat, lon, zoom, TILESIZE, tx, ty, ox, oy);
+            project_lat_lon(&proj, lat, lon, ftx, fty, fox, foy);
+            double ex = fabs(((double)ftx - tx) * TILESIZE + fox - ox);
+            double ey = fabs(((double)fty - ty) * TILESIZE + foy - oy);
+            maxerr = std::max(maxerr, std::max(ex, ey));
+            bool near_edge = (ox < eps) || (ox > TILESIZE - eps) || (oy < eps) || (oy > TILESIZE - eps);
+            if (!near_edge && ((tx != ftx) || (ty != fty)))
+                tile_diff++;
+            bool near_half = (fabs(ox - floor(ox) - 0.5) < eps) || (fabs(oy - floor(oy) - 0.5) < eps);
+            if (!near_edge && !near_half && ((lround(ox) != lround(fox)) || (lround(oy) != lround(foy))))
+                pixel_diff++;
+        }
+    }
+
+    int n = grid * grid;
+    double lat = (bbox.ll_lat + bbox.tr_lat) / 2, lon = (bbox.ll_lon + bbox.tr_lon) / 2;
+    STARTTIME(start);
+    for (int i = 0; i < n; i++) {
+        int32_t tx, ty;
+        double ox, oy;
+        compute_pixel_offset(lat + i * 1e-7, lon, zoom, TILESIZE, tx, ty, ox, oy);
+        sink += ox;
+    }
+    double t_double = LAPTIME(start) * 1000.0 / n;
+    STARTTIME(start);
+    for (int i = 0; i < n; i++) {
+        int32_t tx, ty;
+        float ox, oy;
+        project_lat_lon(&proj, lat + i * 1e-7, lon, tx, ty, ox, oy);
+        sink += ox;
+    }
+    double t_float = LAPTIME(start) * 1000.0 / n;
+    printf("proj  %-9s z%u %d points: max error %.4f px, %d tile and %d pixel disagreements,"
+           " double %.1f ns %s %.1f ns\n", name, zoom, n, maxerr, tile_diff, pixel_diff,
+           t_double, proj.use_double ? "double (too large for float)" : "float", t_float);
+}
+
+// DEM selection: points between the two fine archives come from the coarse
+// DEM, points under the NODATA overlay fall through to the png archive
+static void benchSelect(archive_t *png, archive_t *coarse) {
+    int n = nrandom;
+    int bad = 0;
+    int64_t start;
+
+    for (int i = 0; i < n; i++) {
+        locInfo_t li = {};
+        double lat, lon;
+        // a coarse pixel inside the tile column between png and webp
+        int shift = BENCH_ZOOM - coarse->zoom;
+        int64_t cx = ((((int64_t)png->x0 + ntiles) * TILESIZE) >> shift) + xorshift() % (TILESIZE >> shift);
+        int64_t cy = (((int64_t)png->y0 * TILESIZE) >> shift) + xorshift() % ((ntiles * TILESIZE) >> shift);
+        pixelToLatLon(cx + 0.0625, cy + 0.0625, lat, lon, coarse->zoom);
+        getLocInfo(lat, lon, &li);
+        if ((li.status != LS_VALID) || (fabs(li.elevation - synthElevation(cx, cy) / 10.0) > 0.05))
+            bad++;
+    }
+    locInfo_t li = {};
+    double lat, lon;
+    archivePoint(png, 0, 0, 10, 10, lat, lon);
+    getLocInfo(lat, lon, &li);
+    if (!checkElevation(png, 0, 0, 10, 10, &li))
+        bad++;
+    STARTTIME(start);
+    for (int i = 0; i < nlookups; i++)
+        getLocInfo(lat, lon, &li);
+    printf("select %d DEMs: %d wrong selections, %.1f ns/lookup under a NODATA overlay\n",
+           7 + nextra, bad, LAPTIME(start) * 1000.0 / nlookups);
+}
+
+// a lake of uniform tiles: the first decoded, its copies recognized by their
+// blob; then cycling png tiles filling the cache and the lake tiles, which
+// take no slab and stay cached beside them
+static void benchUniform(archive_t *png, archive_t *lake, size_t cachesize) {
+    std::vector<double> first, known;
+    cacheStats_t before, after;
+    locInfo_t li;
+    int64_t start;
+    int bad = 0;
+
+    flushCache();
+    getCacheStats(&before);
+    uint32_t uniform = lake->di->uniform_tiles;
+    for (int ty = 0; ty < lake->ntiles; ty++) {
+        for (int tx = 0; tx < lake->ntiles; tx++) {
+            double lat, lon;
+            pixelToLatLon((double)(lake->x0 + tx) * TILESIZE + 100.25,
+                          (double)(lake->y0 + ty) * TILESIZE + 100.25, lat, lon, lake->zoom);
+            li = {};
+            STARTTIME(start);
+            getLocInfo(lat, lon, &li);
+            (first.empty() ? first : known).push_back(LAPTIME(start) / 1000.0);
+            if ((li.status != LS_VALID) || (fabs(li.elevation - lake->flat / 10.0) > 0.05))
+                bad++;
+        }
+    }
+    getCacheStats(&after);
+    printf("%-5s uniform first %.3f ms, copies mean %.3f ms: %u uniform tiles, %u recognized by blob,"
+           " %d wrong elevations\n", lake->name.c_str(), mean(first), mean(known),
+           (uint32_t)lake->di->uniform_tiles - uniform, after.uniform_known - before.uniform_known, bad);
+
+    int n = nrandom;
+    int ntile = std::min((int)cachesize, ntiles * ntiles);
+    int cycle = ntile + lake->ntiles * lake->ntiles;
+    uint32_t hits = png->di->cache_hits + lake->di->cache_hits;
+    uint32_t misses = png->di->cache_misses + lake->di->cache_misses;
+    bad = 0;
+    flushCache();
+    hostHeapResetPeak();
+    for (int i = 0; i < n; i++) {
+        int t = i % cycle;
+        double lat, lon;
+        li = {};
+        if (t < ntile) {
+            archivePoint(png, t % ntiles, t / ntiles, 50, 50, lat, lon);
+            getLocInfo(lat, lon, &li);
+            bad += !checkElevation(png, t % ntiles, t / ntiles, 50, 50, &li);
+        } else {
+            t -= ntile;
+            pixelToLatLon((double)(lake->x0 + t % lake->ntiles) * TILESIZE + 50.25,
+                          (double)(lake->y0 + t / lake->ntiles) * TILESIZE + 50.25, lat, lon, lake->zoom);
+            getLocInfo(lat, lon, &li);
+            bad += (li.status != LS_VALID) || (fabs(li.elevation - lake->flat / 10.0) > 0.05);
+        }
+    }
+    hits = png->di->cache_hits + lake->di->cache_hits - hits;
+    misses = png->di->cache_misses + lake->di->cache_misses - misses;
+    getCacheStats(&after);
+    printf("%-5s uniform cycling %d png and %d lake tiles, cache %zu: hit ratio %.3f, %zu entries %zu uniform,"
+           " peak %zu bytes, %d wrong elevations\n", lake->name.c_str(), ntile, cycle - ntile, cachesize,
+           (double)hits / (hits + misses), after.tile_entries, after.uniform_entries, hostHeapPeak(), bad);
+}
+
+// 10 Hz GPS fixes at 52 m/s with a few metres of noise, diagonally across
+// the archive and back, the tiles cached: getLocInfo() per fix against a
+// lookup session, which must agree with it
+static void benchSession(archive_t *a, size_t cachesize, interp_t interp, const char *name) {
+    int span = ntiles * TILESIZE;
+    int64_t ax = (int64_t)a->x0 * TILESIZE, ay = (int64_t)a->y0 * TILESIZE;
+    double lat0, lon0, lat1, lon1;
+    std::vector<double> lat, lon;
+    std::vector<locInfo_t> plain;
+    int64_t start;
+
+    pixelToLatLon(ax + 2.0, ay + 2.0, lat0, lon0);
+    pixelToLatLon(ax + span - 3.0, ay + span - 3.0, lat1, lon1);
+    double length = hypot((lat1 - lat0) * 111320.0, (lon1 - lon0) * 111320.0 * cos(to_radians(lat0)));
+    int nfix = length / 5.2;
+    double noise = 3.0 / 111320.0;
+    for (int pass = 0; pass < 10; pass++) {
+        for (int i = 0; i <= nfix; i++) {
+            double t = (pass & 1) ? 1.0 - (double)i / nfix : (double)i / nfix;
+            double jlat = ((xorshift() % 2001) / 1000.0 - 1.0) * noise;
+            double jlon = ((xorshift() % 2001) / 1000.0 - 1.0) * noise;
+            lat.push_back(std::min(std::max(lat0 + t * (lat1 - lat0) + jlat, lat1), lat0));
+            lon.push_back(std::max(std::min(lon0 + t * (lon1 - lon0) + jlon, lon1), lon0));
+        }
+    }
+    size_t n = lat.size();
+    plain.resize(n);
+
+    setCacheSize(2 * ntiles * ntiles + 4);
+    for (size_t i = 0; i < n; i++) {
+        getLocInfo(lat[i], lon[i], &plain[i], interp);
+    }
+    STARTTIME(start);
+    for (size_t i = 0; i < n; i++) {
+        getLocInfo(lat[i], lon[i], &plain[i], interp);
+    }
+    double plain_ns = LAPTIME(start) * 1000.0 / n;
+
+    lookupSession_t session = {};
+    locInfo_t li = {};
+    int differ = 0, boundary = 0;
+    for (size_t i = 0; i < n; i++) {
+        getLocInfo(&session, lat[i], lon[i], &li, interp);
+        if ((li.status == plain[i].status) && (fabs(li.elevation - plain[i].elevation) < 0.001))
+            continue;
+        // getLocInfo() projects in float: within its error of a pixel's edge
+        // the nearest pixel may be the next one
+        double x, y;
+        lat_lon_to_pixel(lat[i], lon[i], BENCH_ZOOM, TILESIZE, x, y);
+        bool edge = (fabs(x - floor(x) - 0.5) < 0.001) || (fabs(y - floor(y) - 0.5) < 0.001);
+        boundary += edge && (interp == INTERP_NEAREST);
+        differ += !(edge && (interp == INTERP_NEAREST));
+    }
+    uint32_t fast = session.fast, slow = session.slow;
+    closeSession(&session);
+    STARTTIME(start);
+    for (size_t i = 0; i < n; i++) {
+        getLocInfo(&session, lat[i], lon[i], &li, interp);
+    }
+    double session_ns = LAPTIME(start) * 1000.0 / n;
+    closeSession(&session);
+    printf("%-5s session %-8s %zu fixes: getLocInfo %.1f ns/fix, session %.1f ns/fix (%.1fx), %u from the pinned"
+           " tile %u full lookups, %d differ, %d on a pixel edge\n", a->name.c_str(), name, n, plain_ns,
+           session_ns, plain_ns / session_ns, fast, slow, differ, boundary);
+    setCacheSize(cachesize);
+}
+
+// fly east across the archive at one fix per tick, 64 ticks per tile,
+// ticks BENCH_TICK_US apart in real time, with or without the prefetcher
+#define BENCH_TICK_US   250
+#define BENCH_TICK_S    1.0
+
+static void benchFlight(archive_t *a, bool prefetch) {
+    std::vector<double> latency;
+    demInfo_t *di = a->di;
+    uint32_t loads = di->prefetch_loads, hits = di->prefetch_hits, wasted = di->prefetch_wasted;
+    uint32_t misses = di->cache_misses;
+    int64_t gy = ((int64_t)a->y0 + ntiles / 2) * TILESIZE + 100;
+    int64_t gx0 = (int64_t)a->x0 * TILESIZE + 10, gx1 = ((int64_t)a->x0 + ntiles) * TILESIZE - 10;
+    int step = TILESIZE / 64;
+    double lat, lon;
+    int64_t start;
+    int bad = 0, stalls = 0;
+
+    pixelToLatLon(gx0, gy, lat, lon);
+    float speed = step * resolution(lat, BENCH_ZOOM) / BENCH_TICK_S;
+    flushCache();
+    if (prefetch)
+        prefetchStart(120.0f);
+    for (int64_t gx = gx0; gx < gx1; gx += step) {
+        locInfo_t li = {};
+        pixelToLatLon(gx + 0.25, gy + 0.25, lat, lon);
+        STARTTIME(start);
+        if (prefetch)
+            prefetchUpdate(lat, lon, 90.0f, speed);
+        getLocInfo(lat, lon, &li);
+        double ms = LAPTIME(start) / 1000.0;
+        latency.push_back(ms);
+        stalls += (ms > 0.5);
+        if ((li.status != LS_VALID) || (fabs(li.elevation - synthElevation(gx, gy) / 10.0) > 0.05))
+            bad++;
+        usleep(BENCH_TICK_US);
+    }
+    if (prefetch)
+        prefetchStop();
+    printf("%-5s flight %s %zu fixes at %.0f m/s: max %.3f ms p99 %.3f ms, %d stalls > 0.5 ms,"
+           " %d lookup misses, prefetched %d used %d wasted %d, %d wrong elevations\n",
+           a->name.c_str(), prefetch ? "prefetch   " : "no prefetch", latency.size(), speed,
+           *std::max_element(latency.begin(), latency.end()), percentile(latency, 0.99), stalls,
+           di->cache_misses - misses, di->prefetch_loads - loads, di->prefetch_hits - hits,
+           di->prefetch_wasted - wasted, bad);
+}
+
+// cold misses reading the blob through sqlite3_column_blob() and streaming
+// it with sqlite3_blob_open(): latency and SQLite's peak memory, with the
+// blob cache on, which keeps copies of the chunks streamed
+static void benchStream(archive_t *a) {
+    bool stream = a->di->tile_blobs;
+    cacheStats_t stats;
+
+    getCacheStats(&stats);
+    setCacheBytes(stats.tile_bytes, TIERS_BLOB_BYTES);
+
+    for (int pass = 0; pass < 2; pass++) {
+        std::vector<double> total;
+        int64_t start;
+        int bad = 0;
+
+        a->di->tile_blobs = (pass == 1);
+        flushCache();
+        sqlite3_memory_highwater(1);
+        size_t base = sqlite3_memory_used();
+        for (int ty = 0; ty < ntiles; ty++) {
+            for (int tx = 0; tx < ntiles; tx++) {
+                double lat, lon;
+                locInfo_t li = {};
+                int px = xorshift() % TILESIZE, py = xorshift() % TILESIZE;
+                archivePoint(a, tx, ty, px, py, lat, lon);
+                STARTTIME(start);
+                getLocInfo(lat, lon, &li);
+                total.push_back(LAPTIME(start) / 1000.0);
+                bad += !checkElevation(a, tx, ty, px, py, &li);
+            }
+        }
+        printf("%-5s %-6s %4zu misses  mean %7.3f ms  sqlite peak +%lld bytes, %d wrong elevations\n",
+               a->name.c_str(), pass ? "stream" : "column", total.size(), mean(total),
+               (long long)(sqlite3_memory_highwater(0) - base), bad);
+    }
+    a->di->tile_blobs = stream;
+    setCacheBytes(stats.tile_bytes, stats.blob_bytes);
+}
+
+// cold lookups decoding only around the pixel needed, then a lookup
+// nearby which should hit and one across the tile which needs all of it
+static void benchPartial(archive_t *a) {
+    std::vector<double> cold, near, far;
+    uint32_t partials = a->di->partial_decodes, upgrades = a->di->partial_upgrades;
+    int64_t start;
+    int bad = 0;
+
+    flushCache();
+    a->di->partial_decode = true;
+    for (int ty = 0; ty < ntiles; ty++) {
+        for (int tx = 0; tx < ntiles; tx++) {
+            double lat, lon;
+            locInfo_t li = {};
+            int px = 8 + xorshift() % (TILESIZE - 16), py = 8 + xorshift() % (TILESIZE / 2);
+
+            archivePoint(a, tx, ty, px, py, lat, lon);
+            STARTTIME(start);
+            getLocInfo(lat, lon, &li);
+            cold.push_back(LAPTIME(start) / 1000.0);
+            bad += !checkElevation(a, tx, ty, px, py, &li);
+
+            archivePoint(a, tx, ty, px + 3, py - 3, lat, lon);
+            STARTTIME(start);
+            getLocInfo(lat, lon, &li);
+            near.push_back(LAPTIME(start) / 1000.0);
+            bad += !checkElevation(a, tx, ty, px + 3, py - 3, &li);
+
+            archivePoint(a, tx, ty, TILESIZE - 1 - px, TILESIZE - 1 - py, lat, lon);
+            STARTTIME(start);
+            getLocInfo(lat, lon, &li);
+            far.push_back(LAPTIME(start) / 1000.0);
+            bad += !checkElevation(a, tx, ty, TILESIZE - 1 - px, TILESIZE - 1 - py, &li);
+        }
+    }
+    a->di->partial_decode = false;
+    printf("%-5s partial cold mean %7.3f p50 %7.3f ms, nearby mean %6.3f ms, across tile mean %7.3f ms,"
+           " %u partial decodes %u upgrades, %d wrong elevations\n",
+           a->name.c_str(), mean(cold), percentile(cold, 0.5), mean(near), mean(far),
+           a->di->partial_decodes - partials, a->di->partial_upgrades - upgrades, bad);
+}
+
+typedef struct {
+    int tx, ty, px, py;
+    bool done;
+    locInfo_t li;
+} asyncPoint_t;
+
+static void asyncDone(double, double, const locInfo_t *li, void *arg) {
+    asyncPoint_t *ap = (asyncPoint_t *)arg;
+    ap->li = *li;
+    ap->done = true;
+}
+
+// random lookups through getLocInfoAsync() on a cold cache: no call may
+// block, every tile must be decoded once however many lookups wait for it
+static void benchAsync(archive_t *a) {
+    std::vector<asyncPoint_t> points(nrandom);
+    std::vector<double> latency;
+    uint32_t misses = a->di->cache_misses, coalesced = a->di->coalesced;
+    int64_t start, total;
+    int pending = 0, bad = 0, delivered = 0;
+
+    flushCache();
+    STARTTIME(total);
+    for (auto &ap: points) {
+        double lat, lon;
+        ap.tx = xorshift() % ntiles;
+        ap.ty = xorshift() % ntiles;
+        ap.px = xorshift() % TILESIZE;
+        ap.py = xorshift() % TILESIZE;
+        ap.done = false;
+        archivePoint(a, ap.tx, ap.ty, ap.px, ap.py, lat, lon);
+        STARTTIME(start);
+        getLocInfoAsync(lat, lon, &ap.li, asyncDone, &ap);
+        latency.push_back(LAPTIME(start) / 1000.0);
+        if (ap.li.status == LS_PENDING)
+            pending++;
+        else
+            ap.done = true;
+    }
+    while (delivered < pending) {
+        delivered += pollLocInfo();
+        usleep(100);
+    }
+    double secs = LAPTIME(total) / 1e6;
+    for (auto &ap: points) {
+        if (!ap.done || !checkElevation(a, ap.tx, ap.ty, ap.px, ap.py, &ap.li))
+            bad++;
+    }
+    printf("%-5s async  %d lookups over %d tiles: call max %.3f ms p99 %.3f ms, %d pending,"
+           " %u tile decodes, %u coalesced, all done in %.1f ms, %d wrong elevations\n",
+           a->name.c_str(), nrandom, ntiles * ntiles,
+           *std::max_element(latency.begin(), latency.end()), percentile(latency, 0.99), pending,
+           a->di->cache_misses - misses, a->di->coalesced - coalesced, secs * 1000.0, bad);
+}
+
+// the zoom a lookup at global pixel gx/gy of the archive's zoom reads: the
+// finest which has its tile
+static int zoomRead(const archive_t *a, double gx, double gy) {
+    int z = a->zoom;
+    while ((z > (int)a->zoom - a->levels) &&
+            zoomHole(a, z, (int64_t)floor(gx / TILESIZE) >> (a->zoom - z), (int64_t)floor(gy / TILESIZE) >> (a->zoom - z)))
+        z--;
+    return z;
+}
+
+// the elevation a nearest lookup at global pixel gx/gy of the archive's zoom
+// reads from zoom z, within the tile of zoom z holding the point
+static double zoomNearest(const archive_t *a, int z, double gx, double gy) {
+    double s = 1 << (a->zoom - z);
+    double x = gx / s, y = gy / s;
+    int64_t tx = floor(x / TILESIZE), ty = floor(y / TILESIZE);
+    int64_t px = std::min<int64_t>(lround(x - tx * TILESIZE), TILESIZE - 1);
+    int64_t py = std::min<int64_t>(lround(y - ty * TILESIZE), TILESIZE - 1);
+    return zoomElevation(a, z, tx * TILESIZE + px, ty * TILESIZE + py) / 10.0;
+}
+
+// lookups in the archive's two missing tiles: getLocInfo() and
+// getLocInfoBatch() must read the finest lower zoom which has the point
+static void benchFallback(archive_t *a) {
+    int64_t row = (int64_t)a->y0 + ntiles / 2;
+    int64_t holes[] = { a->x0 + 1, a->x0 + ntiles - 2 };
+    std::vector<double> lat, lon, gx, gy;
+    double bilinear_error = 0.0;
+    int bad = 0;
+
+    flushCache();
+    for (int i = 0; i < nrandom / 10; i++) {
+        double x = (double)holes[i % 2] * TILESIZE + xorshift() % TILESIZE + 0.25;
+        double y = (double)row * TILESIZE + xorshift() % TILESIZE + 0.25;
+        double plat, plon;
+        pixelToLatLon(x, y, plat, plon);
+        gx.push_back(x);
+        gy.push_back(y);
+        lat.push_back(plat);
+        lon.push_back(plon);
+    }
+    std::vector<locInfo_t> batch(lat.size());
+    getLocInfoBatch(lat.data(), lon.data(), lat.size(), batch.data());
+    for (size_t i = 0; i < lat.size(); i++) {
+        locInfo_t li = {}, bl = {};
+        int z = zoomRead(a, gx[i], gy[i]);
+        double want = zoomNearest(a, z, gx[i], gy[i]);
+        getLocInfo(lat[i], lon[i], &li);
+        getLocInfo(lat[i], lon[i], &bl, INTERP_BILINEAR);
+        if ((li.status != LS_VALID) || (li.zoom != z) || (fabs(li.elevation - want) > 0.05))
+            bad++;
+        if ((batch[i].status != LS_VALID) || (batch[i].zoom != z) || (fabs(batch[i].elevation - want) > 0.05))
+            bad++;
+        if ((bl.status != LS_VALID) || (bl.zoom != z))
+            bad++;
+        else
+            bilinear_error = std::max(bilinear_error, fabs(bl.elevation - synthMetres((int64_t)gx[i], (int64_t)gy[i])));
+    }
+    printf("%-5s fallback %zu lookups in tiles missing at z%u: from z%d and z%d, bilinear max error %.1f m"
+           " against the terrain, %d wrong elevations\n", a->name.c_str(), lat.size(), a->zoom,
+           zoomRead(a, holes[0] * TILESIZE, row * TILESIZE), zoomRead(a, holes[1] * TILESIZE, row * TILESIZE),
+           bilinear_error, bad);
+}
+
+// getAreaMaxElevation() over the missing tiles, inside each and across it and
+// half its western neighbour: at least every lookup in the box, cold and warm
+static void benchZoomArea(archive_t *a) {
+    int64_t row = (int64_t)a->y0 + ntiles / 2;
+    int64_t holes[] = { a->x0 + 1, a->x0 + ntiles - 2 };
+    const int grid = 40;
+    double over = 0.0;
+    int bad = 0, boxes = 0;
+
+    for (int64_t hole: holes) {
+        double y0 = row * TILESIZE + 20.0, y1 = (row + 1) * TILESIZE - 20.0;
+        for (double x0: { hole * TILESIZE + 20.0, (hole - 0.5) * TILESIZE }) {
+            double x1 = (hole + 1) * TILESIZE - 20.0;
+            bbox_t box;
+            pixelToLatLon(x0, y1, box.ll_lat, box.ll_lon);
+            pixelToLatLon(x1, y0, box.tr_lat, box.tr_lon);
+            double top = -INFINITY;
+            for (int i = 0; i < grid * grid; i++) {
+                double lat, lon;
+                locInfo_t li = {};
+                pixelToLatLon(x0 + (i % grid + 0.5) * (x1 - x0) / grid,
+                              y0 + (i / grid + 0.5) * (y1 - y0) / grid, lat, lon);
+                getLocInfo(lat, lon, &li);
+                if (li.status == LS_VALID)
+                    top = std::max(top, li.elevation);
+                else
+                    bad++;
+            }
+            for (int pass = 0; pass < 2; pass++) {
+                locInfo_t li = {};
+                if (pass == 0)
+                    flushCache();
+                getAreaMaxElevation(&box, &li);
+                if ((li.status != LS_VALID) || (li.elevation < top - 0.05))
+                    bad++;
+                else
+                    over = std::max(over, li.elevation - top);
+            }
+            boxes++;
+        }
+    }
+    printf("%-5s area over missing tiles: %d boxes cold and warm, max at least every one of %d lookups in each"
+           " and at most %.1f m above, %d wrong\n", a->name.c_str(), boxes, grid * grid, over, bad);
+}
+
+typedef struct {
+    double gx, gy;
+    int64_t start;
+    double wait_ms;     // until the first answer
+    bool done;
+    locInfo_t li;
+} fixWait_t;
+
+static void fixDone(double, double, const locInfo_t *li, void *arg) {
+    fixWait_t *f = (fixWait_t *)arg;
+    if (f->li.status == LS_PENDING)
+        f->wait_ms = LAPTIME(f->start) / 1000.0;
+    f->li = *li;
+    f->done = true;
+}
+
+// fly east along the middle row, across both missing tiles, on a cold
+// cache with getLocInfoAsync() or getLocInfoProgressive(): how long fixes
+// wait for a first answer, estimates against the zoom they are from
+static void benchProgressive(archive_t *a, bool progressive) {
+    int64_t gy = ((int64_t)a->y0 + ntiles / 2) * TILESIZE + 100;
+    int64_t gx0 = (int64_t)a->x0 * TILESIZE + 10, gx1 = ((int64_t)a->x0 + ntiles) * TILESIZE - 10;
+    std::vector<fixWait_t> fixes;
+    std::vector<double> wait;
+    int full = 0, estimates = 0, pending = 0, bad = 0;
+    double estimate_error = 0.0;
+
+    for (int64_t gx = gx0; gx < gx1; gx += TILESIZE / 64) {
+        fixes.push_back({ gx + 0.25, gy + 0.25, 0, 0.0, false, {} });
+    }
+    flushCache();
+    for (auto &f: fixes) {
+        double lat, lon;
+        pollLocInfo();
+        pixelToLatLon(f.gx, f.gy, lat, lon);
+        STARTTIME(f.start);
+        if (progressive)
+            getLocInfoProgressive(lat, lon, &f.li, fixDone, &f);
+        else
+            getLocInfoAsync(lat, lon, &f.li, fixDone, &f);
+        if (f.li.status == LS_PENDING) {
+            pending++;
+        } else if (f.li.status == LS_ESTIMATE) {
+            f.wait_ms = LAPTIME(f.start) / 1000.0;
+            estimates++;
+            if ((f.li.zoom >= a->zoom) || (fabs(f.li.elevation - zoomNearest(a, f.li.zoom, f.gx, f.gy)) > 0.05))
+                bad++;
+            estimate_error = std::max(estimate_error, fabs(f.li.elevation - synthMetres((int64_t)f.gx, (int64_t)f.gy)));
+        } else {
+            f.wait_ms = LAPTIME(f.start) / 1000.0;
+            full++;
+            f.done = true;
+        }
+        usleep(BENCH_TICK_US);
+    }
+    auto answered = [&fixes]() {
+        return std::all_of(fixes.begin(), fixes.end(), [](const fixWait_t &f) {
+            return f.done;
+        });
+    };
+    for (int i = 0; (i < 10000) && !answered(); i++) {
+        pollLocInfo();
+        usleep(100);
+    }
+    asyncStop();
+    for (auto &f: fixes) {
+        int z = zoomRead(a, f.gx, f.gy);
+        if (!f.done || (f.li.status != LS_VALID) || (f.li.zoom != z) ||
+                (fabs(f.li.elevation - zoomNearest(a, z, f.gx, f.gy)) > 0.05))
+            bad++;
+        wait.push_back(f.wait_ms);
+    }
+    printf("%-5s %-11s %zu fixes across z%u tiles: %d at once, %d estimates (max %.1f m off the terrain),"
+           " %d pending; first answer mean %.3f ms max %.3f ms, %d wrong elevations\n",
+           a->name.c_str(), progressive ? "progressive" : "async", fixes.size(), a->zoom, full, estimates,
+           estimate_error, pending, mean(wait), *std::max_element(wait.begin(), wait.end()), bad);
+}
+
+// eviction policies replayed on tile-key traces of tracks: a race circuit
+// flown in laps, a field worked in rows, a drifting thermal and any tracks
+// given with -T. Each fix is looked up, consecutive fixes on the same tile
+// count once. opt is Belady's optimum, the bound for any policy.
+#define TRACE_METRES_PER_DEGREE 111320.0
+
+typedef struct {
+    double lat;
+    double lon;
+    float track;
+    float speed;
+} fix_t;
+
+typedef struct {
+    std::string name;
+    uint32_t zoom;
+    std::vector<fix_t> fixes;
+} trace_t;
+
+typedef struct {
+    uint64_t key;
+    size_t fix;
+} access_t;
+
+static fix_t trace_here;
+
+// as the library's spatial_policy cost: tile distance from the fix, from
+// where the track leads in SPATIAL_HORIZON seconds and behind the fix
+static float traceCost(const uint64_t &key, void *ctx) {
+    const fix_t *f = (const fix_t *)ctx;
+    xyz_t k;
+    double x, y, ax, ay;
+    k.key = key;
+    double distance = f->speed * SPATIAL_HORIZON;
+    double ahead_lat = f->lat + distance * cos(f->track * (M_PI / 180.0)) / TRACE_METRES_PER_DEGREE;
+    double ahead_lon = f->lon + distance * sin(f->track * (M_PI / 180.0)) /
+                       (TRACE_METRES_PER_DEGREE * cos(f->lat * (M_PI / 180.0)));
+    lat_lon_to_pixel(f->lat, f->lon, k.entry.z, 1, x, y);
+    lat_lon_to_pixel(ahead_lat, ahead_lon, k.entry.z, 1, ax, ay);
+    double cx = k.entry.x + 0.5, cy = k.entry.y + 0.5;
+    double behind = -((cx - x) * (ax - x) + (cy - y) * (ay - y)) / (hypot(ax - x, ay - y) + 1e-9);
+    return hypot(cx - x, cy - y) + hypot(cx - ax, cy - ay) + SPATIAL_BEHIND * (behind > 0 ? behind : 0);
+}
+
+template<typename P>
+inline void tracePolicy(P &) {
+}
+
+template<>
+inline void tracePolicy(cache::spatial_policy<uint64_t> &policy) {
+    policy.cost(traceCost, &trace_here);
+}
+
+// fixes in metres east and north of an origin, track and speed from the motion
+static void traceFix(trace_t &t, double lat0, double lon0, double east, double north,
+                     double ve, double vn) {
+    fix_t f;
+    f.lat = lat0 + north / TRACE_METRES_PER_DEGREE;
+    f.lon = lon0 + east / (TRACE_METRES_PER_DEGREE * cos(lat0 * (M_PI / 180.0)));
+    f.track = fmod(to_degrees(atan2(ve, vn)) + 360.0, 360.0);
+    f.speed = hypot(ve, vn);
+    t.fixes.push_back(f);
+}
+
+// 10 laps of a 12 x 6 km rectangle at 40 m/s
+static trace_t traceCircuit(void) {
+    trace_t t = { "circuit", 13, {} };
+    double w = 12000.0, h = 6000.0, v = 40.0, lap = 2 * (w + h);
+    for (int s = 0; s < 10 * lap / v; s++) {
+        double d = fmod(s * v, lap);
+        if (d < w)
+            traceFix(t, 47.21, 11.18, d, 0, v, 0);
+        else if (d < w + h)
+            traceFix(t, 47.21, 11.18, w, d - w, 0, v);
+        else if (d < 2 * w + h)
+            traceFix(t, 47.21, 11.18, 2 * w + h - d, h, -v, 0);
+        else
+            traceFix(t, 47.21, 11.18, 0, lap - d, 0, -v);
+    }
+    return t;
+}
+
+// a 5 x 5 km field in 300 m rows at 25 m/s
+static trace_t traceField(void) {
+    trace_t t = { "field", 15, {} };
+    double v = 25.0;
+    for (int row = 0; row * 300.0 <= 5000.0; row++) {
+        double dir = (row & 1) ? -1.0 : 1.0;
+        for (double d = 0; d < 5000.0; d += v)
+            traceFix(t, 47.07, 15.42, (row & 1) ? 5000.0 - d : d, row * 300.0, dir * v, 0);
+        for (double d = 0; d < 300.0; d += v)
+            traceFix(t, 47.07, 15.42, (row & 1) ? 0 : 5000.0, row * 300.0 + d, 0, v);
+    }
+    return t;
+}
+
+// 40 minutes circling at 14 m/s on a 120 m radius, drifting 4 m/s east-northeast
+static trace_t traceThermal(void) {
+    trace_t t = { "thermal", 15, {} };
+    double r = 120.0, w = 14.0 / r;
+    double de = 4.0 * sin(70.0 * (M_PI / 180.0)), dn = 4.0 * cos(70.0 * (M_PI / 180.0));
+    for (int s = 0; s < 2400; s++)
+        traceFix(t, 47.31, 12.79, de * s + r * sin(w * s), dn * s + r * cos(w * s),
+                 de + r * w * cos(w * s), dn - r * w * sin(w * s));
+    return t;
+}
+
+// "lat,lon[,track,speed]" per line, one fix a second; track and speed
+// come from the next fix when missing
+static bool traceRead(const char *path, uint32_t zoom, trace_t &t) {
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    std::vector<bool> derive;
+
+    if (fp == NULL) {
+        perror(path);
+        return false;
+    }
+    t.name = path;
+    t.zoom = zoom;
+    while (fgets(line, sizeof(line), fp)) {
+        fix_t f = {};
+        int n;
+        if (line[0] == '#')
+            continue;
+        n = sscanf(line, "%lf,%lf,%f,%f", &f.lat, &f.lon, &f.track, &f.speed);
+        if (n < 2)
+            continue;
+        t.fixes.push_back(f);
+        derive.push_back(n < 4);
+    }
+    fclose(fp);
+    for (size_t i = 0; i + 1 < t.fixes.size(); i++) {
+        if (!derive[i])
+            continue;
+        fix_t &f = t.fixes[i];
+        double dn = (t.fixes[i + 1].lat - f.lat) * TRACE_METRES_PER_DEGREE;
+        double de = (t.fixes[i + 1].lon - f.lon) * TRACE_METRES_PER_DEGREE * cos(f.lat * (M_PI / 180.0));
+        f.track = fmod(to_degrees(atan2(de, dn)) + 360.0, 360.0);
+        f.speed = hypot(de, dn);
+    }
+    return !t.fixes.empty();
+}
+
+static std::vector<access_t> traceAccesses(const trace_t &t) {
+    std::vector<access_t> accesses;
+    for (size_t i = 0; i < t.fixes.size(); i++) {
+        xyz_t k;
+        double x, y;
+        lat_lon_to_pixel(t.fixes[i].lat, t.fixes[i].lon, t.zoom, 1, x, y);
+        k.key = 0;
+        k.entry.x = (uint16_t)x;
+        k.entry.y = (uint16_t)y;
+        k.entry.z = t.zoom;
+        if (accesses.empty() || (accesses.back().key != k.key))
+            accesses.push_back({ k.key, i });
+    }
+    return accesses;
+}
+
+template<typename P>
+static size_t traceReplay(const trace_t &t, const std::vector<access_t> &accesses, size_t capacity) {
+    cache::fixed_cache<uint64_t, int, P> c(capacity, 0);
+    size_t hits = 0;
+
+    tracePolicy(c.policy());
+    for (auto &a : accesses) {
+        trace_here = t.fixes[a.fix];
+        if (c.get(a.key))
+            hits++;
+        else
+            c.put(a.key, 1);
+    }
+    return hits;
+}
+
+// Belady: evict the tile needed again furthest ahead
+static size_t traceOptimal(const std::vector<access_t> &accesses, size_t capacity) {
+    std::vector<size_t> next(accesses.size());
+    std::unordered_map<uint64_t, size_t> seen;
+    std::unordered_map<uint64_t, size_t> cached;    // key -> next use
+    size_t hits = 0;
+
+    for (size_t i = accesses.size(); i-- > 0;) {
+        auto it = seen.find(accesses[i].key);
+        next[i] = (it == seen.end()) ? SIZE_MAX : it->second;
+        seen[accesses[i].key] = i;
+    }
+    for (size_t i = 0; i < accesses.size(); i++) {
+        auto it = cached.find(accesses[i].key);
+        if (it != cached.end()) {
+            hits++;
+        } else if (cached.size() >= capacity) {
+            auto victim = cached.begin();
+            for (auto c = cached.begin(); c != cached.end(); c++)
+                if (c->second > victim->second)
+                    victim = c;
+            cached.erase(victim);
+        }
+        if (capacity > 0)
+            cached[accesses[i].key] = next[i];
+    }
+    return hits;
+}
+
+static void benchPolicies(const std::vector<trace_t> &traces, size_t capacity) {
+    for (auto &t : traces) {
+        std::vector<access_t> accesses = traceAccesses(t);
+        double n = accesses.empty() ? 1.0 : accesses.size();
+        printf("policy %-7s z%u %zu fixes %zu tile lookups, cache %zu: lru %.1f%% clock %.1f%%"
+               " 2q %.1f%% spatial %.1f%% opt %.1f%% hits\n",
+               t.name.c_str(), t.zoom, t.fixes.size(), accesses.size(), capacity,
+               100.0 * traceReplay<cache::lru_policy<uint64_t>>(t, accesses, capacity) / n,
+               100.0 * traceReplay<cache::clock_policy<uint64_t>>(t, accesses, capacity) / n,
+               100.0 * traceReplay<cache::twoq_policy<uint64_t>>(t, accesses, capacity) / n,
+               100.0 * traceReplay<cache::spatial_policy<uint64_t>>(t, accesses, capacity) / n,
+               100.0 * traceOptimal(accesses, capacity) / n);
+    }
+
+    // a resize keeps the entries in the policy's order: 1 was used last,
+    // so after growing by one and putting two more, 2 is the one evicted
+    cache::fixed_lru_cache<uint64_t, int> c(4, 0);
+    for (uint64_t k = 1; k <= 4; k++) {
+        c.put(k, 1);
+    }
+    c.get(1);
+    c.resize(5);
+    c.put(5, 1);
+    c.put(6, 1);
+    bool order = c.exists(1) && !c.exists(2) && c.exists(3);
+    printf("policy lru resized: order kept %s\n", order ? "ok" : "WRONG");
+}
+
+// what DEM_STATS collected over the whole run, per stage
+static void benchStats(const archive_t *a) {
+    static const char *names[STAGE_COUNT] = { "lookup", "select", "project", "cache", "fetch", "decode" };
+    demStats_t st;
+
+    if (!getDemStats(a->di, &st))
+        return;
+    printf("%-5s stats ", a->name.c_str());
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const stageStats_t &s = st.stage[i];
+        printf(" %s %u p50 %u p99 %u ns", names[i], s.count, stagePercentile(&s, 0.5), stagePercentile(&s, 0.99));
+    }
+    printf("; %llu bytes read %llu decoded, %u tiles cached %u dropped, tile memory %zu peak %zu bytes\n",
+           (unsigned long long)st.bytes_read, (unsigned long long)st.bytes_decoded, st.tiles_cached,
+           st.tiles_dropped, st.tile_bytes, st.tile_bytes_peak);
+}
+
+static bool exists(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+static size_t blobBytes(const std::string &path) {
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    size_t bytes = 0;
+
+    if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK &&
+            sqlite3_prepare_v2(db, "SELECT sum(length(tile_data)) FROM tiles", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            bytes = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return bytes;
+}
+
+int main(int argc, char **argv) {
+    const char *dir = ".";
+    size_t cachesize = TILECACHE_SIZE;
+    bool keep = false;
+    std::vector<trace_t> traces = { traceCircuit(), traceField(), traceThermal() };
+    std::vector<const char *> tracks;
+    uint32_t track_zoom = 15;
+    int opt;
+
+    hostLogLevel(LOG_LEVEL_ERROR);
+    while ((opt = getopt(argc, argv, "d:t:m:n:r:c:s:T:z:kv")) != -1) {
+        switch (opt) {
+            case 'd':
+                dir = optarg;
+                break;
+            case 't':
+                ntiles = atoi(optarg);
+                break;
+            case 'm':
+                nextra = atoi(optarg);
+                break;
+            case 'n':
+                nlookups = atoi(optarg);
+                break;
+            case 'r':
+                nrandom = atoi(optarg);
+                break;
+            case 'c':
+                cachesize = atoi(optarg);
+                break;
+            case 's':
+                rng_state = strtoull(optarg, NULL, 0) | 1;
+                break;
+            case 'T':
+                tracks.push_back(optarg);
+                break;
+            case 'z':
+                track_zoom = atoi(optarg);
+                break;
+            case 'k':
+                keep = true;
+                break;
+            case 'v':
+                hostLogLevel(LOG_LEVEL_VERBOSE);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d dir] [-t tiles] [-m extradems] [-n hits] [-r random]"
+                        " [-c cachesize] [-s seed] [-T track.csv] [-z zoom] [-k] [-v]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // the two fine archives, one tile column apart, a coarse one below both,
+    // a NODATA tile over the first png tile, a raw container east of the
+    // webp one, a DPK archive east of that, one with three lower zooms and
+    // two tiles missing east of that, a flat lake east of all and
+    // optionally more NODATA tiles east of the lake
+    std::vector<archive_t> archives = {
+        { "png",  ENC_PNG,  BENCH_X0, BENCH_Y0, BENCH_ZOOM, ntiles },
+        { "webp", ENC_WEBP, BENCH_X0 + ntiles + 1, BENCH_Y0, BENCH_ZOOM, ntiles },
+        { "coarse", ENC_PNG, BENCH_X0 >> 2, BENCH_Y0 >> 2, BENCH_ZOOM - 2, (2 * ntiles + 1) / 4 + 2, false, true },
+        { "overlay", ENC_PNG, BENCH_X0 << 1, BENCH_Y0 << 1, BENCH_ZOOM + 1, 1, true },
+        { "lake", ENC_WEBP, (BENCH_X0 + 5 * ntiles + 5) << 1, BENCH_Y0 << 1, BENCH_ZOOM + 1, 2, false, false, 4235 },
+        { "raw", ENC_PNG, BENCH_X0 + 2 * ntiles + 2, BENCH_Y0, BENCH_ZOOM, ntiles, false, false, 0, true },
+        { "dpk", ENC_DPK, BENCH_X0 + 3 * ntiles + 3, BENCH_Y0, BENCH_ZOOM, ntiles },
+        { "zooms", ENC_PNG, BENCH_X0 + 4 * ntiles + 4, BENCH_Y0, BENCH_ZOOM, ntiles, false, false, 0, false, "", NULL, 0, 3 },
+    };
+    for (int i = 0; i < nextra; i++) {
+        archive_t a = { "extra" + std::to_string(i), ENC_PNG, ((BENCH_X0 + 5 * ntiles + 7) << 1) + 3 * i,
+                        BENCH_Y0 << 1, BENCH_ZOOM + 1, 1, true
+                      };
+        archives.push_back(a);
+    }
+
+    for (auto path : tracks) {
+        trace_t t;
+        if (!traceRead(path, track_zoom, t))
+            return 1;
+        traces.push_back(t);
+    }
+    benchPolicies(traces, cachesize);
+
+    sqlite3_initialize();
+    setCacheSize(cachesize);
+    for (auto &a : archives) {
+        a.path = std::string(dir) + "/synthetic-" + a.name + (a.raw ? ".dem" : ".mbtiles");
+        if (!keep || !exists(a.path)) {
+            int64_t start;
+            STARTTIME(start);
+            if (a.raw) {
+                // an MBTiles archive first, then the converter
+                archive_t src = a;
+                src.path = std::string(dir) + "/synthetic-" + a.name + ".mbtiles";
+                if ((writeArchive(&src) != SQLITE_OK) || (convertDEM(src.path.c_str(), a.path.c_str()) != SQLITE_OK))
+                    return 1;
+                a.blob_bytes = fileSize(a.path);
+            } else if (a.encoding == ENC_DPK) {
+                // a PNG archive first, then the transcoder
+                archive_t src = a;
+                src.encoding = ENC_PNG;
+                src.path = std::string(dir) + "/synthetic-" + a.name + "-png.mbtiles";
+                if ((writeArchive(&src) != SQLITE_OK) || (transcodeDEM(src.path.c_str(), a.path.c_str()) != SQLITE_OK))
+                    return 1;
+                a.blob_bytes = blobBytes(a.path);
+            } else if (writeArchive(&a) != SQLITE_OK) {
+                return 1;
+            } else if ((&a == &archives[0]) && (summarizeDEM(a.path.c_str()) != SQLITE_OK)) {
+                // png has the summary table, the others are summarized as tiles decode
+                return 1;
+            }
+            printf("%-5s generated %s: %d tiles, %zu blob bytes in %.1f s\n", a.name.c_str(), a.path.c_str(),
+                   a.ntiles * a.ntiles, a.blob_bytes, LAPTIME(start) / 1e6);
+        } else {
+            a.blob_bytes = a.raw ? fileSize(a.path) : blobBytes(a.path);
+        }
+        static const char *sources[] = { "a scan", "metadata", "the sidecar", "the raw header" };
+        int64_t start;
+        STARTTIME(start);
+        if (addDEM(a.path.c_str(), &a.di) != SQLITE_OK) {
+            fprintf(stderr, "addDEM %s failed\n", a.path.c_str());
+            return 1;
+        }
+        printf("%-5s startup addDEM %.3f ms, bbox from %s, database %s, %u tiles from the snapshot\n",
+               a.name.c_str(), LAPTIME(start) / 1000.0, sources[a.di->bbox_source],
+               a.di->opened ? "open" : "not open yet", (uint32_t)a.di->snapshot_tiles);
+    }
+
+    bbox_t austria = { 46.37, 9.53, 49.02, 17.16 };
+    benchProjection("austria", austria, 13);
+    benchProjection("austria", austria, 16);
+    benchProjection("synthetic", archives[0].di->bbox, BENCH_ZOOM);
+
+    benchSelect(&archives[0], &archives[2]);
+    benchUniform(&archives[0], &archives[4], cachesize);
+    for (int i: { 0, 1, 6 }) {
+        archive_t &a = archives[i];
+        benchCold(&a);
+        benchSnapshot(&a, cachesize);
+        benchHit(&a);
+        benchThroughput(&a, cachesize);
+        benchTiers(&a, cachesize);
+        benchBatch(&a);
+        benchThreads(&a, cachesize);
+        benchInterp(&a, INTERP_BILINEAR, "bilinear");
+        benchInterp(&a, INTERP_BICUBIC, "bicubic");
+        benchProfile(&a, cachesize);
+        benchArea(archives, &a, cachesize);
+        benchSession(&a, cachesize, INTERP_NEAREST, "nearest");
+        benchSession(&a, cachesize, INTERP_BILINEAR, "bilinear");
+        benchStream(&a);
+        benchPartial(&a);
+        benchAsync(&a);
+        benchFlight(&a, false);
+        benchFlight(&a, true);
+    }
+
+    // the raw container: no blobs, SQLite or partial decodes to compare
+    archive_t &r = archives[5];
+    benchCold(&r);
+    benchHit(&r);
+    benchThroughput(&r, cachesize);
+    benchBatch(&r);
+    benchThreads(&r, cachesize);
+    benchInterp(&r, INTERP_BILINEAR, "bilinear");
+    benchInterp(&r, INTERP_BICUBIC, "bicubic");
+    benchProfile(&r, cachesize);
+    benchArea(archives, &r, cachesize);
+    benchSession(&r, cachesize, INTERP_NEAREST, "nearest");
+    benchAsync(&r);
+    benchFlight(&r, false);
+    benchFlight(&r, true);
+
+    // lower zooms: missing tiles, estimates while tiles load
+    archive_t &z = archives[7];
+    benchFallback(&z);
+    benchZoomArea(&z);
+    benchProgressive(&z, false);
+    benchProgressive(&z, true);
+
+    for (int i: { 0, 1, 6, 5 }) {
+        benchStats(&archives[i]);
+    }
+
+    asyncStop();
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("peak heap_caps memory %zu bytes, max rss %ld kB\n", hostHeapPeak(), ru.ru_maxrss);
+    return 0;
+}
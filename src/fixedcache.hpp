@@ -0,0 +1,590 @@
+/*
+ * File:   fixedcache.hpp
+ *
+ * fixed-capacity cache for embedded use, a drop-in for lru_cache:
+ *  - entries live in an array sized by the constructor and resize()
+ *  - keys are found by open addressing (linear probing, backward shift
+ *    deletion) in an index table of twice the capacity
+ *  - put(), get(), peek() and remove() never allocate
+ *  - get() and peek() return values, not references into the cache
+ *  - take() removes an entry without the evict callback, evict() evicts
+ *    the policy's victim, for callers keeping a budget of their own
+ *  - the eviction policy is a template parameter: lru_policy, clock_policy,
+ *    twoq_policy or spatial_policy below
+ *
+ * Not thread safe.
+ */
+#ifndef _FIXEDCACHE_HPP_INCLUDED_
+#define	_FIXEDCACHE_HPP_INCLUDED_
+
+#include <stdint.h>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace cache {
+
+// entries are numbered 0..capacity-1
+typedef int32_t slot_t;
+static const slot_t noslot = -1;
+
+// A policy is told about entries entering, being used and leaving the cache,
+// and picks the victim when room is needed:
+//   void resize(size_t capacity)            forget all entries
+//   void inserted(slot_t e, const key_t &k)
+//   void accessed(slot_t e)                 get()
+//   void removed(slot_t e)                  evicted, removed or taken
+//   slot_t victim(F evictable)              among the e evictable(e) accepts; noslot if none
+//   void oldest_first(F f)                  f(e) for every entry, the next victims first
+
+// doubly linked recency lists over entry numbers, for the policies below
+class slot_lists {
+  public:
+    void resize(size_t capacity) {
+        _prev.assign(capacity, noslot);
+        _next.assign(capacity, noslot);
+    }
+
+    void push_front(slot_t &head, slot_t &tail, slot_t e) {
+        _prev[e] = noslot;
+        _next[e] = head;
+        if (head != noslot)
+            _prev[head] = e;
+        head = e;
+        if (tail == noslot)
+            tail = e;
+    }
+
+    void erase(slot_t &head, slot_t &tail, slot_t e) {
+        if (_prev[e] != noslot)
+            _next[_prev[e]] = _next[e];
+        else
+            head = _next[e];
+        if (_next[e] != noslot)
+            _prev[_next[e]] = _prev[e];
+        else
+            tail = _prev[e];
+    }
+
+    // f(e) for every entry of a list, least recent first
+    template<typename F>
+    void each(slot_t tail, F f) const {
+        for (slot_t e = tail; e != noslot; e = _prev[e]) {
+            f(e);
+        }
+    }
+
+    // the least recent evictable entry of a list
+    template<typename F>
+    slot_t oldest(slot_t tail, F evictable) const {
+        for (slot_t e = tail; e != noslot; e = _prev[e]) {
+            if (evictable(e))
+                return e;
+        }
+        return noslot;
+    }
+
+  private:
+    std::vector<slot_t> _prev;
+    std::vector<slot_t> _next;
+};
+
+// evict the least recently used entry
+template<typename key_t>
+class lru_policy {
+  public:
+    void resize(size_t capacity) {
+        _lists.resize(capacity);
+        _head = _tail = noslot;
+    }
+
+    void inserted(slot_t e, const key_t &) {
+        _lists.push_front(_head, _tail, e);
+    }
+
+    void accessed(slot_t e) {
+        if (e == _head)
+            return;
+        _lists.erase(_head, _tail, e);
+        _lists.push_front(_head, _tail, e);
+    }
+
+    void removed(slot_t e) {
+        _lists.erase(_head, _tail, e);
+    }
+
+    template<typename F>
+    slot_t victim(F evictable) {
+        return _lists.oldest(_tail, evictable);
+    }
+
+    template<typename F>
+    void oldest_first(F f) const {
+        _lists.each(_tail, f);
+    }
+
+    slot_t newest(void) const {
+        return _head;
+    }
+
+  private:
+    slot_lists _lists;
+    slot_t _head = noslot;
+    slot_t _tail = noslot;
+};
+
+// second chance: a hand sweeps the entries, sparing those used since it last
+// passed. Hits only set a bit.
+template<typename key_t>
+class clock_policy {
+  public:
+    void resize(size_t capacity) {
+        _referenced.assign(capacity, 0);
+        _used.assign(capacity, 0);
+        _hand = 0;
+    }
+
+    void inserted(slot_t e, const key_t &) {
+        _used[e] = 1;
+        _referenced[e] = 1;
+    }
+
+    void accessed(slot_t e) {
+        _referenced[e] = 1;
+    }
+
+    void removed(slot_t e) {
+        _used[e] = 0;
+    }
+
+    template<typename F>
+    slot_t victim(F evictable) {
+        size_t n = _used.size();
+        if (n == 0)
+            return noslot;
+        // the first sweep may only clear bits, the second finds one clear
+        for (size_t i = 0; i <= 2 * n; i++) {
+            slot_t e = _hand;
+            _hand = (_hand + 1) % n;
+            if (!_used[e] || !evictable(e))
+                continue;
+            if (_referenced[e]) {
+                _referenced[e] = 0;
+                continue;
+            }
+            return e;
+        }
+        return noslot;
+    }
+
+    // from the hand on, those it would spare last
+    template<typename F>
+    void oldest_first(F f) const {
+        size_t n = _used.size();
+        for (int referenced = 0; referenced < 2; referenced++) {
+            for (size_t i = 0; i < n; i++) {
+                slot_t e = (_hand + i) % n;
+                if (_used[e] && (_referenced[e] == referenced))
+                    f(e);
+            }
+        }
+    }
+
+  private:
+    std::vector<uint8_t> _referenced;
+    std::vector<uint8_t> _used;
+    slot_t _hand = 0;
+};
+
+// simplified 2Q (Johnson and Shasha, 1994): new entries go to a FIFO (A1in)
+// of a quarter of the capacity; keys evicted from it are remembered (A1out,
+// half the capacity) and enter the LRU main queue (Am) if they come back.
+// A scan through many entries only ever flushes A1in. A resize remembers
+// the keys in Am, so they go back there when re-inserted.
+template<typename key_t>
+class twoq_policy {
+  public:
+    void resize(size_t capacity) {
+        std::vector<key_t> am;
+        _lists.each(_am_tail, [this, &am](slot_t e) {
+            am.push_back(_keys[e]);
+        });
+        _lists.resize(capacity);
+        _keys.assign(capacity, key_t());
+        _main.assign(capacity, 0);
+        _in_head = _in_tail = _am_head = _am_tail = noslot;
+        _in_size = 0;
+        _in_max = (capacity > 4) ? capacity / 4 : 1;
+        _ghosts.assign((capacity > 2) ? capacity / 2 : 1, key_t());
+        _ghost_valid.assign(_ghosts.size(), 0);
+        _ghost_next = 0;
+        for (auto &key: am) {
+            remember(key);
+        }
+    }
+
+    void inserted(slot_t e, const key_t &key) {
+        _keys[e] = key;
+        _main[e] = forget(key);
+        if (_main[e]) {
+            _lists.push_front(_am_head, _am_tail, e);
+        } else {
+            _lists.push_front(_in_head, _in_tail, e);
+            _in_size++;
+        }
+    }
+
+    void accessed(slot_t e) {
+        // hits in A1in are taken as correlated references: no promotion
+        if (_main[e] && (e != _am_head)) {
+            _lists.erase(_am_head, _am_tail, e);
+            _lists.push_front(_am_head, _am_tail, e);
+        }
+    }
+
+    void removed(slot_t e) {
+        if (_main[e]) {
+            _lists.erase(_am_head, _am_tail, e);
+        } else {
+            _lists.erase(_in_head, _in_tail, e);
+            _in_size--;
+        }
+    }
+
+    template<typename F>
+    slot_t victim(F evictable) {
+        slot_t e = noslot;
+        if (_in_size > _in_max)
+            e = _lists.oldest(_in_tail, evictable);
+        if (e == noslot)
+            e = _lists.oldest(_am_tail, evictable);
+        if (e == noslot)
+            e = _lists.oldest(_in_tail, evictable);
+        if ((e != noslot) && !_main[e])
+            remember(_keys[e]);
+        return e;
+    }
+
+    // A1in before Am, as victim() prefers
+    template<typename F>
+    void oldest_first(F f) const {
+        _lists.each(_in_tail, f);
+        _lists.each(_am_tail, f);
+    }
+
+  private:
+    void remember(const key_t &key) {
+        _ghosts[_ghost_next] = key;
+        _ghost_valid[_ghost_next] = 1;
+        _ghost_next = (_ghost_next + 1) % _ghosts.size();
+    }
+
+    // true if key was remembered
+    bool forget(const key_t &key) {
+        for (size_t i = 0; i < _ghosts.size(); i++) {
+            if (_ghost_valid[i] && (_ghosts[i] == key)) {
+                _ghost_valid[i] = 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    slot_lists _lists;
+    std::vector<key_t> _keys;
+    std::vector<uint8_t> _main;     // in Am, else in A1in
+    slot_t _in_head = noslot;
+    slot_t _in_tail = noslot;
+    slot_t _am_head = noslot;
+    slot_t _am_tail = noslot;
+    size_t _in_size = 0;
+    size_t _in_max = 1;
+    std::vector<key_t> _ghosts;     // A1out, a ring
+    std::vector<uint8_t> _ghost_valid;
+    size_t _ghost_next = 0;
+};
+
+// evict the entry a cost function rates highest, e.g. the tile farthest from
+// the current position and the track ahead. Without a cost function, or
+// among equal costs, the least recently used. The entry used last is spared,
+// it is what a lookup is about to read.
+template<typename key_t>
+class spatial_policy {
+  public:
+    typedef float (*cost_t)(const key_t &key, void *ctx);
+
+    void cost(cost_t fn, void *ctx) {
+        _cost = fn;
+        _ctx = ctx;
+    }
+
+    void resize(size_t capacity) {
+        _lru.resize(capacity);
+        _keys.assign(capacity, key_t());
+        _used.assign(capacity, 0);
+    }
+
+    void inserted(slot_t e, const key_t &key) {
+        _lru.inserted(e, key);
+        _keys[e] = key;
+        _used[e] = 1;
+    }
+
+    void accessed(slot_t e) {
+        _lru.accessed(e);
+    }
+
+    void removed(slot_t e) {
+        _lru.removed(e);
+        _used[e] = 0;
+    }
+
+    template<typename F>
+    slot_t victim(F evictable) {
+        slot_t worst = _lru.victim(evictable);
+        if ((_cost == NULL) || (worst == noslot))
+            return worst;
+        float highest = _cost(_keys[worst], _ctx);
+        for (size_t e = 0; e < _used.size(); e++) {
+            if (!_used[e] || !evictable(e) || ((slot_t)e == _lru.newest()))
+                continue;
+            float c = _cost(_keys[e], _ctx);
+            if (c > highest) {
+                highest = c;
+                worst = e;
+            }
+        }
+        return worst;
+    }
+
+    // by recency: costs change as the position moves
+    template<typename F>
+    void oldest_first(F f) const {
+        _lru.oldest_first(f);
+    }
+
+  private:
+    lru_policy<key_t> _lru;
+    std::vector<key_t> _keys;
+    std::vector<uint8_t> _used;
+    cost_t _cost = NULL;
+    void *_ctx = NULL;
+};
+
+template<typename key_t, typename value_t, typename policy_t = lru_policy<key_t>>
+class fixed_cache {
+
+  public:
+    typedef value_t value_type;
+    typedef void (*evict_cb_t)(key_t, value_t);
+    typedef slot_t handle_t;
+    static const handle_t nohandle = noslot;
+
+    fixed_cache(size_t max_size, value_t sentinel) :
+        _sentinel(sentinel), _evict(NULL) {
+        resize(max_size);
+    }
+
+    fixed_cache(size_t max_size, value_t sentinel, evict_cb_t ev) :
+        _sentinel(sentinel), _evict(ev) {
+        resize(max_size);
+    }
+
+    // false if nothing can be evicted to make room: value is not stored then
+    bool put(const key_t& key, const value_t& value) {
+        remove(key);
+        if ((_size >= _max_size) && !evict())
+            return false;
+        handle_t e = _free;
+        _free = _entries[e].next_free;
+        _entries[e].key = key;
+        _entries[e].value = value;
+        _entries[e].linked = true;
+        _index[probe(key)] = e;
+        _policy.inserted(e, key);
+        _size++;
+        return true;
+    }
+
+    value_t get(const key_t& key) {
+        handle_t e = find(key);
+        if (e == nohandle)
+            return _sentinel;
+        _policy.accessed(e);
+        return _entries[e].value;
+    }
+
+    // like get(), but doesn't count as a use
+    value_t peek(const key_t& key) const {
+        handle_t e = find(key);
+        return (e == nohandle) ? _sentinel : _entries[e].value;
+    }
+
+    void remove(const key_t& key) {
+        size_t slot;
+        handle_t e = find(key, &slot);
+        if (e == nohandle)
+            return;
+        unlink(e, slot);
+        if (_evict != NULL) _evict(_entries[e].key, _entries[e].value);
+        freeEntry(e);
+    }
+
+    // remove key and hand its value to the caller instead of the evict callback
+    bool take(const key_t& key, value_t& value) {
+        size_t slot;
+        handle_t e = find(key, &slot);
+        if (e == nohandle)
+            return false;
+        value = _entries[e].value;
+        unlink(e, slot);
+        freeEntry(e);
+        return true;
+    }
+
+    // evict the policy's victim, false if there is none
+    bool evict(void) {
+        return evict([](const key_t &, const value_t &) {
+            return true;
+        });
+    }
+
+    // the same among the entries pred(key, value) accepts
+    template<typename F>
+    bool evict(F pred) {
+        handle_t e = _policy.victim([this, &pred](slot_t s) {
+            return pred(_entries[s].key, _entries[s].value);
+        });
+        if (e == nohandle)
+            return false;
+        remove(_entries[e].key);
+        return true;
+    }
+
+    void clear(void) {
+        for (size_t e = 0; e < _entries.size(); e++) {
+            if (_entries[e].linked)
+                remove(_entries[e].key);
+        }
+    }
+
+    // the policy picks the entries a shrinking cache drops; those kept are
+    // put back in its order, so they are evicted in the same order as before
+    void resize(size_t max_size) {
+        std::vector<entry_t> kept;
+
+        while ((_size > max_size) && evict())
+            ;
+        _policy.oldest_first([this, &kept](slot_t e) {
+            kept.push_back(_entries[e]);
+        });
+        size_t slots = 2;
+        while (slots < 2 * max_size)
+            slots <<= 1;
+        _max_size = max_size;
+        _entries.assign(max_size, entry_t());
+        _index.assign(slots, (handle_t)nohandle);
+        _mask = slots - 1;
+        _size = 0;
+        _free = nohandle;
+        for (size_t i = max_size; i-- > 0;) {
+            _entries[i].next_free = _free;
+            _free = i;
+        }
+        _policy.resize(max_size);
+        for (auto &en: kept) {
+            put(en.key, en.value);
+        }
+    }
+
+    bool exists(const key_t& key) const {
+        return find(key) != nohandle;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    policy_t &policy(void) {
+        return _policy;
+    }
+
+    // f(key, value) for every entry
+    template<typename F>
+    void for_each(F f) const {
+        for (auto &en: _entries) {
+            if (en.linked)
+                f(en.key, en.value);
+        }
+    }
+
+  private:
+    typedef struct {
+        key_t key;
+        value_t value;
+        handle_t next_free;
+        bool linked;        // in the index and known to the policy
+    } entry_t;
+
+    // Fibonacci hashing: std::hash of an integer is the integer itself
+    size_t home(const key_t& key) const {
+        return (size_t)(((uint64_t)std::hash<key_t>()(key) * 0x9E3779B97F4A7C15ull) >> 32) & _mask;
+    }
+
+    // the slot holding key, or the empty slot ending its probe sequence
+    size_t probe(const key_t& key) const {
+        size_t slot = home(key);
+        while ((_index[slot] != nohandle) && !(_entries[_index[slot]].key == key))
+            slot = (slot + 1) & _mask;
+        return slot;
+    }
+
+    handle_t find(const key_t& key, size_t *slot = NULL) const {
+        size_t s = probe(key);
+        if (slot != NULL)
+            *slot = s;
+        return _index[s];
+    }
+
+    // drop entry e in index slot from the index and the policy; it
+    // still counts towards the size until freeEntry()
+    void unlink(handle_t e, size_t slot) {
+        _policy.removed(e);
+        _entries[e].linked = false;
+        // backward shift: move later members of the probe sequence up
+        size_t hole = slot;
+        for (size_t s = (slot + 1) & _mask; _index[s] != nohandle; s = (s + 1) & _mask) {
+            size_t h = home(_entries[_index[s]].key);
+            // s may move to hole unless its home lies cyclically in (hole, s]
+            if (((s - h) & _mask) >= ((s - hole) & _mask)) {
+                _index[hole] = _index[s];
+                hole = s;
+            }
+        }
+        _index[hole] = nohandle;
+    }
+
+    void freeEntry(handle_t e) {
+        _entries[e].value = _sentinel;
+        _entries[e].next_free = _free;
+        _free = e;
+        _size--;
+    }
+
+    std::vector<entry_t> _entries;
+    std::vector<handle_t> _index;
+    size_t _mask;
+    size_t _max_size;
+    size_t _size = 0;
+    handle_t _free = nohandle;
+    policy_t _policy;
+    value_type _sentinel;
+    evict_cb_t _evict;
+};
+
+template<typename key_t, typename value_t>
+using fixed_lru_cache = fixed_cache<key_t, value_t, lru_policy<key_t>>;
+
+} // namespace cache
+
+#endif	/* _FIXEDCACHE_HPP_INCLUDED_ */
@@ -0,0 +1,73 @@
+#include <math.h>
+
+#include "interpolate.hpp"
+
+void windowOrigin(double offset_x, double offset_y, int32_t &col, int32_t &row, float &fx, float &fy) {
+    double u = offset_x - 0.5;
+    double v = offset_y - 0.5;
+    double x0 = floor(u);
+    double y0 = floor(v);
+    fx = (float)(u - x0);
+    fy = (float)(v - y0);
+    col = (int32_t)x0 - 1;
+    row = (int32_t)y0 - 1;
+}
+
+// Keys cubic convolution, a = -0.5 - same kernel as GDAL's cubic resampling
+static inline void cubicWeights(float t, float *w) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    w[0] = -0.5f * t3 + t2 - 0.5f * t;
+    w[1] = 1.5f * t3 - 2.5f * t2 + 1.0f;
+    w[2] = -1.5f * t3 + 2.0f * t2 + 0.5f * t;
+    w[3] = 0.5f * t3 - 0.5f * t2;
+}
+
+// taps 5, 6, 9, 10 are the 2x2 neighbourhood of the sample
+static void bilinear(const window_t *win, size_t n, float *out, float *weight) {
+    const size_t s = win->stride;
+    const float *v = win->v;
+    const float *m = win->m;
+
+    for (size_t i = 0; i < n; i++) {
+        float fx = win->fx[i], fy = win->fy[i];
+        float w00 = (1.0f - fx) * (1.0f - fy) * m[5 * s + i];
+        float w01 = fx * (1.0f - fy) * m[6 * s + i];
+        float w10 = (1.0f - fx) * fy * m[9 * s + i];
+        float w11 = fx * fy * m[10 * s + i];
+        float sum = w00 * v[5 * s + i] + w01 * v[6 * s + i] + w10 * v[9 * s + i] + w11 * v[10 * s + i];
+        float wsum = w00 + w01 + w10 + w11;
+        out[i] = (wsum > 0.0f) ? sum / wsum : 0.0f;
+        weight[i] = wsum;
+    }
+}
+
+static void bicubic(const window_t *win, size_t n, float *out, float *weight) {
+    const size_t s = win->stride;
+    const float *v = win->v;
+    const float *m = win->m;
+
+    // bilinear result first, it is the fallback for incomplete windows
+    bilinear(win, n, out, weight);
+    for (size_t i = 0; i < n; i++) {
+        float wx[INTERP_WINDOW], wy[INTERP_WINDOW];
+        float sum = 0.0f;
+        float full = 1.0f;
+        cubicWeights(win->fx[i], wx);
+        cubicWeights(win->fy[i], wy);
+        for (int k = 0; k < INTERP_TAPS; k++) {
+            sum += wy[k / INTERP_WINDOW] * wx[k % INTERP_WINDOW] * v[k * s + i];
+            full *= m[k * s + i];
+        }
+        out[i] = (full > 0.0f) ? sum : out[i];
+        weight[i] = (full > 0.0f) ? 1.0f : weight[i];
+    }
+}
+
+void interpolate(interp_t mode, const window_t *win, size_t n, float *out, float *weight) {
+    if (mode == INTERP_BICUBIC) {
+        bicubic(win, n, out, weight);
+    } else {
+        bilinear(win, n, out, weight);
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    INTERP_DEFAULT = 0,   // use the DEM's setting, nearest if unset
+    INTERP_NEAREST,
+    INTERP_BILINEAR,
+    INTERP_BICUBIC,
+} interp_t;
+
+// an interpolated sample reads a 4x4 window of pixels around it
+#define INTERP_WINDOW   4
+#define INTERP_TAPS     (INTERP_WINDOW * INTERP_WINDOW)
+
+// sample windows of n points in structure-of-arrays layout, so the kernel
+// runs straight-line arithmetic across points: tap k of point i is at
+// v[k * stride + i], taps are row major
+typedef struct {
+    float *v;       // elevation in metres, 0 where m is 0
+    float *m;       // 1 if the tap holds an elevation, 0 for NODATA or no tile
+    float *fx;      // sample position between taps 1 and 2, 0..1
+    float *fy;
+    size_t stride;
+} window_t;
+
+// window placement for a sample at tile pixel offset (offset_x, offset_y),
+// pixel centres at .5 as in gdallocationinfo: col/row is the tile pixel of tap 0
+void windowOrigin(double offset_x, double offset_y, int32_t &col, int32_t &row, float &fx, float &fy);
+
+// interpolate n windows into out. Bilinear renormalizes over valid taps,
+// bicubic falls back to bilinear unless all 16 taps are valid.
+// weight receives the sum of valid weights, 0 if no tap contributed.
+void interpolate(interp_t mode, const window_t *win, size_t n, float *out, float *weight);
@@ -1,7 +1,35 @@
 #pragma once
 
+#ifdef ARDUINO
+
 #include <ArduinoLog.h>
-#define LOG_DEBUG   Log.traceln
+// debug output filtered out costs a level check: the arguments are not evaluated
+#define LOG_DEBUG(...)  do { if (Log.getLevel() >= LOG_LEVEL_TRACE) Log.traceln(__VA_ARGS__); } while (0)
 #define LOG_ERROR   Log.errorln
 #define LOG_INFO    Log.noticeln
 
+#else
+
+// host build: same levels as ArduinoLog, printf-style output to stderr
+#define LOG_LEVEL_SILENT  0
+#define LOG_LEVEL_FATAL   1
+#define LOG_LEVEL_ERROR   2
+#define LOG_LEVEL_WARNING 3
+#define LOG_LEVEL_NOTICE  4
+#define LOG_LEVEL_TRACE   5
+#define LOG_LEVEL_VERBOSE 6
+
+#ifndef LOG_LEVEL
+    #define LOG_LEVEL LOG_LEVEL_NOTICE
+#endif
+
+void hostLog(int level, const char *fmt, ...);
+void hostLogLevel(int level);
+extern int host_log_level;
+
+// as on the ESP32, filtered debug output does not evaluate its arguments
+#define LOG_DEBUG(...)  do { if (host_log_level >= LOG_LEVEL_TRACE) hostLog(LOG_LEVEL_TRACE, __VA_ARGS__); } while (0)
+#define LOG_ERROR(...)  hostLog(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_INFO(...)   hostLog(LOG_LEVEL_NOTICE, __VA_ARGS__)
+
+#endif
@@ -11,6 +11,8 @@
  *  - add an optional evict callback
  *  - add items() iterator
  *  - add remove() method
+ *  - add clear() and resize() methods
+ *  - add peek() method
  * haberlerm@gmail.com 2/2024
  */
 #ifndef _LRUCACHE_HPP_INCLUDED_
@@ -68,15 +70,45 @@ class lru_cache {
         }
     }
 
+    // like get(), but leaves the recency order alone
+    const value_t& peek(const key_t& key) const {
+        auto it = _cache_items_map.find(key);
+        if (it == _cache_items_map.end()) {
+            return _sentinel;
+        }
+        return it->second->second;
+    }
+
     void remove(const key_t& key) {
         auto it = _cache_items_map.find(key);
         if (it != _cache_items_map.end()) {
-            if (_evict != NULL) _evict(it->first, it->second);
+            if (_evict != NULL) _evict(it->first, it->second->second);
             _cache_items_list.erase(it->second);
             _cache_items_map.erase(it);
         }
     }
 
+    void clear(void) {
+        while (!_cache_items_list.empty()) {
+            auto last = _cache_items_list.end();
+            last--;
+            if (_evict != NULL) _evict(last->first, last->second);
+            _cache_items_map.erase(last->first);
+            _cache_items_list.pop_back();
+        }
+    }
+
+    void resize(size_t max_size) {
+        _max_size = max_size;
+        while (_cache_items_map.size() > _max_size) {
+            auto last = _cache_items_list.end();
+            last--;
+            if (_evict != NULL) _evict(last->first, last->second);
+            _cache_items_map.erase(last->first);
+            _cache_items_list.pop_back();
+        }
+    }
+
     bool exists(const key_t& key) const {
         return _cache_items_map.find(key) != _cache_items_map.end();
     }
@@ -8,13 +8,11 @@
 #include "SD.h"
 #include "math.h"
 #include "Esp.h"
+#include "platform.hpp"
 #include "logging.hpp"
 #include "mbtiles.hpp"
 #include "slippytiles.hpp"
 
-#define STARTTIME(x) { x = esp_timer_get_time();}
-#define LAPTIME(x)  (uint32_t) (esp_timer_get_time() - x)
-
 #ifdef CORES3
 #define AW9523_ADDR 0x58
 #define SD_CS 4
@@ -1,9 +1,25 @@
-#include <Arduino.h>
-
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdarg.h>
 #include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <new>
+#include <unordered_map>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#ifdef ARDUINO
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/task.h>
+#else
+    #include <thread>
+    #include <pthread.h>
+#endif
 
 #include "pngle.h"
 
@@ -11,22 +27,202 @@
 #include "webp/encode.h"
 #include "webp/types.h"
 
+#include "platform.hpp"
 #include "logging.hpp"
 #include "mbtiles.hpp"
 #include "slippytiles.hpp"
+#include "interpolate.hpp"
+
+#if RAWDEM_MMAP
+    #include <sys/mman.h>
+#endif
 
 static const char *tileQuery = "SELECT tile_data FROM tiles WHERE"
                                " zoom_level = ? AND tile_column = ? AND tile_row = ?";
-static const char *max_zoomQuery = "SELECT max(zoom_level) FROM tiles";
+static const char *rowidQuery = "SELECT rowid FROM tiles WHERE"
+                                " zoom_level = ? AND tile_column = ? AND tile_row = ?";
+static const char *tablesQuery = "SELECT type FROM sqlite_master WHERE name = 'tiles'";
+static const char *max_zoomQuery = "SELECT min(zoom_level),max(zoom_level) FROM tiles";
+static const char *metadataQuery = "SELECT name,value FROM metadata WHERE"
+                                   " name IN ('bounds','minzoom','maxzoom','format')";
 static const char *bboxQuery = "SELECT min(tile_column),max(tile_column),"
                                "min(tile_row),max(tile_row) FROM tiles WHERE zoom_level = ?";
+static const char *tileSizeQuery = "SELECT tile_data FROM tiles WHERE zoom_level = ? LIMIT 1";
+static const char *summaryCreate = "CREATE TABLE IF NOT EXISTS elevation_summary (zoom_level INTEGER,"
+                                   " tile_column INTEGER, tile_row INTEGER, min INTEGER, max INTEGER, blocks BLOB,"
+                                   " PRIMARY KEY (zoom_level, tile_column, tile_row))";
+static const char *summaryQuery = "SELECT tile_column, tile_row, min, max FROM elevation_summary"
+                                  " WHERE zoom_level = ?";
+static const char *blocksQuery = "SELECT blocks FROM elevation_summary WHERE"
+                                 " zoom_level = ? AND tile_column = ? AND tile_row = ?";
+
+// a window of tile pixels x0..x1-1, y0..y1-1
+typedef struct {
+    int32_t x0;
+    int32_t y0;
+    int32_t x1;
+    int32_t y1;
+} roi_t;
+
+// min/max per tile of a DEM for area queries: every complete tile cached is
+// noted, the first query reads the summary table or raw index
+typedef struct demSummary {
+    std::mutex lock;
+    std::unordered_map<uint64_t, elevRange_t> tiles;
+    bool loaded;        // table or index read
+    bool complete;      // tiles holds every tile of the DEM
+    bool blocks;        // the table has per block ranges
+} demSummary_t;
+
+#if DEM_STATS
+// the live counters behind demStats_t
+typedef struct demCounters {
+    struct {
+        counter_t<uint32_t> buckets[STATS_BUCKETS];
+        counter_t<uint64_t> total_ns;
+        std::atomic<uint32_t> max_ns;
+    } stage[STAGE_COUNT];
+    counter_t<uint64_t> bytes_read;
+    counter_t<uint64_t> bytes_decoded;
+    std::atomic<int32_t> tiles_cached;
+    counter_t<uint32_t> tiles_dropped;
+    std::atomic<int64_t> tile_bytes;
+    std::atomic<int64_t> tile_bytes_peak;
+} demCounters_t;
+
+static void statStage(demInfo_t *di, stage_t stage, uint64_t ns);
+static void statTile(demInfo_t *di, const tile_t *tile, int sign);
+
+#define STAT_START(t)           uint32_t t = FINETIME()
+#define STAT_RESTART(t)         t = FINETIME()
+#define STAT_STAGE(di, s, t)    statStage(di, s, (uint64_t)(uint32_t)(FINETIME() - (t)) * 1000 / FINE_PER_US)
+#define STAT_US(di, s, us)      statStage(di, s, (uint64_t)(us) * 1000)
+#define STAT_ADD(di, field, n)  do { if ((di)->stats != NULL) (di)->stats->field += (n); } while (0)
+#define STAT_TILE(di, t, sign)  statTile(di, t, sign)
+#else
+#define STAT_START(t)           do {} while (0)
+#define STAT_RESTART(t)         do {} while (0)
+#define STAT_STAGE(di, s, t)    do {} while (0)
+#define STAT_US(di, s, us)      do {} while (0)
+#define STAT_ADD(di, field, n)  do {} while (0)
+#define STAT_TILE(di, t, sign)  do {} while (0)
+#endif
 
 static void evictTile(uint64_t key, tile_t *t);
+static int rawProbe(const char *path, const struct stat &st, demInfo_t *di);
 
-static cache::lru_cache<uint64_t, tile_t *> tile_cache(TILECACHE_SIZE, {}, evictTile);
-static std::vector<demInfo_t *> dems;
+typedef cache::fixed_cache<uint64_t, tile_t *, TILECACHE_POLICY<uint64_t>> tileCache_t;
+
+// the tile cache, split by key into shards with a lock each. An entry holds
+// a reference to its tile, lookups take their own under the shard lock and
+// read the tile after dropping the lock; the last reference frees it.
+// Uniform tiles have entries of their own: at most tiles entries hold pixels.
+typedef struct tileShard {
+    std::mutex lock;
+    tileCache_t cache;
+    size_t tiles;       // entries with pixels allowed
+    size_t buffered;    // entries with pixels
+    tileShard() : cache(1, NULL, evictTile), tiles(1), buffered(0) {}
+} tileShard_t;
+
+static tileShard_t shards[TILECACHE_SHARDS];
+
+// a cache entry which holds pixels
+static bool tileBuffered(const uint64_t &, tile_t *const &tile) {
+    return !tile->uniform;
+}
+static size_t nshards = 1;      // in use
+static std::vector<demInfo_t *> dems;   // finest resolution first
+static std::unordered_map<uint32_t, std::vector<demInfo_t *>> demgrid;
+static std::vector<demInfo_t *> demwide;    // over DEMGRID_WIDE cells, finest first
+static std::mutex dem_lock;     // addDEM()
+static size_t cache_size;       // 0 until first sized
+static std::atomic<uint32_t> prefetch_unused;  // cached by the prefetcher, not used yet
+// tiles which could not be loaded, the longest known forgotten first
+static cache::fixed_lru_cache<uint64_t, locStatus_t> absent(ABSENT_MAX, LS_VALID);
+static std::mutex absent_lock;
 static uint8_t dbindex;
+
+// tiles being loaded by a lookup; lookups missing them too wait for that load.
+// A few at a time: a list, reserved so a miss does not allocate
+static std::vector<uint64_t> loading;
+static std::mutex loading_lock;
+static std::condition_variable loading_done;
+
+// decoded tiles are kept in slabs of TILESIZE x TILESIZE elevations, allocated
+// up front so tiles coming and going don't fragment PSRAM. Slabs in use by the
+// cache or a decoder are not on the free list, which holds raw memory: a
+// tile_t is constructed in a slab when it is taken and destroyed when it
+// comes back.
+static std::vector<void *> slabs_free;
+static size_t slabs_total;      // allocated
+static size_t slabs_wanted;     // surplus slabs are freed as they come back
+static uint32_t slab_overflows; // tiles put on the heap: larger, or no slab free
+static std::mutex slab_lock;
+static const size_t slab_bytes = sizeof(tile_t) + TILESIZE * TILESIZE * sizeof(int16_t);
+
+// what decoders need besides the tile, kept for the next decode instead of
+// freed, TILESLAB_SPARE at most of each, so misses don't allocate once warm:
+// images WebP tiles decode into before they become elevations, and pngle
+// decoders. Larger images come from the heap and go back to it.
+#define SCRATCH_BYTES (TILESIZE * TILESIZE * 4)
+static std::vector<uint8_t *> scratch_free;
+static std::vector<pngle_t *> pngles_free;
+static std::mutex scratch_lock;
+// headers of uniform and mapped raw tiles, which come and go with each miss
+static std::vector<void *> headers_free;   // raw memory, like slabs_free
+static std::mutex header_lock;
+static const size_t header_bytes = sizeof(tile_t) + sizeof(int16_t);
+
+// the blob cache, second tier behind the tile cache: compressed tiles whose
+// decoded tile was evicted, within blob_budget bytes. A miss in the tile cache
+// found here is decoded from RAM; the blob then moves back with its tile.
+// fetchTile() takes from it on any thread: use under blob_lock
+typedef struct {
+    uint8_t *data;      // follows the header
+    uint32_t size;
+} blob_t;
+
+static void blobEvict(uint64_t key, blob_t *blob);
+
+static cache::fixed_lru_cache<uint64_t, blob_t *> blob_cache(BLOBCACHE_ENTRIES, NULL, blobEvict);
+static size_t blob_budget = BLOBCACHE_BYTES;
+static size_t blob_used;
+static uint32_t blob_hits, blob_misses, blob_demotions, blob_evictions;
+static std::mutex blob_lock;
+// blobs which decoded to a uniform tile: copies of them, like the empty tiles
+// of a sparse overlay, become uniform tiles without decoding
+typedef struct {
+    uint64_t hash;      // of the blob, 0: unused
+    uint8_t *data;      // the blob itself, compared on a hash match
+    int size;
+    uint16_t width;
+    uint16_t height;
+    int32_t base;
+    int32_t min;
+    int32_t max;
+    int16_t value;
+} uniformBlob_t;
+
+static uniformBlob_t uniform_blobs[UNIFORM_BLOBS];
+static size_t uniform_next;     // replaced next
+static uint32_t uniform_known;
+static std::mutex uniform_lock;
+static const double metres_per_degree = 111320.0;   // of latitude
+
+// the latest position for the spatial policy, and where the track leads in
+// SPATIAL_HORIZON seconds: lookups move both, prefetchUpdate() sets the lead.
+// Points are x << 32 | y in 32 bit fractions of the world, so the cost of a
+// tile is differences from its key. Single precision is plenty to rank tiles.
+typedef struct {
+    std::atomic<uint64_t> at;
+    std::atomic<uint64_t> ahead;
+    std::atomic<float> lead_x;  // from at to ahead, in fractions of the world
+    std::atomic<float> lead_y;
+} position_t;
+static position_t here;
 static uint8_t pngSignature[] = { 0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A };
+static uint8_t dpkSignature[] = { 0x89, 'D', 'P', 'K' };
 
 int getBBox(sqlite3 *db, demInfo_t *di) {
     sqlite3_stmt* stmt = nullptr;
@@ -40,7 +236,8 @@ int getBBox(sqlite3 *db, demInfo_t *di) {
     }
     rc = sqlite3_step(stmt);
     if (rc == SQLITE_ROW) {
-        max_zoom = sqlite3_column_int(stmt, 0);
+        di->min_zoom = sqlite3_column_int(stmt, 0);
+        max_zoom = sqlite3_column_int(stmt, 1);
         di->max_zoom = max_zoom;
         LOG_DEBUG("max_zoom: %d", max_zoom);
     } else {
@@ -51,6 +248,10 @@ int getBBox(sqlite3 *db, demInfo_t *di) {
     sqlite3_finalize(stmt);
     stmt = nullptr;
     rc = sqlite3_prepare_v2(db, bboxQuery, -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return rc;
+    }
     sqlite3_bind_int(stmt, 1, max_zoom);
     rc = sqlite3_step(stmt);
     if (rc == SQLITE_ROW) {
@@ -66,11 +267,12 @@ int getBBox(sqlite3 *db, demInfo_t *di) {
     }
     sqlite3_finalize(stmt);
 
-    di->bbox.ll_lat = tiley2lat(tr_max, max_zoom);
+    // tilex2long/tiley2lat give the top left corner of a tile, so the
+    // far edges of the bbox are those of the next column and row
+    di->bbox.ll_lat = tiley2lat(tr_max + 1, max_zoom);
     di->bbox.ll_lon = tilex2long(tc_min, max_zoom);
     di->bbox.tr_lat = tiley2lat(tr_min, max_zoom);
-    di->bbox.tr_lon = tilex2long(tc_max, max_zoom);
-    di->index = ++dbindex;
+    di->bbox.tr_lon = tilex2long(tc_max + 1, max_zoom);
 
     LOG_DEBUG("bbox %F %F %F %F",
               di->bbox.ll_lat, di->bbox.tr_lat,
@@ -78,25 +280,343 @@ int getBBox(sqlite3 *db, demInfo_t *di) {
     return SQLITE_OK;
 }
 
-int addDEM(const char *path, demInfo_t **demInfo) {
-    demInfo_t *di = new demInfo_t();
-    int rc = sqlite3_open(path, &di->db);
-    if (rc != SQLITE_OK) {
-        LOG_ERROR("Can't open database %s: rc=%d %s", path, rc, sqlite3_errmsg(di->db));
-        delete di;
-        return rc;
+// bounds, zooms and format from the metadata table: no scan of the tiles
+// false unless bounds and maxzoom are there
+static bool readMetadata(sqlite3 *db, demInfo_t *di) {
+    sqlite3_stmt* stmt = nullptr;
+    bool bounds = false, zoom = false;
+    int min_zoom = -1;
+
+    if (sqlite3_prepare_v2(db, metadataQuery, -1, &stmt, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *name = (const char *)sqlite3_column_text(stmt, 0);
+        const char *value = (const char *)sqlite3_column_text(stmt, 1);
+        if ((name == NULL) || (value == NULL))
+            continue;
+        if (!strcmp(name, "bounds")) {
+            // left,bottom,right,top
+            bounds = (sscanf(value, "%lf,%lf,%lf,%lf", &di->bbox.ll_lon, &di->bbox.ll_lat,
+                             &di->bbox.tr_lon, &di->bbox.tr_lat) == 4) &&
+                     (di->bbox.ll_lon < di->bbox.tr_lon) && (di->bbox.ll_lat < di->bbox.tr_lat);
+        } else if (!strcmp(name, "maxzoom")) {
+            di->max_zoom = atoi(value);
+            zoom = true;
+        } else if (!strcmp(name, "minzoom")) {
+            min_zoom = atoi(value);
+        } else if (!strcmp(name, "format")) {
+            if (!strcmp(value, "png")) {
+                di->encoding = ENC_PNG;
+            } else if (!strcmp(value, "webp")) {
+                di->encoding = ENC_WEBP;
+            } else if (!strcmp(value, "dpk")) {
+                di->encoding = ENC_DPK;
+            } else {
+                di->encoding = ENC_BAD_FORMAT;
+                LOG_ERROR("tile format %s is not Terrain-RGB", value);
+            }
+        }
+    }
+    sqlite3_finalize(stmt);
+    di->min_zoom = ((min_zoom >= 0) && (min_zoom <= di->max_zoom)) ? min_zoom : di->max_zoom;
+    LOG_DEBUG("metadata: bounds %d zoom %d..%d", bounds, di->min_zoom, di->max_zoom);
+    return bounds && zoom;
+}
+
+// bbox, zooms and format of an archive of this size and mtime, read or
+// computed by an earlier addDEM()
+static std::string sidecarPath(const char *path) {
+    return std::string(path) + DEM_SIDECAR;
+}
+
+static bool readSidecar(const char *path, const struct stat &st, demInfo_t *di) {
+    long long size, mtime;
+    int min_zoom, max_zoom, encoding, tile_size;
+
+    if (!*DEM_SIDECAR)
+        return false;
+    FILE *f = fopen(sidecarPath(path).c_str(), "r");
+    if (f == NULL)
+        return false;
+    int n = fscanf(f, "%lld %lld %d %d %d %lf %lf %lf %lf %d", &size, &mtime, &min_zoom, &max_zoom, &encoding,
+                   &di->bbox.ll_lon, &di->bbox.ll_lat, &di->bbox.tr_lon, &di->bbox.tr_lat, &tile_size);
+    fclose(f);
+    if ((n != 10) || (size != (long long)st.st_size) || (mtime != (long long)st.st_mtime) ||
+            (tile_size <= 0) || (tile_size > UINT16_MAX)) {
+        LOG_DEBUG("%s: stale sidecar", path);
+        return false;
+    }
+    di->min_zoom = min_zoom;
+    di->max_zoom = max_zoom;
+    di->encoding = (encoding_t)encoding;
+    di->tile_size = tile_size;
+    return true;
+}
+
+static void writeSidecar(const char *path, const struct stat &st, const demInfo_t *di) {
+    if (!*DEM_SIDECAR)
+        return;
+    FILE *f = fopen(sidecarPath(path).c_str(), "w");
+    if (f == NULL) {
+        LOG_DEBUG("%s: can't write sidecar: %s", path, strerror(errno));
+        return;
+    }
+    fprintf(f, "%lld %lld %d %d %d %.9f %.9f %.9f %.9f %d\n", (long long)st.st_size, (long long)st.st_mtime,
+            di->min_zoom, di->max_zoom, di->encoding,
+            di->bbox.ll_lon, di->bbox.ll_lat, di->bbox.tr_lon, di->bbox.tr_lat, di->tile_size);
+    fclose(f);
+}
+
+static uint16_t blobTileSize(const uint8_t *blob, int size);
+
+// the size of the tiles at the highest zoom, from the header of one of them;
+// lookups project with it, so it is settled before the DEM is used
+static void readTileSize(sqlite3 *db, demInfo_t *di) {
+    sqlite3_stmt* stmt = nullptr;
+
+    if (sqlite3_prepare_v2(db, tileSizeQuery, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, di->max_zoom);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            uint16_t size = blobTileSize((const uint8_t *)sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0));
+            if (size != 0)
+                di->tile_size = size;
+        }
+    }
+    sqlite3_finalize(stmt);
+    LOG_DEBUG("tile size %u", di->tile_size);
+}
+
+// tile blobs can be streamed with sqlite3_blob_open() from a table, not from a view
+static bool tilesIsTable(sqlite3 *db) {
+    sqlite3_stmt* stmt = nullptr;
+    bool table = false;
+
+    if (sqlite3_prepare_v2(db, tablesQuery, -1, &stmt, nullptr) == SQLITE_OK &&
+            sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *type = (const char *)sqlite3_column_text(stmt, 0);
+        table = (type != NULL) && !strcmp(type, "table");
+    }
+    sqlite3_finalize(stmt);
+    return table;
+}
+
+static void connClose(dbConn_t *c) {
+    heap_caps_free(c->chunk);
+    sqlite3_finalize(c->tile_stmt);
+    sqlite3_finalize(c->rowid_stmt);
+    sqlite3_close(c->db);
+    *c = {};
+}
+
+// prepare the tile queries on an open connection
+static int connPrepare(demInfo_t *di, dbConn_t *c) {
+    c->chunk = (uint8_t *) heap_caps_malloc(BLOB_CHUNK, MALLOC_CAP_8BIT);
+    if (c->chunk == NULL)
+        return SQLITE_NOMEM;
+    int rc = sqlite3_prepare_v3(c->db, tileQuery, -1, SQLITE_PREPARE_PERSISTENT, &c->tile_stmt, nullptr);
+    if ((rc == SQLITE_OK) && di->tile_blobs) {
+        di->stmt_prepares++;
+        rc = sqlite3_prepare_v3(c->db, rowidQuery, -1, SQLITE_PREPARE_PERSISTENT, &c->rowid_stmt, nullptr);
     }
-    // retrieve bbox
-    rc = getBBox(di->db, di);
     if (rc != SQLITE_OK) {
-        LOG_DEBUG("bbox query failed %s: rc=%d %s", path, rc, sqlite3_errmsg(di->db));
-        di->db_errors++;
-        delete di;
+        LOG_ERROR("%s: prepare failed rc=%d %s", di->path, rc, sqlite3_errmsg(c->db));
         return rc;
     }
+    di->stmt_prepares++;
+    return SQLITE_OK;
+}
+
+// finer resolution first, then the order DEMs were added in
+static bool finerThan(const demInfo_t *a, const demInfo_t *b) {
+    uint64_t pa = (uint64_t)a->tile_size << a->max_zoom;
+    uint64_t pb = (uint64_t)b->tile_size << b->max_zoom;
+    if (pa != pb)
+        return pa > pb;
+    return a->index < b->index;
+}
+
+static uint32_t gridCell(int32_t row, int32_t col) {
+    return (uint32_t)row * DEMGRID_COLUMNS + col;
+}
+
+static int32_t gridRow(double lat) {
+    int32_t row = (int32_t)floor((lat + 90.0) / DEMGRID_CELL);
+    return (row < 0) ? 0 : ((row >= DEMGRID_ROWS) ? DEMGRID_ROWS - 1 : row);
+}
+
+static int32_t gridColumn(double lon) {
+    int32_t col = (int32_t)floor((lon + 180.0) / DEMGRID_CELL);
+    return (col < 0) ? 0 : ((col >= DEMGRID_COLUMNS) ? DEMGRID_COLUMNS - 1 : col);
+}
+
+static void cellInsert(std::vector<demInfo_t *> &cell, demInfo_t *di) {
+    cell.insert(std::upper_bound(cell.begin(), cell.end(), di, finerThan), di);
+}
+
+static bool cellOverlaps(const demInfo_t *di, int32_t row, int32_t col) {
+    return (row >= gridRow(di->bbox.ll_lat)) && (row <= gridRow(di->bbox.tr_lat)) &&
+           (col >= gridColumn(di->bbox.ll_lon)) && (col <= gridColumn(di->bbox.tr_lon));
+}
+
+// enter a DEM in every grid cell its bbox overlaps, keeping each cell's list
+// in priority order, so selection only looks at DEMs which may contain the point.
+// A DEM over more than DEMGRID_WIDE cells, a continental or global one, goes
+// into demwide instead, and only into the cells other DEMs have: memory does
+// not grow with its area
+static void indexDEM(demInfo_t *di) {
+    int32_t row0 = gridRow(di->bbox.ll_lat), row1 = gridRow(di->bbox.tr_lat);
+    int32_t col0 = gridColumn(di->bbox.ll_lon), col1 = gridColumn(di->bbox.tr_lon);
+
+    dems.insert(std::upper_bound(dems.begin(), dems.end(), di, finerThan), di);
+    for (size_t i = 0; i < dems.size(); i++) {
+        dems[i]->rank = i;
+    }
+    if ((int64_t)(row1 - row0 + 1) * (col1 - col0 + 1) > DEMGRID_WIDE) {
+        cellInsert(demwide, di);
+        for (auto &c: demgrid) {
+            if (cellOverlaps(di, c.first / DEMGRID_COLUMNS, c.first % DEMGRID_COLUMNS))
+                cellInsert(c.second, di);
+        }
+        return;
+    }
+    for (int32_t row = row0; row <= row1; row++) {
+        for (int32_t col = col0; col <= col1; col++) {
+            auto it = demgrid.find(gridCell(row, col));
+            if (it == demgrid.end()) {
+                // a new cell starts with the wide DEMs over it
+                it = demgrid.emplace(gridCell(row, col), std::vector<demInfo_t *>()).first;
+                for (auto w: demwide) {
+                    if (cellOverlaps(w, row, col))
+                        it->second.push_back(w);
+                }
+            }
+            cellInsert(it->second, di);
+        }
+    }
+}
+
+// the DEMs which may contain the point, finest first; demwide where no
+// other DEM is
+static const std::vector<demInfo_t *> *demCandidates(double lat, double lon) {
+    auto it = demgrid.find(gridCell(gridRow(lat), gridColumn(lon)));
+    if (it != demgrid.end())
+        return &it->second;
+    return demwide.empty() ? NULL : &demwide;
+}
+
+// a point as a fraction of the world's width, 0..1, in 32 bits
+static inline uint64_t worldFixed(float f) {
+    if (f <= 0.0f)
+        return 0;
+    return (f < 1.0f) ? (uint64_t)(f * 4294967296.0f) : UINT32_MAX;
+}
+
+// spatial_policy cost of a tile in tiles: its distance from the position and
+// from where the track leads, plus how far behind the position it lies
+static float tileCost(const uint64_t &key, void *) {
+    xyz_t k;
+    k.key = key;
+    uint64_t at = here.at.load(std::memory_order_relaxed);
+    uint64_t ahead = here.ahead.load(std::memory_order_relaxed);
+    int shift = 32 - k.entry.z;
+    int64_t x = (int64_t)(at >> 32), y = (int64_t)(uint32_t)at;
+    // the tile's centre and the lead relative to the position
+    int64_t cx = ((int64_t)k.entry.x << shift) + ((int64_t)1 << (shift - 1)) - x;
+    int64_t cy = ((int64_t)k.entry.y << shift) + ((int64_t)1 << (shift - 1)) - y;
+    int64_t ax = (int64_t)(ahead >> 32) - x, ay = (int64_t)(uint32_t)ahead - y;
+    float tile = 1.0f / (float)((int64_t)1 << shift);
+    float dx = cx * tile, dy = cy * tile, lx = ax * tile, ly = ay * tile;
+    float lead = sqrtf(lx * lx + ly * ly);
+    float behind = (lead > 0.0f) ? -(dx * lx + dy * ly) / lead : 0.0f;
+    return sqrtf(dx * dx + dy * dy) + sqrtf((dx - lx) * (dx - lx) + (dy - ly) * (dy - ly)) +
+           (float)SPATIAL_BEHIND * ((behind > 0.0f) ? behind : 0.0f);
+}
+
+// policies needing more than a capacity get it here
+template<typename P>
+inline void policyInit(P &) {
+}
+
+template<>
+inline void policyInit(cache::spatial_policy<uint64_t> &policy) {
+    policy.cost(tileCost, NULL);
+}
+
+// the position moved: project it for the spatial policy
+static void setHere(double lat, double lon) {
+    float r = (float)lat * ((float)M_PI / 180.0f);
+    float x = ((float)lon + 180.0f) / 360.0f;
+    float y = 0.5f - logf(tanf((float)M_PI / 4.0f + r / 2.0f)) / (2.0f * (float)M_PI);
+    float ax = x + here.lead_x.load(std::memory_order_relaxed);
+    float ay = y + here.lead_y.load(std::memory_order_relaxed);
+    here.at.store(worldFixed(x) << 32 | worldFixed(y), std::memory_order_relaxed);
+    here.ahead.store(worldFixed(ax) << 32 | worldFixed(ay), std::memory_order_relaxed);
+}
+
+// neighbouring tiles, and tiles along any track, spread over the shards
+static inline tileShard_t &shardOf(uint64_t key) {
+    return shards[((key * 0x9E3779B97F4A7C15ull) >> 32) % nshards];
+}
+
+int addDEM(const char *path, demInfo_t **demInfo) {
+    std::lock_guard<std::mutex> guard(dem_lock);
+    if (cache_size == 0)
+        setCacheSize(TILECACHE_SIZE);
+    for (auto &shard: shards) {
+        policyInit(shard.cache.policy());
+    }
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        LOG_ERROR("Can't open database %s: %s", path, strerror(errno));
+        return SQLITE_CANTOPEN;
+    }
+    demInfo_t *di = new demInfo_t();
     di->tile_size = TILESIZE;
+    // a raw container has it all in its header. For MBTiles, bbox and zooms
+    // come from the sidecar, else the metadata, else a scan of the tiles
+    int raw = rawProbe(path, st, di);
+    if (raw < 0) {
+        delete di;
+        return SQLITE_CORRUPT;
+    }
+    if (raw > 0) {
+        LOG_DEBUG("%s: raw DEM", path);
+    } else if (readSidecar(path, st, di)) {
+        di->bbox_source = BBOX_SIDECAR;
+    } else {
+        sqlite3 *db = NULL;
+        int rc = sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL);
+        if (rc == SQLITE_OK) {
+            if (readMetadata(db, di)) {
+                di->bbox_source = BBOX_METADATA;
+            } else {
+                di->bbox_source = BBOX_SCAN;
+                rc = getBBox(db, di);
+            }
+        }
+        if (rc == SQLITE_OK)
+            readTileSize(db, di);
+        if (rc != SQLITE_OK) {
+            LOG_ERROR("Can't read database %s: rc=%d %s", path, rc, sqlite3_errmsg(db));
+            sqlite3_close(db);
+            delete di;
+            return rc;
+        }
+        sqlite3_close(db);
+        writeSidecar(path, st, di);
+    }
+    di->index = ++dbindex;
     di->path = strdup(path);
-    dems.push_back(di);
+    di->summary = new demSummary_t();
+#if DEM_STATS
+    di->stats = new demCounters_t();
+#endif
+    projection_init(&di->proj, di->bbox.ll_lat, di->bbox.ll_lon, di->bbox.tr_lat, di->bbox.tr_lon,
+                    di->max_zoom, di->tile_size);
+    indexDEM(di);
+    loadCacheSnapshot(di);
     if (demInfo != NULL) {
         *demInfo = di;
     }
@@ -108,214 +628,3873 @@ bool demContains(demInfo_t *di, double lat, double lon) {
              (lon > di->bbox.ll_lon) && (lon < di->bbox.tr_lon));
 }
 
+// have n slabs, under slab_lock
+static void slabsReserve(size_t n) {
+    slabs_wanted = n;
+    slabs_free.reserve(n);
+    while (slabs_total < n) {
+        void *slab = heap_caps_malloc(slab_bytes, MALLOC_CAP_SPIRAM);
+        if (slab == NULL) {
+            LOG_ERROR("can't allocate tile slab %u", (uint32_t)slabs_total);
+            break;
+        }
+        slabs_free.push_back(slab);
+        slabs_total++;
+    }
+    while ((slabs_total > n) && !slabs_free.empty()) {
+        heap_caps_free(slabs_free.back());
+        slabs_free.pop_back();
+        slabs_total--;
+    }
+}
+
+// an image of bytes for a decoder, NULL if out of memory
+static uint8_t *scratchTake(size_t bytes) {
+    if (bytes <= SCRATCH_BYTES) {
+        std::lock_guard<std::mutex> guard(scratch_lock);
+        if (!scratch_free.empty()) {
+            uint8_t *p = scratch_free.back();
+            scratch_free.pop_back();
+            return p;
+        }
+        bytes = SCRATCH_BYTES;
+    }
+    return (uint8_t *)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+}
+
+// give back what scratchTake(bytes) returned
+static void scratchGive(uint8_t *p, size_t bytes) {
+    if (p == NULL)
+        return;
+    if (bytes <= SCRATCH_BYTES) {
+        std::lock_guard<std::mutex> guard(scratch_lock);
+        if (scratch_free.size() < TILESLAB_SPARE) {
+            scratch_free.push_back(p);
+            return;
+        }
+    }
+    heap_caps_free(p);
+}
+
+// a pngle decoder, ready for a new image
+static pngle_t *pngleTake(void) {
+    {
+        std::lock_guard<std::mutex> guard(scratch_lock);
+        if (!pngles_free.empty()) {
+            pngle_t *p = pngles_free.back();
+            pngles_free.pop_back();
+            return p;
+        }
+    }
+    return pngle_new();
+}
+
+static void pngleGive(pngle_t *p) {
+    if (p == NULL)
+        return;
+    pngle_reset(p);
+    {
+        std::lock_guard<std::mutex> guard(scratch_lock);
+        if (pngles_free.size() < TILESLAB_SPARE) {
+            pngles_free.push_back(p);
+            return;
+        }
+    }
+    pngle_destroy(p);
+}
+
 std::string keyStr(uint64_t key) {
     xyz_t k;
     k.key = key;
     return string_format("dem=%d %d/%d/%d",k.entry.index, k.entry.z, k.entry.x, k.entry.y);
 }
 
+void setCacheSize(size_t entries) {
+    // a freshly decoded tile must survive its own insertion
+    cache_size = (entries > 0) ? entries : 1;
+    // tiles move shards with their number
+    size_t n = std::min(std::max(cache_size / TILECACHE_SHARD_MIN, (size_t)1), (size_t)TILECACHE_SHARDS);
+    for (size_t i = 0; i < TILECACHE_SHARDS; i++) {
+        tileShard_t &shard = shards[i];
+        std::lock_guard<std::mutex> guard(shard.lock);
+        if (n != nshards)
+            shard.cache.clear();
+        if (i < n) {
+            shard.tiles = cache_size / n + (i < cache_size % n);
+            shard.cache.resize(shard.tiles + TILECACHE_UNIFORM / n + (i < TILECACHE_UNIFORM % n));
+            while ((shard.buffered > shard.tiles) && shard.cache.evict(tileBuffered))
+                ;
+        }
+    }
+    nshards = n;
+    {
+        std::lock_guard<std::mutex> guard(scratch_lock);
+        scratch_free.reserve(TILESLAB_SPARE);
+        pngles_free.reserve(TILESLAB_SPARE);
+    }
+    {
+        std::lock_guard<std::mutex> guard(loading_lock);
+        loading.reserve(TILESLAB_SPARE + DBPOOL_SIZE + 4);
+    }
+    {
+        // uniform entries, and each pixel entry may be a mapped raw tile
+        std::lock_guard<std::mutex> guard(header_lock);
+        headers_free.reserve(cache_size + TILECACHE_UNIFORM + TILESLAB_SPARE);
+    }
+    std::lock_guard<std::mutex> guard(slab_lock);
+    slabsReserve(cache_size + TILESLAB_SPARE);
+}
+
+// the tile cache in slabs, at least one
+void setCacheBytes(size_t tile_bytes, size_t blob_bytes) {
+    setCacheSize(tile_bytes / slab_bytes);
+    std::lock_guard<std::mutex> guard(blob_lock);
+    blob_budget = blob_bytes;
+    while ((blob_used > blob_budget) && blob_cache.evict())
+        ;
+}
+
+void getCacheStats(cacheStats_t *stats) {
+    *stats = {};
+    stats->tile_bytes = cache_size * slab_bytes;
+    for (auto &shard: shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        stats->tile_entries += shard.cache.size();
+        stats->uniform_entries += shard.cache.size() - shard.buffered;
+    }
+    for (auto d: dems) {
+        stats->tile_hits += d->cache_hits;
+        stats->tile_misses += d->cache_misses;
+    }
+    std::lock_guard<std::mutex> guard(blob_lock);
+    stats->blob_bytes = blob_budget;
+    stats->blob_used = blob_used;
+    stats->blob_entries = blob_cache.size();
+    stats->blob_hits = blob_hits;
+    stats->blob_misses = blob_misses;
+    stats->blob_demotions = blob_demotions;
+    stats->blob_evictions = blob_evictions;
+    std::lock_guard<std::mutex> uguard(uniform_lock);
+    stats->uniform_known = uniform_known;
+}
+
+void flushCache(void) {
+    // the tile cache demotes to the blob cache: clear it first
+    for (auto &shard: shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.cache.clear();
+    }
+    {
+        std::lock_guard<std::mutex> guard(blob_lock);
+        blob_cache.clear();
+    }
+    std::lock_guard<std::mutex> guard(absent_lock);
+    absent.clear();
+}
+
 void printCache(void) {
-    for (auto item: tile_cache.items()) {
-        LOG_INFO("%s", keyStr(item.first).c_str());
+    for (size_t i = 0; i < nshards; i++) {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        shards[i].cache.for_each([i](uint64_t key, tile_t *) {
+            LOG_INFO("shard %u: %s", (uint32_t)i, keyStr(key).c_str());
+        });
     }
+    LOG_INFO("slabs %u free of %u, %u tiles on the heap",
+             (uint32_t)slabs_free.size(), (uint32_t)slabs_total, slab_overflows);
 }
 
 void printDems(void) {
     for (auto d: dems) {
-        LOG_INFO("dem %d: %s bbx=%F/%F..%F/%F dberr=%d tile_err=%d hits=%d misses=%d tilesize=%d",
+        LOG_INFO("dem %d: %s bbx=%F/%F..%F/%F dberr=%d tile_err=%d hits=%d misses=%d tilesize=%d"
+                 " fetch=%uuS decode=%uuS fetches=%u prepared=%u pool=%u/%u waits=%u"
+                 " prefetched=%d used=%d wasted=%d prefetch=%uuS",
                  d->index, d->path,d->bbox.ll_lat,d->bbox.ll_lon, d->bbox.tr_lat,d->bbox.tr_lon,
-                 d->db_errors, d->tile_errors, d->cache_hits, d->cache_misses, d->tile_size);
+                 (uint32_t)d->db_errors, (uint32_t)d->tile_errors, (uint32_t)d->cache_hits,
+                 (uint32_t)d->cache_misses, d->tile_size,
+                 (uint32_t)d->fetch_us, (uint32_t)d->decode_us, (uint32_t)d->fetches,
+                 (uint32_t)d->stmt_prepares, (uint32_t)d->pool_opens, DBPOOL_SIZE, (uint32_t)d->pool_waits,
+                 (uint32_t)d->prefetch_loads, (uint32_t)d->prefetch_hits, (uint32_t)d->prefetch_wasted,
+                 (uint32_t)d->prefetch_us);
+#if DEM_STATS
+        LOG_INFO("dem %d stats %s", d->index, demStatsJSON(d).c_str());
+#endif
     }
 }
 
-static void freeTile(tile_t *tile) {
-    if (tile == NULL)
+#if DEM_STATS
+static void statStage(demInfo_t *di, stage_t stage, uint64_t ns) {
+    if (di->stats == NULL)
         return;
-    if (tile->buffer != NULL)
-        heap_caps_free(tile->buffer);
-    heap_caps_free(tile);
+    auto &h = di->stats->stage[stage];
+    uint32_t v = (ns > UINT32_MAX) ? UINT32_MAX : ns;
+    h.buckets[(v > 1) ? 31 - __builtin_clz(v) : 0]++;
+    h.total_ns += v;
+    uint32_t max = h.max_ns.load(std::memory_order_relaxed);
+    while ((v > max) && !h.max_ns.compare_exchange_weak(max, v, std::memory_order_relaxed))
+        ;
 }
 
-static void evictTile(uint64_t key, tile_t *t) {
-    LOG_DEBUG("evict %s",keyStr(key).c_str());
-    if (t != NULL) {
-        if ( t->buffer != NULL)
-            heap_caps_free(t->buffer);
-        heap_caps_free(t);
+// a tile of di entered (sign 1) or left (-1) the cache: mapped raw tiles
+// hold only their header, the elevations are the file's
+static void statTile(demInfo_t *di, const tile_t *tile, int sign) {
+    demCounters_t *c = di->stats;
+    if (c == NULL)
+        return;
+    bool own = tile->uniform || (tile->buffer == (const int16_t *)(tile + 1));
+    size_t pixels = tile->uniform ? 1 : (size_t)tile->width * tile->height;
+    int64_t bytes = sign * (int64_t)(sizeof(tile_t) + (own ? pixels * sizeof(int16_t) : 0));
+    c->tiles_cached += sign;
+    if (sign < 0)
+        c->tiles_dropped++;
+    int64_t now = c->tile_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t peak = c->tile_bytes_peak.load(std::memory_order_relaxed);
+    while ((now > peak) && !c->tile_bytes_peak.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+        ;
+}
+#endif
+
+bool getDemStats(const demInfo_t *di, demStats_t *stats) {
+    *stats = {};
+#if DEM_STATS
+    const demCounters_t *c = di->stats;
+    if (c == NULL)
+        return false;
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        stageStats_t &st = stats->stage[i];
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            st.buckets[b] = c->stage[i].buckets[b];
+            st.count += st.buckets[b];
+        }
+        st.total_ns = c->stage[i].total_ns;
+        st.max_ns = c->stage[i].max_ns.load(std::memory_order_relaxed);
     }
+    stats->bytes_read = c->bytes_read;
+    stats->bytes_decoded = c->bytes_decoded;
+    stats->tiles_cached = std::max(c->tiles_cached.load(std::memory_order_relaxed), 0);
+    stats->tiles_dropped = c->tiles_dropped;
+    stats->tile_bytes = std::max<int64_t>(c->tile_bytes.load(std::memory_order_relaxed), 0);
+    stats->tile_bytes_peak = c->tile_bytes_peak.load(std::memory_order_relaxed);
+    return true;
+#else
+    (void)di;
+    return false;
+#endif
 }
 
-static encoding_t encodingType(const uint8_t *blob, int blob_size) {
-    if (memcmp(blob, pngSignature, sizeof(pngSignature)) == 0) {
-        return ENC_PNG;
+uint32_t stagePercentile(const stageStats_t *stage, double p) {
+    uint64_t want = ceil(p * stage->count), seen = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        seen += stage->buckets[b];
+        if ((seen > 0) && (seen >= want))
+            return std::min<uint64_t>((2ull << b) - 1, stage->max_ns);
     }
-    if (!memcmp(blob, "RIFF", 4) && !memcmp(blob + 8, "WEBP", 4)) {
-        return ENC_WEBP;
+    return stage->max_ns;
+}
+
+std::string demStatsJSON(const demInfo_t *di) {
+    static const char *names[STAGE_COUNT] = { "lookup", "select", "project", "cache", "fetch", "decode" };
+    demStats_t st;
+    std::string json;
+
+    if (!getDemStats(di, &st))
+        return "{}";
+    json = "{\"path\":\"";
+    for (const char *p = di->path; *p; p++) {
+        if ((*p == '"') || (*p == '\\'))
+            json += '\\';
+        json += *p;
     }
-    return ENC_UNKNOWN;
+    json += "\",\"stages\":{";
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const stageStats_t &s = st.stage[i];
+        int last = STATS_BUCKETS - 1;
+        while ((last > 0) && (s.buckets[last] == 0))
+            last--;
+        json += string_format("%s\"%s\":{\"count\":%u,\"mean_ns\":%llu,\"p50_ns\":%u,\"p99_ns\":%u,"
+                              "\"max_ns\":%u,\"buckets\":[", i ? "," : "", names[i], s.count,
+                              (unsigned long long)(s.count ? s.total_ns / s.count : 0),
+                              stagePercentile(&s, 0.5), stagePercentile(&s, 0.99), s.max_ns);
+        for (int b = 0; b <= last; b++) {
+            json += string_format("%s%u", b ? "," : "", s.buckets[b]);
+        }
+        json += "]}";
+    }
+    json += string_format("},\"bytes_read\":%llu,\"bytes_decoded\":%llu,\"tiles_cached\":%u,"
+                          "\"tiles_dropped\":%u,\"tile_bytes\":%zu,\"tile_bytes_peak\":%zu}",
+                          (unsigned long long)st.bytes_read, (unsigned long long)st.bytes_decoded,
+                          st.tiles_cached, st.tiles_dropped, st.tile_bytes, st.tile_bytes_peak);
+    return json;
 }
 
-static void pngle_init_cb(pngle_t *pngle, uint32_t w, uint32_t h) {
-    size_t size =  w * h * 3;
-    tile_t *tile = (tile_t *)heap_caps_malloc(sizeof(tile_t), MALLOC_CAP_SPIRAM);
-    tile->buffer = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+void resetDemStats(demInfo_t *di) {
+#if DEM_STATS
+    demCounters_t *c = di->stats;
+    if (c == NULL)
+        return;
+    for (auto &h: c->stage) {
+        for (auto &b: h.buckets) {
+            b = 0;
+        }
+        h.total_ns = 0;
+        h.max_ns.store(0, std::memory_order_relaxed);
+    }
+    c->bytes_read = 0;
+    c->bytes_decoded = 0;
+    c->tiles_dropped = 0;
+    c->tile_bytes_peak.store(c->tile_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+#else
+    (void)di;
+#endif
+}
+
+// a tile and its elevations are one block, a slab or from the heap
+static tile_t *newTile(uint32_t w, uint32_t h) {
+    void *p = NULL;
+    {
+        std::lock_guard<std::mutex> guard(slab_lock);
+        if (slabs_total == 0)
+            slabsReserve(cache_size + TILESLAB_SPARE);
+        if ((w * h <= TILESIZE * TILESIZE) && !slabs_free.empty()) {
+            p = slabs_free.back();
+            slabs_free.pop_back();
+        } else {
+            slab_overflows++;
+        }
+    }
+    bool slab = (p != NULL);
+    if (p == NULL) {
+        p = heap_caps_malloc(sizeof(tile_t) + w * h * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+        if (p == NULL)
+            return NULL;
+    }
+    tile_t *tile = new (p) tile_t{};
+    tile->slab = slab;
+    tile->header = false;
+    tile->buffer = (int16_t *)(tile + 1);
+    tile->blob = NULL;
+    tile->uniform = false;
+    tile->prefetched = false;
+    tile->refs.store(1, std::memory_order_relaxed);
+    tile->base = 0;
+    tile->min = INT32_MAX;
+    tile->max = INT32_MIN;
     tile->width = w;
-    pngle_set_user_data(pngle, tile);
+    tile->height = h;
+    tile->x0 = 0;
+    tile->y0 = 0;
+    tile->x1 = w;
+    tile->y1 = h;
+    return tile;
 }
 
-static int lines = 6;
-static void pngle_draw_cb(pngle_t *pngle, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t rgba[4]) {
-    tile_t *tile = (tile_t *) pngle_get_user_data(pngle);
-    size_t offset = (x + tile->width * y) * 3;
-    tile->buffer[offset] = rgba[0];
-    tile->buffer[offset+1] = rgba[1];
-    tile->buffer[offset+2] = rgba[2];
+// a tile with room for one pixel, pooled: the elevations are elsewhere or all the same
+static tile_t *newTileHeader(uint16_t w, uint16_t h, int32_t base, int32_t min, int32_t max) {
+    void *p = NULL;
+    {
+        std::lock_guard<std::mutex> guard(header_lock);
+        if (!headers_free.empty()) {
+            p = headers_free.back();
+            headers_free.pop_back();
+        }
+    }
+    if (p == NULL) {
+        p = heap_caps_malloc(header_bytes, MALLOC_CAP_8BIT);
+        if (p == NULL)
+            return NULL;
+    }
+    tile_t *tile = new (p) tile_t{};
+    tile->buffer = (int16_t *)(tile + 1);
+    tile->blob = NULL;
+    tile->slab = false;
+    tile->header = true;
+    tile->uniform = false;
+    tile->prefetched = false;
+    tile->refs.store(1, std::memory_order_relaxed);
+    tile->base = base;
+    tile->min = min;
+    tile->max = max;
+    tile->width = w;
+    tile->height = h;
+    tile->x0 = 0;
+    tile->y0 = 0;
+    tile->x1 = w;
+    tile->y1 = h;
+    return tile;
 }
 
-bool lookupTile(demInfo_t *di, locInfo_t *locinfo, double lat, double lon) {
-    xyz_t key;
-    tile_t *tile = NULL;
-    double offset_x, offset_y;
-    int32_t tile_x, tile_y;
-    compute_pixel_offset(lat, lon, di->max_zoom, di->tile_size,
-                         tile_x, tile_y, offset_x, offset_y);
+// a tile of value v throughout
+static tile_t *newUniformTile(uint16_t w, uint16_t h, int32_t base, int32_t min, int32_t max, int16_t v) {
+    tile_t *tile = newTileHeader(w, h, base, min, max);
+    if (tile == NULL)
+        return NULL;
+    tile->buffer[0] = v;
+    tile->uniform = true;
+    return tile;
+}
 
-    key.entry.index = di->index;
-    key.entry.x =  (uint16_t)tile_x;
-    key.entry.y =  (uint16_t)tile_y;
-    key.entry.z = di->max_zoom;
+// pixel c/r of tile, the one value of a uniform tile
+static inline int16_t tilePixel(const tile_t *tile, int32_t c, int32_t r) {
+    return tile->uniform ? tile->buffer[0] : tile->buffer[c + r * tile->width];
+}
 
-    if (!tile_cache.exists(key.key)) {
-        LOG_DEBUG("cache entry %s not found", keyStr(key.key).c_str());
-        di->cache_misses++;
+static inline bool tilePartial(const tile_t *tile) {
+    return (tile->x0 > 0) || (tile->y0 > 0) || (tile->x1 < tile->width) || (tile->y1 < tile->height);
+}
 
-        // fetch the missing tile
-        sqlite3_stmt* stmt = nullptr;
-        int rc = sqlite3_prepare_v2(di->db, tileQuery, -1, &stmt, nullptr);
+// the decoded window of tile includes roi, or all of the tile for a NULL roi
+static inline bool tileCovers(const tile_t *tile, const roi_t *roi) {
+    if (roi == NULL)
+        return !tilePartial(tile);
+    return (roi->x0 >= tile->x0) && (roi->y0 >= tile->y0) &&
+           (roi->x1 <= tile->x1) && (roi->y1 <= tile->y1);
+}
 
-        sqlite3_bind_int(stmt, 1, key.entry.z);
-        sqlite3_bind_int(stmt, 2, key.entry.x);
-        sqlite3_bind_int(stmt, 3, key.entry.y);
+static void blobFree(blob_t *blob) {
+    heap_caps_free(blob);
+}
 
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            const uint8_t *blob = (const uint8_t *)sqlite3_column_blob(stmt, 0);
-            int blob_size = sqlite3_column_bytes(stmt, 0);
-
-            switch(encodingType(blob, blob_size)) {
-                case ENC_PNG: {
-                        pngle_t *pngle = pngle_new();
-                        pngle_set_init_callback(pngle, pngle_init_cb);
-                        pngle_set_draw_callback(pngle, pngle_draw_cb);
-                        int fed = pngle_feed(pngle, blob, blob_size);
-                        if (fed != blob_size) {
-                            LOG_ERROR("%s: decode failed: decoded %d out of %u: %s",
-                                      keyStr(key.key).c_str(), fed, blob_size, pngle_error(pngle));
-                            freeTile(tile);
-                            tile = NULL;
-                            di->tile_errors++;
-                            locinfo->status = LS_PNG_DECODE_ERROR;
-                        } else {
-                            pngle_ihdr_t *hdr = pngle_get_ihdr(pngle);
-                            if (hdr->compression) {
-                                locinfo->status = LS_PNG_COMPRESSED;
-                                LOG_ERROR("%s: compressed PNG tile",
-                                          keyStr(key.key).c_str());
-                            } else {
-                                di->tile_size = pngle_get_width(pngle);
-                                tile = (tile_t *) pngle_get_user_data(pngle);
-                                tile_cache.put(key.key, tile);
-                                locinfo->status = LS_VALID;
-                            }
-                        }
-                        pngle_destroy(pngle);
-                        sqlite3_finalize(stmt);
-                    }
-                    break;
-                case ENC_WEBP: {
-                        int width, height;
-                        VP8StatusCode sc;
-                        WebPDecoderConfig config;
-                        size_t bufsize;
-                        uint8_t *buffer;
-
-                        WebPInitDecoderConfig(&config);
-                        if (!WebPGetInfo(blob, blob_size, &width, &height)) {
-                            LOG_ERROR("%s: WebPGetInfo failed rc=%d", keyStr(key.key).c_str(), rc);
-                            locinfo->status = LS_WEBP_DECODE_ERROR;
-                            sqlite3_finalize(stmt);
-                            break;
-                        }
-                        sc = WebPGetFeatures(blob, blob_size, &config.input);
-                        if (sc != VP8_STATUS_OK) {
-                            LOG_ERROR("%s: WebPGetFeatures failed sc=%d", keyStr(key.key).c_str(), sc);
-                            locinfo->status = LS_WEBP_DECODE_ERROR;
-                            sqlite3_finalize(stmt);
-                            break;
-                        }
-                        if (config.input.format != 2) {
-                            LOG_ERROR("%s: lossy WEBP compression", keyStr(key.key).c_str());
-                            locinfo->status = LS_WEBP_COMPRESSED;
-                            sqlite3_finalize(stmt);
-                            break;
-                        }
-                        LOG_DEBUG("webp w %d h %d alpha %d animate %d format %d",
-                                  config.input.width, config.input.height,config.input.has_alpha,
-                                  config.input.has_animation, config.input.format);
-
-                        tile = (tile_t *) heap_caps_malloc(sizeof(tile_t), MALLOC_CAP_SPIRAM);
-                        bufsize = width * height * 3;
-                        buffer = (uint8_t *) heap_caps_malloc(bufsize, MALLOC_CAP_SPIRAM);
-                        if ((tile != NULL) && (buffer != NULL) && (bufsize != 0)) {
-                            tile->buffer = buffer;
-                            tile->width = config.input.width;
-                            if (WebPDecodeRGBInto(blob, blob_size,
-                                                  buffer, bufsize, width * 3) == NULL) {
-                                LOG_ERROR("%s: WebPDecode failed", keyStr(key.key).c_str());
-                                freeTile(tile);
-                                tile = NULL;
-                                di->tile_errors++;
-                                locinfo->status = LS_WEBP_DECODE_ERROR;
-                            } else {
-                                di->tile_size = config.input.width;
-                                tile_cache.put(key.key, tile);
-                                locinfo->status = LS_VALID;
-                            }
-                            WebPFreeDecBuffer(&config.output);
-                            sqlite3_finalize(stmt);
-                        }
-                        break;
-                    default:
-                        locinfo->status = LS_UNKNOWN_IMAGE_FORMAT;
-                        break;
-                    }
-            }
+static void freeTile(tile_t *tile) {
+    if (tile == NULL)
+        return;
+    blobFree((blob_t *)tile->blob);
+    bool slab = tile->slab, header = tile->header;
+    void *p = tile;
+    tile->~tile_t();
+    if (slab) {
+        std::lock_guard<std::mutex> guard(slab_lock);
+        if (slabs_total <= slabs_wanted) {
+            slabs_free.push_back(p);
+            return;
         }
-    } else {
-        LOG_DEBUG("cache entry %s found: ", keyStr(key.key).c_str());
-        tile = tile_cache.get(key.key);
-        locinfo->status = LS_VALID;
-        di->cache_hits++;
+        slabs_total--;
     }
-    // assert(tile->buffer != NULL);
-    if (locinfo->status == LS_VALID) {
-        size_t i = round(offset_x)  + round(offset_y) * di->tile_size;
-        locinfo->elevation = rgb2alt(&tile->buffer[i * 3] );
-        return true;
+    if (header) {
+        std::lock_guard<std::mutex> guard(header_lock);
+        if (headers_free.size() < headers_free.capacity()) {
+            headers_free.push_back(p);
+            return;
+        }
     }
-    return false;
+    heap_caps_free(p);
 }
 
-int getLocInfo(double lat, double lon, locInfo_t *locinfo) {
-    for (auto di: dems) {
-        if (demContains(di, lat, lon)) {
-            LOG_DEBUG("%F %F contained in %s", lat, lon, di->path);
-            if (lookupTile(di, locinfo, lat, lon)) {
-                return SQLITE_OK;
-            }
-        }
+// drop a reference to tile, the last one frees it
+static void tileRelease(tile_t *tile) {
+    if (tile->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        freeTile(tile);
+}
+
+static demInfo_t *demByIndex(uint16_t index) {
+    for (auto d: dems) {
+        if (d->index == index)
+            return d;
     }
-    locinfo->status = LS_TILE_NOT_FOUND;
-    return SQLITE_OK;
+    return NULL;
+}
+
+// a blob of size bytes for the blob cache, NULL if it is off or the blob won't fit
+static blob_t *blobNew(int size) {
+    {
+        std::lock_guard<std::mutex> guard(blob_lock);
+        if ((size_t)size > blob_budget)
+            return NULL;
+    }
+    blob_t *blob = (blob_t *)heap_caps_malloc(sizeof(blob_t) + size, MALLOC_CAP_SPIRAM);
+    if (blob == NULL)
+        return NULL;
+    blob->data = (uint8_t *)(blob + 1);
+    blob->size = size;
+    return blob;
+}
+
+// blob_cache evict callback, under blob_lock
+static void blobEvict(uint64_t, blob_t *blob) {
+    blob_used -= blob->size;
+    blob_evictions++;
+    blobFree(blob);
+}
+
+// the blob of an evicted tile moves to the blob cache, oldest blobs make room
+static void blobDemote(uint64_t key, blob_t *blob) {
+    std::lock_guard<std::mutex> guard(blob_lock);
+    if (blob->size > blob_budget) {
+        blobFree(blob);
+        return;
+    }
+    while ((blob_used + blob->size > blob_budget) && blob_cache.evict())
+        ;
+    if (!blob_cache.put(key, blob)) {
+        blobFree(blob);
+        return;
+    }
+    blob_used += blob->size;
+    blob_demotions++;
+}
+
+// the blob of a tile to decode, taken out of the blob cache; NULL on a miss
+static blob_t *blobTake(uint64_t key) {
+    std::lock_guard<std::mutex> guard(blob_lock);
+    blob_t *blob;
+    if (!blob_cache.take(key, blob)) {
+        blob_misses++;
+        return NULL;
+    }
+    blob_used -= blob->size;
+    blob_hits++;
+    return blob;
+}
+
+// tile cache evict callback, under the shard lock; lookups still reading
+// the tile keep it until they are done
+static void evictTile(uint64_t key, tile_t *t) {
+    LOG_DEBUG("evict %s",keyStr(key).c_str());
+#if DEM_STATS
+    {
+        xyz_t k;
+        k.key = key;
+        demInfo_t *di = demByIndex(k.entry.index);
+        if (di != NULL)
+            STAT_TILE(di, t, -1);
+    }
+#endif
+    if (t->prefetched) {
+        xyz_t k;
+        k.key = key;
+        t->prefetched = false;
+        prefetch_unused--;
+        demInfo_t *di = demByIndex(k.entry.index);
+        if (di != NULL)
+            di->prefetch_wasted++;
+    }
+    if (t->blob != NULL) {
+        blobDemote(key, (blob_t *)t->blob);
+        t->blob = NULL;
+    }
+    if (!t->uniform)
+        shardOf(key).buffered--;
+    tileRelease(t);
+}
+
+// cache tile for key in shard, under its lock; a tile with pixels may
+// evict others with pixels to stay within shard.tiles
+static bool shardPut(tileShard_t &shard, uint64_t key, tile_t *tile) {
+    shard.cache.remove(key);
+    if (!tile->uniform) {
+        while ((shard.buffered >= shard.tiles) && shard.cache.evict(tileBuffered))
+            ;
+    }
+    if (!shard.cache.put(key, tile))
+        return false;
+    shard.buffered += !tile->uniform;
+    return true;
+}
+
+static inline int16_t clampElevation(int32_t v) {
+    return (v < -ELEV_RANGE) ? -ELEV_RANGE : ((v > ELEV_RANGE) ? ELEV_RANGE : v);
+}
+
+// move the tile base to the middle of lo..hi, re-encoding what was stored so far
+static void rebaseTile(tile_t *tile, int32_t lo, int32_t hi) {
+    int32_t base = lo + (hi - lo) / 2;
+    int32_t delta = tile->base - base;
+    size_t n = (size_t)tile->width * tile->height;
+
+    if (hi - lo > 2 * ELEV_RANGE) {
+        LOG_ERROR("elevation range %d..%d dm exceeds tile encoding, clamping", lo, hi);
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (tile->buffer[i] != ELEV_NODATA)
+            tile->buffer[i] = clampElevation(tile->buffer[i] + delta);
+    }
+    tile->base = base;
+}
+
+// store one Terrain-RGB pixel, rebasing the tile if the value does not fit
+static void storePixel(tile_t *tile, size_t i, const uint8_t *px, bool nodata) {
+    int32_t dm = rgb2dm(px);
+
+    // fully transparent pixels and RGB 0/0/0 (-10000m) carry no elevation
+    if (nodata || ((px[0] | px[1] | px[2]) == 0)) {
+        tile->buffer[i] = ELEV_NODATA;
+        return;
+    }
+    if ((dm < tile->min) || (dm > tile->max)) {
+        int32_t lo = (dm < tile->min) ? dm : tile->min;
+        int32_t hi = (dm > tile->max) ? dm : tile->max;
+        if (tile->min > tile->max) {
+            tile->base = dm;
+        } else if ((lo - tile->base < -ELEV_RANGE) || (hi - tile->base > ELEV_RANGE)) {
+            rebaseTile(tile, lo, hi);
+        }
+        tile->min = lo;
+        tile->max = hi;
+    }
+    tile->buffer[i] = clampElevation(dm - tile->base);
+}
+
+// convert a decoded RGB(A) image of the w x h window at x0/y0 of the tile,
+// choosing the base up front
+static void storeImage(tile_t *tile, const uint8_t *image, size_t bpp,
+                       uint16_t x0, uint16_t y0, uint16_t w, uint16_t h) {
+    size_t n = (size_t)w * h;
+    int32_t lo = INT32_MAX, hi = INT32_MIN;
+
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *px = image + i * bpp;
+        if (((bpp == 4) && (px[3] == 0)) || ((px[0] | px[1] | px[2]) == 0))
+            continue;
+        int32_t dm = rgb2dm(px);
+        lo = (dm < lo) ? dm : lo;
+        hi = (dm > hi) ? dm : hi;
+    }
+    if (lo <= hi) {
+        tile->base = lo + (hi - lo) / 2;
+        tile->min = lo;
+        tile->max = hi;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *px = image + i * bpp;
+        int16_t *dst = tile->buffer + (y0 + i / w) * tile->width + x0 + i % w;
+        if (((bpp == 4) && (px[3] == 0)) || ((px[0] | px[1] | px[2]) == 0))
+            *dst = ELEV_NODATA;
+        else
+            *dst = clampElevation(rgb2dm(px) - tile->base);
+    }
+    tile->x0 = x0;
+    tile->y0 = y0;
+    tile->x1 = x0 + w;
+    tile->y1 = y0 + h;
+}
+
+static encoding_t encodingType(const uint8_t *blob, int blob_size) {
+    if (blob_size < 12) {
+        return ENC_UNKNOWN;
+    }
+    if (memcmp(blob, pngSignature, sizeof(pngSignature)) == 0) {
+        return ENC_PNG;
+    }
+    if (!memcmp(blob, "RIFF", 4) && !memcmp(blob + 8, "WEBP", 4)) {
+        return ENC_WEBP;
+    }
+    if (memcmp(blob, dpkSignature, sizeof(dpkSignature)) == 0) {
+        return ENC_DPK;
+    }
+    return ENC_UNKNOWN;
+}
+
+// the width of the image in a tile blob, from its header; 0 if unknown
+static uint16_t blobTileSize(const uint8_t *blob, int size) {
+    switch(encodingType(blob, size)) {
+        case ENC_PNG: {
+                // IHDR comes first, the width big endian after its length and type
+                if (size < 24)
+                    return 0;
+                uint32_t w = ((uint32_t)blob[16] << 24) | ((uint32_t)blob[17] << 16) | (blob[18] << 8) | blob[19];
+                return (w <= UINT16_MAX) ? (uint16_t)w : 0;
+            }
+        case ENC_WEBP: {
+                int w, h;
+                if (!WebPGetInfo(blob, size, &w, &h) || (w > UINT16_MAX))
+                    return 0;
+                return (uint16_t)w;
+            }
+        case ENC_DPK: {
+                dpkHeader_t h;
+                if (size < (int)sizeof(h))
+                    return 0;
+                memcpy(&h, blob, sizeof(h));
+                return h.width;
+            }
+        default:
+            return 0;
+    }
+}
+
+typedef struct {
+    tile_t *tile;
+    uint32_t stop_row;  // decoding may stop once rows 0..stop_row-1 are complete
+    uint32_t rows;      // complete so far
+} pngDecode_t;
+
+static void pngle_init_cb(pngle_t *pngle, uint32_t w, uint32_t h) {
+    pngDecode_t *ctx = (pngDecode_t *) pngle_get_user_data(pngle);
+    ctx->tile = newTile(w, h);
+    // interlaced images complete no row before the last pass
+    if (pngle_get_ihdr(pngle)->interlace)
+        ctx->stop_row = UINT32_MAX;
+}
+
+static void pngle_draw_cb(pngle_t *pngle, uint32_t x, uint32_t y, uint32_t, uint32_t, uint8_t rgba[4]) {
+    pngDecode_t *ctx = (pngDecode_t *) pngle_get_user_data(pngle);
+    tile_t *tile = ctx->tile;
+    if (tile == NULL)
+        return;
+    storePixel(tile, x + tile->width * y, rgba, rgba[3] == 0);
+    if (x == tile->width - 1u)
+        ctx->rows = y + 1;
+}
+
+// a tile of the size lookups project with: addDEM() fixed it, and a tile
+// of another size would be read out of bounds
+static bool tileSizeOk(demInfo_t *di, const tile_t *tile) {
+    return (tile->width == di->tile_size) && (tile->height == di->tile_size);
+}
+
+static xyz_t makeKey(demInfo_t *di, int32_t tile_x, int32_t tile_y) {
+    xyz_t key;
+    key.entry.index = di->index;
+    key.entry.x =  (uint16_t)tile_x;
+    key.entry.y =  (uint16_t)tile_y;
+    key.entry.z = di->max_zoom;
+    return key;
+}
+
+static xyz_t tileKey(demInfo_t *di, double lat, double lon, double &offset_x, double &offset_y) {
+    int32_t tile_x, tile_y;
+    float x, y;
+    project_lat_lon(&di->proj, lat, lon, tile_x, tile_y, x, y);
+    offset_x = x;
+    offset_y = y;
+    return makeKey(di, tile_x, tile_y);
+}
+
+// the tile at the lower zoom z holding the point at offset_x/y of tile key,
+// with the offsets in it
+static xyz_t zoomKey(demInfo_t *di, xyz_t key, int z, double &offset_x, double &offset_y) {
+    int shift = key.entry.z - z;
+    xyz_t k = key;
+    k.entry.x = key.entry.x >> shift;
+    k.entry.y = key.entry.y >> shift;
+    k.entry.z = z;
+    offset_x = ((key.entry.x - (k.entry.x << shift)) * (double)di->tile_size + offset_x) / (1 << shift);
+    offset_y = ((key.entry.y - (k.entry.y << shift)) * (double)di->tile_size + offset_y) / (1 << shift);
+    return k;
+}
+
+// a tile blob read in chunks: incrementally from an open sqlite3_blob, or
+// from a blob SQLite materialized in memory; what is read may be copied
+// to a blob kept for the blob cache on the way
+typedef struct {
+    sqlite3_blob *blob;     // NULL: read from data
+    const uint8_t *data;
+    int size;
+    int pos;
+    uint8_t *copy;          // NULL: not kept, else size bytes
+} blobReader_t;
+
+// read up to len bytes, 0 at the end, -1 on error
+static int readBlob(blobReader_t *r, uint8_t *buf, int len) {
+    int n = std::min(len, r->size - r->pos);
+    if (n <= 0)
+        return 0;
+    if (r->blob != NULL) {
+        if (sqlite3_blob_read(r->blob, buf, n, r->pos) != SQLITE_OK)
+            return -1;
+    } else {
+        memcpy(buf, r->data + r->pos, n);
+    }
+    if (r->copy != NULL)
+        memcpy(r->copy + r->pos, buf, n);
+    r->pos += n;
+    return n;
+}
+
+// 64 bit FNV-1a, never 0
+static uint64_t blobHash(const uint8_t *data, int size) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int i = 0; i < size; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ull;
+    }
+    return (h != 0) ? h : 1;
+}
+
+// a new uniform tile if the blob decoded to one before, else NULL
+static tile_t *uniformKnown(uint64_t hash, const uint8_t *data, int size) {
+    std::lock_guard<std::mutex> guard(uniform_lock);
+    for (auto &b: uniform_blobs) {
+        if ((b.hash == hash) && (b.size == size) && !memcmp(b.data, data, size)) {
+            uniform_known++;
+            return newUniformTile(b.width, b.height, b.base, b.min, b.max, b.value);
+        }
+    }
+    return NULL;
+}
+
+// replace a fully decoded tile of one value throughout by a uniform tile,
+// remembering its blob, read again from r, unless hash is 0
+static tile_t *tileUniform(tile_t *tile, uint64_t hash, blobReader_t *r, uint8_t *chunk) {
+    // several elevations: not uniform. Else NODATA pixels may still differ
+    if (tile->min < tile->max)
+        return tile;
+    size_t n = (size_t)tile->width * tile->height;
+    int16_t v = tile->buffer[0];
+    for (size_t i = 1; i < n; i++) {
+        if (tile->buffer[i] != v)
+            return tile;
+    }
+    tile_t *u = newUniformTile(tile->width, tile->height, tile->base, tile->min, tile->max, v);
+    if (u == NULL)
+        return tile;
+    freeTile(tile);
+    if (hash == 0)
+        return u;
+    // the decoders consumed the chunk
+    r->pos = 0;
+    int size = readBlob(r, chunk, BLOB_CHUNK);
+    if ((size != r->size) || (blobHash(chunk, size) != hash))
+        return u;
+    std::lock_guard<std::mutex> guard(uniform_lock);
+    for (auto &b: uniform_blobs) {
+        if ((b.hash == hash) && (b.size == size) && !memcmp(b.data, chunk, size))
+            return u;
+    }
+    uniformBlob_t &b = uniform_blobs[uniform_next];
+    uint8_t *data = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (data == NULL)
+        return u;
+    memcpy(data, chunk, size);
+    heap_caps_free(b.data);
+    b = { hash, data, size, u->width, u->height, u->base, u->min, u->max, v };
+    uniform_next = (uniform_next + 1) % UNIFORM_BLOBS;
+    return u;
+}
+
+static inline uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t u) {
+    return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+
+// the DPK prediction for pixel c/r, from the row so far and the one above
+static inline int32_t dpkPredict(const int32_t *row, const int32_t *up, uint32_t c, uint32_t r) {
+    if (r == 0)
+        return (c == 0) ? 0 : row[c - 1];
+    if (c == 0)
+        return up[0];
+    return row[c - 1] + up[c] - up[c - 1];
+}
+
+// decode a DPK blob into a new tile, the first have bytes of it in chunk
+// with a roi, decoding stops below it
+static tile_t *dpkDecode(xyz_t key, blobReader_t *r, uint8_t *chunk, int have, const roi_t *roi) {
+    dpkHeader_t h;
+
+    if (have < (int)sizeof(h))
+        return NULL;
+    memcpy(&h, chunk, sizeof(h));
+    if ((h.version != DPK_VERSION) || (h.predictor != DPK_PREDICT_GRADIENT) || (h.width == 0) || (h.height == 0)) {
+        LOG_ERROR("%s: DPK version %u predictor %u %ux%u not supported", keyStr(key.key).c_str(),
+                  h.version, h.predictor, h.width, h.height);
+        return NULL;
+    }
+    tile_t *tile = newTile(h.width, h.height);
+    // each row has a zero left of it, and the one above the first is zeros:
+    // then the gradient is the prediction on the edges too
+    size_t rows_bytes = 2 * (h.width + 1) * sizeof(int32_t);
+    int32_t *rows = (int32_t *)scratchTake(rows_bytes);
+    if ((tile == NULL) || (rows == NULL)) {
+        freeTile(tile);
+        scratchGive((uint8_t *)rows, rows_bytes);
+        return NULL;
+    }
+    memset(rows, 0, rows_bytes);
+    if (h.min <= h.max) {
+        tile->base = h.min + (h.max - h.min) / 2;
+        tile->min = h.min;
+        tile->max = h.max;
+    }
+    // rows top down: stop below the last one needed
+    uint32_t stop = h.height;
+    if (roi != NULL)
+        stop = std::min<int32_t>(std::max<int32_t>(roi->y1, 1), h.height);
+    size_t total = (size_t)h.width * h.height, n = (size_t)h.width * stop, i = 0;
+    int32_t *row = rows + 1, *up = rows + h.width + 2;
+    int32_t base = tile->base;
+    uint32_t residual[DPK_BLOCK];
+    uint32_t c = 0;
+    int16_t *dst = tile->buffer;
+    int pos = sizeof(h);
+    uint32_t zeros = 0;
+    bool ok = true;
+
+    while (ok && (i < n)) {
+        // keep a whole block in chunk, and 8 bytes after it for the loads below
+        if ((have - pos < 1 + 4 * DPK_BLOCK) || (BLOB_CHUNK - pos < 1 + 4 * DPK_BLOCK + 8)) {
+            have -= pos;
+            memmove(chunk, chunk + pos, have);
+            pos = 0;
+            int got = readBlob(r, chunk + have, BLOB_CHUNK - have);
+            ok = (got >= 0);
+            have += std::max(got, 0);
+        }
+        uint32_t bits = 0;
+        if (zeros > 0) {
+            zeros--;
+        } else {
+            bits = (pos < have) ? chunk[pos++] : UINT32_MAX;
+            if ((bits & DPK_ZEROS) && (bits != UINT32_MAX)) {
+                zeros = bits & ~DPK_ZEROS;
+                bits = 0;
+            }
+        }
+        size_t m = std::min<size_t>(DPK_BLOCK, total - i);
+        size_t bytes = (m * bits + 7) / 8;
+        if (!ok || (bits > 32) || (pos + bytes > (size_t)have)) {
+            ok = false;
+            break;
+        }
+        // residual k starts at bit k * bits: one unaligned little endian load each
+        const uint8_t *p = chunk + pos;
+        uint64_t mask = (1ull << bits) - 1;
+        pos += bytes;
+        if ((m == DPK_BLOCK) && (c + m <= h.width) && (i + m <= n)) {
+            // a whole block within a row: no wrap to care for, and loops
+            // of a fixed count the compiler can unroll and vectorize
+            int32_t *out = row + c;
+            const int32_t *above = up + c;
+            int32_t delta[DPK_BLOCK];
+            for (size_t k = 0; k < DPK_BLOCK; k++) {
+                uint64_t word;
+                memcpy(&word, p + ((k * bits) >> 3), sizeof(word));
+                delta[k] = above[k] - above[(ptrdiff_t)k - 1] + unzigzag((word >> ((k * bits) & 7)) & mask);
+            }
+            int32_t left = out[-1];
+            for (size_t k = 0; k < DPK_BLOCK; k++) {
+                left += delta[k];
+                out[k] = left;
+            }
+            for (size_t k = 0; k < DPK_BLOCK; k++)
+                dst[k] = (out[k] == DPK_NODATA) ? ELEV_NODATA : clampElevation(out[k] - base);
+            c += DPK_BLOCK;
+            dst += DPK_BLOCK;
+            i += DPK_BLOCK;
+            if (c == h.width) {
+                c = 0;
+                std::swap(row, up);
+            }
+            continue;
+        }
+        for (size_t k = 0, at = 0; k < m; k++, at += bits) {
+            uint64_t word;
+            memcpy(&word, p + (at >> 3), sizeof(word));
+            residual[k] = (word >> (at & 7)) & mask;
+        }
+        for (size_t k = 0; (k < m) && (i < n); k++, i++) {
+            int32_t v = row[(int32_t)c - 1] + up[c] - up[(int32_t)c - 1] + unzigzag(residual[k]);
+            row[c] = v;
+            *dst++ = (v == DPK_NODATA) ? ELEV_NODATA : clampElevation(v - base);
+            if (++c == h.width) {
+                c = 0;
+                std::swap(row, up);
+            }
+        }
+    }
+    scratchGive((uint8_t *)rows, rows_bytes);
+    if (!ok) {
+        LOG_ERROR("%s: DPK decode failed at pixel %u of %u", keyStr(key.key).c_str(), (uint32_t)i, (uint32_t)n);
+        freeTile(tile);
+        return NULL;
+    }
+    tile->y1 = stop;
+    return tile;
+}
+
+// decode a Terrain-RGB blob into a new tile, NULL with the reason in locinfo->status
+// the blob is streamed into the decoder through chunk, BLOB_CHUNK bytes at a time
+// with a roi, decoding may stop early or skip what lies outside: the tile
+// is partial then, its window tells what was decoded
+// a tile of one value throughout comes back uniform, without pixels; a blob
+// within one chunk which decoded to one before is not decoded again
+// touches only the uniform blobs, so the prefetch worker can use it too
+static tile_t *decodeTile(xyz_t key, blobReader_t *r, uint8_t *chunk, locInfo_t *locinfo,
+                          const roi_t *roi) {
+    tile_t *tile = NULL;
+    int have = readBlob(r, chunk, BLOB_CHUNK);
+    int size = r->size;
+    uint64_t hash = ((have > 0) && (have == size)) ? blobHash(chunk, have) : 0;
+
+    if (hash != 0) {
+        tile = uniformKnown(hash, chunk, size);
+        if (tile != NULL) {
+            locinfo->status = LS_VALID;
+            return tile;
+        }
+    }
+
+    switch(encodingType(chunk, have)) {
+        case ENC_PNG: {
+                // pngle emits rows top down: stop reading below the last row needed
+                pngDecode_t ctx = { NULL, (roi != NULL) ? (uint32_t)roi->y1 : UINT32_MAX, 0 };
+                pngle_t *pngle = pngleTake();
+                pngle_set_user_data(pngle, &ctx);
+                pngle_set_init_callback(pngle, pngle_init_cb);
+                pngle_set_draw_callback(pngle, pngle_draw_cb);
+                int n = 0;
+                while (have > 0) {
+                    n = pngle_feed(pngle, chunk, have);
+                    if (n < 0)
+                        break;
+                    // pngle may leave a partial PNG chunk for the next feed
+                    have -= n;
+                    memmove(chunk, chunk + n, have);
+                    if (ctx.rows >= ctx.stop_row)
+                        break;
+                    int got = readBlob(r, chunk + have, BLOB_CHUNK - have);
+                    if (got < 0) {
+                        n = -1;
+                        break;
+                    }
+                    if ((got == 0) && (n == 0))
+                        break;
+                    have += got;
+                }
+                bool complete = (r->pos == r->size) && (have == 0);
+                if ((n < 0) || (ctx.tile == NULL) || (!complete && (ctx.rows < ctx.stop_row))) {
+                    LOG_ERROR("%s: decode failed: decoded %d out of %u: %s",
+                              keyStr(key.key).c_str(), r->pos - have, r->size, pngle_error(pngle));
+                    freeTile(ctx.tile);
+                    locinfo->status = LS_PNG_DECODE_ERROR;
+                } else {
+                    pngle_ihdr_t *hdr = pngle_get_ihdr(pngle);
+                    if (hdr->compression) {
+                        freeTile(ctx.tile);
+                        locinfo->status = LS_PNG_COMPRESSED;
+                        LOG_ERROR("%s: compressed PNG tile",
+                                  keyStr(key.key).c_str());
+                    } else {
+                        tile = ctx.tile;
+                        if (ctx.rows < tile->height)
+                            tile->y1 = ctx.rows;
+                        locinfo->status = LS_VALID;
+                    }
+                }
+                pngleGive(pngle);
+            }
+            break;
+        case ENC_WEBP: {
+                int width, height, x0, y0, w, h;
+                VP8StatusCode sc;
+                WebPDecoderConfig config;
+                WebPIDecoder *idec;
+                size_t bufsize, bpp;
+                uint8_t *buffer;
+
+                // the bitstream header is in the first chunk
+                WebPInitDecoderConfig(&config);
+                sc = WebPGetFeatures(chunk, have, &config.input);
+                if (sc != VP8_STATUS_OK) {
+                    LOG_ERROR("%s: WebPGetFeatures failed sc=%d", keyStr(key.key).c_str(), sc);
+                    locinfo->status = LS_WEBP_DECODE_ERROR;
+                    break;
+                }
+                if (config.input.format != 2) {
+                    LOG_ERROR("%s: lossy WEBP compression", keyStr(key.key).c_str());
+                    locinfo->status = LS_WEBP_COMPRESSED;
+                    break;
+                }
+                LOG_DEBUG("webp w %d h %d alpha %d animate %d format %d",
+                          config.input.width, config.input.height,config.input.has_alpha,
+                          config.input.has_animation, config.input.format);
+
+                // decode into a scratch RGB(A) image, then convert to elevations
+                // with a roi, let the decoder crop to it
+                x0 = y0 = 0;
+                w = width = config.input.width;
+                h = height = config.input.height;
+                if (roi != NULL) {
+                    x0 = std::max(roi->x0, 0);
+                    y0 = std::max(roi->y0, 0);
+                    w = std::min(roi->x1, width) - x0;
+                    h = std::min(roi->y1, height) - y0;
+                }
+                bpp = config.input.has_alpha ? 4 : 3;
+                bufsize = w * h * bpp;
+                tile = newTile(width, height);
+                buffer = scratchTake(bufsize);
+                if ((tile != NULL) && (buffer != NULL) && (w > 0) && (h > 0)) {
+                    if ((w < width) || (h < height)) {
+                        config.options.use_cropping = 1;
+                        config.options.crop_left = x0;
+                        config.options.crop_top = y0;
+                        config.options.crop_width = w;
+                        config.options.crop_height = h;
+                    }
+                    config.output.colorspace = (bpp == 4) ? MODE_RGBA : MODE_RGB;
+                    config.output.is_external_memory = 1;
+                    config.output.u.RGBA.rgba = buffer;
+                    config.output.u.RGBA.stride = w * bpp;
+                    config.output.u.RGBA.size = bufsize;
+                    idec = WebPIDecode(NULL, 0, &config);
+                    sc = (idec != NULL) ? WebPIAppend(idec, chunk, have) : VP8_STATUS_OUT_OF_MEMORY;
+                    while (sc == VP8_STATUS_SUSPENDED) {
+                        have = readBlob(r, chunk, BLOB_CHUNK);
+                        if (have <= 0)
+                            break;
+                        sc = WebPIAppend(idec, chunk, have);
+                    }
+                    WebPIDelete(idec);
+                    if (sc != VP8_STATUS_OK) {
+                        LOG_ERROR("%s: WebPDecode failed sc=%d", keyStr(key.key).c_str(), sc);
+                        freeTile(tile);
+                        tile = NULL;
+                        locinfo->status = LS_WEBP_DECODE_ERROR;
+                    } else {
+                        storeImage(tile, buffer, bpp, x0, y0, w, h);
+                        locinfo->status = LS_VALID;
+                    }
+                    WebPFreeDecBuffer(&config.output);
+                } else {
+                    freeTile(tile);
+                    tile = NULL;
+                }
+                scratchGive(buffer, bufsize);
+            }
+            break;
+        case ENC_DPK:
+            tile = dpkDecode(key, r, chunk, have, roi);
+            locinfo->status = (tile != NULL) ? LS_VALID : LS_DPK_DECODE_ERROR;
+            break;
+        default:
+            locinfo->status = LS_UNKNOWN_IMAGE_FORMAT;
+            break;
+    }
+    if ((tile != NULL) && !tilePartial(tile))
+        tile = tileUniform(tile, hash, r, chunk);
+    return tile;
+}
+
+// rowids of tiles seen before, so a tile decoded again skips the index lookup
+static cache::fixed_lru_cache<uint64_t, int64_t> rowids(ROWID_CACHE_MAX, -1);
+static std::mutex rowid_lock;
+
+static bool tileRowid(dbConn_t *c, xyz_t key, int64_t *rowid) {
+    {
+        std::lock_guard<std::mutex> guard(rowid_lock);
+        *rowid = rowids.get(key.key);
+        if (*rowid >= 0)
+            return true;
+    }
+    sqlite3_stmt *stmt = c->rowid_stmt;
+    sqlite3_bind_int(stmt, 1, key.entry.z);
+    sqlite3_bind_int(stmt, 2, key.entry.x);
+    sqlite3_bind_int(stmt, 3, key.entry.y);
+    bool found = (sqlite3_step(stmt) == SQLITE_ROW);
+    if (found) {
+        *rowid = sqlite3_column_int64(stmt, 0);
+        std::lock_guard<std::mutex> guard(rowid_lock);
+        rowids.put(key.key, *rowid);
+    }
+    sqlite3_reset(stmt);
+    return found;
+}
+
+// the tile keeps its blob for the blob cache, unless decoding again costs nothing
+static tile_t *keepBlob(tile_t *tile, blob_t *blob) {
+    if ((tile == NULL) || tile->uniform)
+        blobFree(blob);
+    else
+        tile->blob = blob;
+    return tile;
+}
+
+// fetch and decode the tile for key through connection c, all of it or around roi
+// a blob in the blob cache is decoded from there. Otherwise, if tiles is a table,
+// the blob is streamed from the database into the decoder, else (a view over
+// deduplicated images) SQLite materializes it first. With the blob cache on,
+// the chunks streamed are copied to a blob kept with the tile.
+// time to locate the blob is added to *fetch_us, reading and decoding to *decode_us
+static tile_t *fetchTile(demInfo_t *di, dbConn_t *c, xyz_t key, locInfo_t *locinfo,
+                         uint64_t *fetch_us, uint64_t *decode_us, const roi_t *roi = NULL) {
+    tile_t *tile = NULL;
+    int64_t start;
+
+    locinfo->status = LS_TILE_NOT_FOUND;
+    STARTTIME(start);
+    blob_t *kept = blobTake(key.key);
+    if (kept != NULL) {
+        blobReader_t r = { NULL, kept->data, (int)kept->size, 0, NULL };
+        *fetch_us += LAPTIME(start);
+        STARTTIME(start);
+        tile = decodeTile(key, &r, c->chunk, locinfo, roi);
+        *decode_us += LAPTIME(start);
+        return keepBlob(tile, kept);
+    }
+    if (di->tile_blobs && (c->rowid_stmt != NULL)) {
+        int64_t rowid;
+        sqlite3_blob *blob = NULL;
+        if (!tileRowid(c, key, &rowid))
+            return NULL;
+        int rc = sqlite3_blob_open(c->db, "main", "tiles", "tile_data", rowid, 0, &blob);
+        if (rc != SQLITE_OK) {
+            LOG_ERROR("%s: blob open failed rc=%d %s", keyStr(key.key).c_str(), rc, sqlite3_errmsg(c->db));
+            sqlite3_blob_close(blob);
+            locinfo->status = LS_DB_ERROR;
+            return NULL;
+        }
+        blobReader_t r = { blob, NULL, sqlite3_blob_bytes(blob), 0, NULL };
+        STAT_ADD(di, bytes_read, r.size);
+        kept = blobNew(r.size);
+        if (kept != NULL)
+            r.copy = kept->data;
+        *fetch_us += LAPTIME(start);
+        STARTTIME(start);
+        tile = decodeTile(key, &r, c->chunk, locinfo, roi);
+        *decode_us += LAPTIME(start);
+        sqlite3_blob_close(blob);
+        // a partial decode stopped reading early: nothing whole to keep
+        if ((kept != NULL) && (r.pos < r.size)) {
+            blobFree(kept);
+            kept = NULL;
+        }
+        return keepBlob(tile, kept);
+    }
+
+    sqlite3_stmt *stmt = c->tile_stmt;
+    sqlite3_bind_int(stmt, 1, key.entry.z);
+    sqlite3_bind_int(stmt, 2, key.entry.x);
+    sqlite3_bind_int(stmt, 3, key.entry.y);
+
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        blobReader_t r = { NULL, (const uint8_t *)sqlite3_column_blob(stmt, 0),
+                           sqlite3_column_bytes(stmt, 0), 0, NULL
+                         };
+        STAT_ADD(di, bytes_read, r.size);
+        kept = blobNew(r.size);
+        if (kept != NULL)
+            memcpy(kept->data, r.data, r.size);
+        *fetch_us += LAPTIME(start);
+        STARTTIME(start);
+        tile = decodeTile(key, &r, c->chunk, locinfo, roi);
+        *decode_us += LAPTIME(start);
+        tile = keepBlob(tile, kept);
+    }
+    // drops the blob and the read transaction
+    sqlite3_reset(stmt);
+    return tile;
+}
+
+// lookups read through di->conn, or through a pool connection while another
+// thread has it. The loader worker and the threads of a batch lookup use the pool.
+static std::mutex pool_lock;
+static std::condition_variable pool_free;
+
+// open a connection of di on first use, under pool_lock; the first one
+// also finds out whether tile blobs can be streamed
+static int connOpen(demInfo_t *di, dbConn_t *c) {
+    int rc = sqlite3_open_v2(di->path, &c->db, SQLITE_OPEN_READONLY, NULL);
+    if (rc == SQLITE_OK) {
+        if (!di->opened) {
+            di->tile_blobs = tilesIsTable(c->db);
+            di->opened = true;
+        }
+        rc = connPrepare(di, c);
+    }
+    if (rc != SQLITE_OK) {
+        LOG_ERROR("can't open database %s: rc=%d %s", di->path, rc, sqlite3_errmsg(c->db));
+        di->db_errors++;
+        connClose(c);
+    }
+    return rc;
+}
+
+// a free pool connection of di, opened on first use; NULL if it can't be opened
+static dbConn_t *poolAcquire(demInfo_t *di) {
+    std::unique_lock<std::mutex> guard(pool_lock);
+    bool waited = false;
+
+    while (true) {
+        for (int i = 0; i < DBPOOL_SIZE; i++) {
+            dbConn_t *c = &di->pool[i];
+            if (c->busy)
+                continue;
+            if (c->db == NULL) {
+                if (connOpen(di, c) != SQLITE_OK)
+                    return NULL;
+                di->pool_opens++;
+            }
+            c->busy = true;
+            di->pool_waits += waited;
+            return c;
+        }
+        pool_free.wait(guard);
+        waited = true;
+    }
+}
+
+// the lookup connection of di if it is free, else a pool connection
+// the first lookup of a DEM opens its database
+static dbConn_t *connAcquire(demInfo_t *di) {
+    {
+        std::lock_guard<std::mutex> guard(pool_lock);
+        if (!di->conn.busy) {
+            if ((di->conn.db == NULL) && (connOpen(di, &di->conn) != SQLITE_OK))
+                return NULL;
+            di->conn.busy = true;
+            return &di->conn;
+        }
+    }
+    return poolAcquire(di);
+}
+
+static void connRelease(dbConn_t *c) {
+    std::lock_guard<std::mutex> guard(pool_lock);
+    c->busy = false;
+    pool_free.notify_one();
+}
+
+// an open raw container: the index is mapped with the file, or read into PSRAM
+typedef struct rawDem {
+    int fd;
+    rawHeader_t header;
+    uint64_t file_bytes;
+    const rawIndex_t *index;    // NULL until opened
+    const uint8_t *map;         // all of the file, RAWDEM_MMAP only
+} rawDem_t;
+
+// a raw container at path: 1 with di->raw set, 0 if the file is something
+// else, -1 if it is a raw container which can't be used
+static int rawProbe(const char *path, const struct stat &st, demInfo_t *di) {
+    rawHeader_t h;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if ((pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)) || memcmp(h.magic, RAWDEM_MAGIC, sizeof(h.magic))) {
+        close(fd);
+        return 0;
+    }
+    uint64_t index_end = sizeof(h) + (uint64_t)h.columns * h.rows * sizeof(rawIndex_t);
+    if ((h.version != RAWDEM_VERSION) || (h.codec != RAW_CODEC_NONE) || (h.tile_size == 0) ||
+            (index_end > (uint64_t)st.st_size)) {
+        LOG_ERROR("%s: unusable raw DEM, version %u codec %u", path, h.version, h.codec);
+        close(fd);
+        return -1;
+    }
+    rawDem_t *rd = new rawDem_t();
+    rd->fd = fd;
+    rd->header = h;
+    rd->file_bytes = st.st_size;
+    di->raw = rd;
+    di->bbox = h.bbox;
+    di->min_zoom = di->max_zoom = h.zoom;
+    di->tile_size = h.tile_size;
+    di->bbox_source = BBOX_HEADER;
+    return 1;
+}
+
+// map the container or read its index on first use, under pool_lock
+static bool rawOpen(demInfo_t *di) {
+    rawDem_t *rd = di->raw;
+    if (di->opened)
+        return rd->index != NULL;
+    di->opened = true;
+#if RAWDEM_MMAP
+    void *map = mmap(NULL, rd->file_bytes, PROT_READ, MAP_SHARED, rd->fd, 0);
+    if (map != MAP_FAILED) {
+        rd->map = (const uint8_t *)map;
+        rd->index = (const rawIndex_t *)(rd->map + sizeof(rawHeader_t));
+    }
+#else
+    size_t bytes = (size_t)rd->header.columns * rd->header.rows * sizeof(rawIndex_t);
+    rawIndex_t *index = (rawIndex_t *)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    if ((index != NULL) && (pread(rd->fd, index, bytes, sizeof(rawHeader_t)) == (ssize_t)bytes))
+        rd->index = index;
+    else
+        heap_caps_free(index);
+#endif
+    if (rd->index == NULL) {
+        LOG_ERROR("%s: can't open raw DEM: %s", di->path, strerror(errno));
+        di->db_errors++;
+    }
+    return rd->index != NULL;
+}
+
+// the tile for key from a raw container: mapped, or read with one pread()
+// time taken is added to *fetch_us, there is nothing to decode
+static tile_t *rawFetch(demInfo_t *di, xyz_t key, locInfo_t *locinfo, uint64_t *fetch_us) {
+    rawDem_t *rd = di->raw;
+    const rawHeader_t &h = rd->header;
+    tile_t *tile;
+    int64_t start;
+
+    {
+        std::lock_guard<std::mutex> guard(pool_lock);
+        if (!rawOpen(di)) {
+            locinfo->status = LS_DB_ERROR;
+            return NULL;
+        }
+    }
+    locinfo->status = LS_TILE_NOT_FOUND;
+    int64_t col = (int64_t)key.entry.x - h.x0, row = (int64_t)key.entry.y - h.y0;
+    if ((key.entry.z != h.zoom) || (col < 0) || (row < 0) || (col >= h.columns) || (row >= h.rows))
+        return NULL;
+    const rawIndex_t &e = rd->index[row * h.columns + col];
+    if (!(e.flags & RAW_PRESENT))
+        return NULL;
+    if (e.flags & RAW_UNIFORM) {
+        tile = newUniformTile(h.tile_size, h.tile_size, e.base, e.min, e.max, e.value);
+    } else {
+        size_t bytes = (size_t)h.tile_size * h.tile_size * sizeof(int16_t);
+        if ((e.bytes != bytes) || (e.offset % RAWDEM_ALIGN) || (e.offset + bytes > rd->file_bytes)) {
+            LOG_ERROR("%s: bad raw tile", keyStr(key.key).c_str());
+            locinfo->status = LS_DB_ERROR;
+            return NULL;
+        }
+        STARTTIME(start);
+#if RAWDEM_MMAP
+        tile = newTileHeader(h.tile_size, h.tile_size, e.base, e.min, e.max);
+        if (tile != NULL)
+            tile->buffer = (int16_t *)(rd->map + e.offset);
+#else
+        tile = newTile(h.tile_size, h.tile_size);
+        if ((tile != NULL) && (pread(rd->fd, tile->buffer, bytes, e.offset) != (ssize_t)bytes)) {
+            LOG_ERROR("%s: raw tile read failed: %s", keyStr(key.key).c_str(), strerror(errno));
+            freeTile(tile);
+            locinfo->status = LS_DB_ERROR;
+            return NULL;
+        }
+        if (tile != NULL) {
+            tile->base = e.base;
+            tile->min = e.min;
+            tile->max = e.max;
+        }
+#endif
+        *fetch_us += LAPTIME(start);
+        if (tile != NULL)
+            STAT_ADD(di, bytes_read, bytes);
+    }
+    if (tile != NULL)
+        locinfo->status = LS_VALID;
+    return tile;
+}
+
+// fetch and decode the tile for key: from a raw container, or through the
+// lookup connection of di if free, else a pool connection; only the pool with pool set
+static tile_t *loadTile(demInfo_t *di, xyz_t key, locInfo_t *locinfo, uint64_t *fetch_us, uint64_t *decode_us,
+                        bool pool, const roi_t *roi = NULL) {
+    uint64_t fetched = 0, decoded = 0;
+    tile_t *tile;
+
+    if (di->raw != NULL) {
+        // mapped tiles take well under the microseconds fetched counts in
+        STAT_START(start);
+        tile = rawFetch(di, key, locinfo, &fetched);
+        STAT_STAGE(di, STAGE_FETCH, start);
+    } else {
+        dbConn_t *c = pool ? poolAcquire(di) : connAcquire(di);
+        if (c == NULL) {
+            locinfo->status = LS_DB_ERROR;
+            return NULL;
+        }
+        tile = fetchTile(di, c, key, locinfo, &fetched, &decoded, roi);
+        connRelease(c);
+        STAT_US(di, STAGE_FETCH, fetched);
+        STAT_US(di, STAGE_DECODE, decoded);
+        if (tile != NULL)
+            STAT_ADD(di, bytes_decoded, (tile->uniform ? 1 : (tile->x1 - tile->x0) * (tile->y1 - tile->y0)) *
+                     sizeof(int16_t));
+    }
+    *fetch_us += fetched;
+    *decode_us += decoded;
+    if ((tile != NULL) && !tileSizeOk(di, tile)) {
+        LOG_ERROR("%s: tile is %ux%u, the DEM's are %u", keyStr(key.key).c_str(), tile->width, tile->height,
+                  di->tile_size);
+        freeTile(tile);
+        locinfo->status = LS_DB_ERROR;
+        return NULL;
+    }
+    return tile;
+}
+
+// write the elevations of tile at the 16 byte aligned end of f, noting where in e
+static bool rawWriteTile(FILE *f, const tile_t *tile, rawIndex_t &e) {
+    static const uint8_t pad[RAWDEM_ALIGN] = {};
+    long pos = ftell(f);
+    size_t fill = (RAWDEM_ALIGN - pos % RAWDEM_ALIGN) % RAWDEM_ALIGN;
+    size_t n = (size_t)tile->width * tile->height;
+
+    if ((pos < 0) || (fwrite(pad, 1, fill, f) != fill) || (fwrite(tile->buffer, sizeof(int16_t), n, f) != n))
+        return false;
+    e.offset = pos + fill;
+    e.bytes = n * sizeof(int16_t);
+    return true;
+}
+
+int convertDEM(const char *mbtiles, const char *raw) {
+    demInfo_t *di = new demInfo_t();
+    sqlite3_stmt *stmt = nullptr;
+    rawHeader_t h = {};
+    int rc, failed = 0;
+
+    di->path = mbtiles;
+    rc = sqlite3_open_v2(mbtiles, &di->conn.db, SQLITE_OPEN_READONLY, NULL);
+    if (rc == SQLITE_OK)
+        rc = getBBox(di->conn.db, di);
+    if (rc == SQLITE_OK) {
+        di->tile_blobs = tilesIsTable(di->conn.db);
+        rc = connPrepare(di, &di->conn);
+    }
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(di->conn.db, bboxQuery, -1, &stmt, nullptr);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, di->max_zoom);
+        rc = (sqlite3_step(stmt) == SQLITE_ROW) ? SQLITE_OK : SQLITE_ERROR;
+        h.x0 = sqlite3_column_int(stmt, 0);
+        h.columns = sqlite3_column_int(stmt, 1) - h.x0 + 1;
+        h.y0 = sqlite3_column_int(stmt, 2);
+        h.rows = sqlite3_column_int(stmt, 3) - h.y0 + 1;
+    }
+    sqlite3_finalize(stmt);
+    FILE *f = (rc == SQLITE_OK) ? fopen(raw, "wb") : NULL;
+    if (f == NULL) {
+        LOG_ERROR("can't convert %s to %s: rc=%d %s", mbtiles, raw, rc, sqlite3_errmsg(di->conn.db));
+        connClose(&di->conn);
+        delete di;
+        return (rc != SQLITE_OK) ? rc : SQLITE_CANTOPEN;
+    }
+    memcpy(h.magic, RAWDEM_MAGIC, sizeof(h.magic));
+    h.version = RAWDEM_VERSION;
+    h.zoom = di->max_zoom;
+    h.codec = RAW_CODEC_NONE;
+    h.bbox = di->bbox;
+    std::vector<rawIndex_t> index((size_t)h.columns * h.rows);
+    // header and index go in last, once the offsets are known
+    bool ok = (fwrite(&h, sizeof(h), 1, f) == 1) &&
+              (fwrite(index.data(), sizeof(rawIndex_t), index.size(), f) == index.size());
+    for (uint32_t row = 0; ok && (row < h.rows); row++) {
+        for (uint32_t col = 0; ok && (col < h.columns); col++) {
+            xyz_t key = makeKey(di, h.x0 + col, h.y0 + row);
+            locInfo_t li = {};
+            uint64_t fetch_us = 0, decode_us = 0;
+            tile_t *tile = fetchTile(di, &di->conn, key, &li, &fetch_us, &decode_us);
+            if (tile == NULL) {
+                failed += (li.status != LS_TILE_NOT_FOUND);
+                continue;
+            }
+            if (h.tile_size == 0)
+                h.tile_size = tile->width;
+            rawIndex_t &e = index[row * h.columns + col];
+            e.base = tile->base;
+            e.min = tile->min;
+            e.max = tile->max;
+            if ((tile->width != h.tile_size) || (tile->height != h.tile_size)) {
+                LOG_ERROR("%s: tile size %ux%u, not %u", keyStr(key.key).c_str(), tile->width, tile->height,
+                          h.tile_size);
+                failed++;
+            } else if (tile->uniform) {
+                e.flags = RAW_PRESENT | RAW_UNIFORM;
+                e.value = tile->buffer[0];
+            } else {
+                e.flags = RAW_PRESENT;
+                ok = rawWriteTile(f, tile, e);
+            }
+            tileRelease(tile);
+        }
+    }
+    ok = ok && (fseek(f, 0, SEEK_SET) == 0) && (fwrite(&h, sizeof(h), 1, f) == 1) &&
+         (fwrite(index.data(), sizeof(rawIndex_t), index.size(), f) == index.size());
+    ok = (fclose(f) == 0) && ok;
+    connClose(&di->conn);
+    delete di;
+    if (!ok) {
+        LOG_ERROR("writing %s failed: %s", raw, strerror(errno));
+        remove(raw);
+        return SQLITE_IOERR;
+    }
+    if (failed > 0)
+        LOG_ERROR("%s: %d tiles could not be converted", mbtiles, failed);
+    return SQLITE_OK;
+}
+
+// encode the elevations of a complete tile as DPK
+static void dpkEncode(const tile_t *tile, std::vector<uint8_t> &out) {
+    dpkHeader_t h = {};
+    uint32_t w = tile->width;
+    size_t n = (size_t)w * tile->height;
+    std::vector<int32_t> dm(n);
+    uint32_t residual[DPK_BLOCK];
+    uint32_t zeros = 0;
+
+    memcpy(h.magic, dpkSignature, sizeof(h.magic));
+    h.version = DPK_VERSION;
+    h.predictor = DPK_PREDICT_GRADIENT;
+    h.width = tile->width;
+    h.height = tile->height;
+    h.min = tile->min;
+    h.max = tile->max;
+    out.assign((const uint8_t *)&h, (const uint8_t *)&h + sizeof(h));
+    for (size_t i = 0; i < n; i++) {
+        int16_t v = tilePixel(tile, i % w, i / w);
+        dm[i] = (v == ELEV_NODATA) ? DPK_NODATA : tile->base + v;
+    }
+    for (size_t i = 0; i < n; i += DPK_BLOCK) {
+        size_t m = std::min<size_t>(DPK_BLOCK, n - i);
+        uint32_t any = 0;
+        for (size_t k = 0; k < m; k++) {
+            uint32_t c = (i + k) % w, r = (i + k) / w;
+            const int32_t *row = dm.data() + (size_t)r * w;
+            residual[k] = zigzag(dm[i + k] - dpkPredict(row, (r > 0) ? row - w : row, c, r));
+            any |= residual[k];
+        }
+        uint32_t bits = any ? 32 - __builtin_clz(any) : 0;
+        uint64_t acc = 0;
+        uint32_t nacc = 0;
+        if (bits == 0) {
+            zeros++;
+            continue;
+        }
+        for (; zeros > 0; zeros -= std::min<uint32_t>(zeros, DPK_ZEROS))
+            out.push_back(DPK_ZEROS | (std::min<uint32_t>(zeros, DPK_ZEROS) - 1));
+        out.push_back(bits);
+        for (size_t k = 0; k < m; k++) {
+            acc |= (uint64_t)residual[k] << nacc;
+            nacc += bits;
+            for (; nacc >= 8; nacc -= 8, acc >>= 8)
+                out.push_back(acc & 0xff);
+        }
+        if (nacc > 0)
+            out.push_back(acc & 0xff);
+    }
+    for (; zeros > 0; zeros -= std::min<uint32_t>(zeros, DPK_ZEROS))
+        out.push_back(DPK_ZEROS | (std::min<uint32_t>(zeros, DPK_ZEROS) - 1));
+}
+
+// a and b hold the same elevations, whatever their base
+static bool sameElevations(const tile_t *a, const tile_t *b) {
+    if ((a->width != b->width) || (a->height != b->height) || tilePartial(a) || tilePartial(b))
+        return false;
+    for (uint32_t r = 0; r < a->height; r++) {
+        for (uint32_t c = 0; c < a->width; c++) {
+            int16_t va = tilePixel(a, c, r), vb = tilePixel(b, c, r);
+            if ((va == ELEV_NODATA) != (vb == ELEV_NODATA))
+                return false;
+            if ((va != ELEV_NODATA) && (a->base + va != b->base + vb))
+                return false;
+        }
+    }
+    return true;
+}
+
+int transcodeDEM(const char *src, const char *dst) {
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = nullptr, *update = nullptr;
+    std::vector<int64_t> ids;
+    std::vector<uint8_t> out;
+    size_t bytes_in = 0, bytes_out = 0;
+    int rc, failed = 0, mismatches = 0;
+    xyz_t key = {};
+
+    // copy the archive, then replace its tile blobs
+    remove(dst);
+    rc = sqlite3_open_v2(src, &db, SQLITE_OPEN_READONLY, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, "VACUUM INTO ?", -1, &stmt, nullptr);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, dst, -1, SQLITE_STATIC);
+        rc = (sqlite3_step(stmt) == SQLITE_DONE) ? SQLITE_OK : sqlite3_errcode(db);
+    }
+    if (rc != SQLITE_OK)
+        LOG_ERROR("can't copy %s to %s: rc=%d %s", src, dst, rc, sqlite3_errmsg(db));
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    db = NULL;
+    if (rc != SQLITE_OK)
+        return rc;
+
+    rc = sqlite3_open_v2(dst, &db, SQLITE_OPEN_READWRITE, NULL);
+    // deduplicated archives keep the blobs in images, tiles is a view
+    std::string table = ((rc == SQLITE_OK) && tilesIsTable(db)) ? "tiles" : "images";
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, string_format("SELECT rowid FROM %s", table.c_str()).c_str(), -1, &stmt, nullptr);
+    if (rc == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+            ids.push_back(sqlite3_column_int64(stmt, 0));
+        sqlite3_finalize(stmt);
+        rc = sqlite3_prepare_v2(db, string_format("SELECT tile_data FROM %s WHERE rowid = ?", table.c_str()).c_str(),
+                                -1, &stmt, nullptr);
+    }
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, string_format("UPDATE %s SET tile_data = ? WHERE rowid = ?", table.c_str()).c_str(),
+                                -1, &update, nullptr);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+    uint8_t *chunk = (uint8_t *)heap_caps_malloc(BLOB_CHUNK, MALLOC_CAP_8BIT);
+    if ((rc != SQLITE_OK) || (chunk == NULL)) {
+        LOG_ERROR("can't transcode %s: rc=%d %s", dst, rc, sqlite3_errmsg(db));
+        heap_caps_free(chunk);
+        sqlite3_finalize(stmt);
+        sqlite3_finalize(update);
+        sqlite3_close(db);
+        remove(dst);
+        return (rc != SQLITE_OK) ? rc : SQLITE_NOMEM;
+    }
+    for (int64_t id: ids) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_int64(stmt, 1, id);
+        if (sqlite3_step(stmt) != SQLITE_ROW) {
+            failed++;
+            continue;
+        }
+        blobReader_t r = { NULL, (const uint8_t *)sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0), 0, NULL };
+        locInfo_t li = {};
+        tile_t *tile = decodeTile(key, &r, chunk, &li, NULL);
+        if (tile == NULL) {
+            failed++;
+            continue;
+        }
+        dpkEncode(tile, out);
+        // a tile goes in only if it decodes to what the original did
+        blobReader_t check = { NULL, out.data(), (int)out.size(), 0, NULL };
+        tile_t *decoded = decodeTile(key, &check, chunk, &li, NULL);
+        if ((decoded == NULL) || !sameElevations(tile, decoded)) {
+            LOG_ERROR("%s: tile rowid %lld does not decode to the same elevations", dst, (long long)id);
+            mismatches++;
+        } else {
+            bytes_in += r.size;
+            bytes_out += out.size();
+            sqlite3_reset(update);
+            sqlite3_bind_blob(update, 1, out.data(), out.size(), SQLITE_STATIC);
+            sqlite3_bind_int64(update, 2, id);
+            if (sqlite3_step(update) != SQLITE_DONE)
+                rc = sqlite3_errcode(db);
+        }
+        tileRelease(tile);
+        if (decoded != NULL)
+            tileRelease(decoded);
+        if (rc != SQLITE_OK)
+            break;
+    }
+    heap_caps_free(chunk);
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(update);
+    // archives without metadata are recognized by the tile signature alone
+    if ((rc == SQLITE_OK) &&
+        (sqlite3_exec(db, "UPDATE metadata SET value = 'dpk' WHERE name = 'format'", NULL, NULL, NULL) == SQLITE_OK) &&
+        (sqlite3_changes(db) == 0))
+        sqlite3_exec(db, "INSERT INTO metadata (name, value) VALUES ('format', 'dpk')", NULL, NULL, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, "VACUUM", NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        LOG_ERROR("transcoding %s failed: rc=%d %s", dst, rc, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        remove(dst);
+        return rc;
+    }
+    sqlite3_close(db);
+    LOG_INFO("%s: %u tiles, %u bytes as %u bytes of DPK, %d not decoded, %d kept for a mismatch",
+             dst, (uint32_t)ids.size(), (uint32_t)bytes_in, (uint32_t)bytes_out, failed, mismatches);
+    if (failed + mismatches > 0)
+        LOG_ERROR("%s: %d tiles could not be transcoded", src, failed + mismatches);
+    return (mismatches > 0) ? SQLITE_MISMATCH : SQLITE_OK;
+}
+
+// the range of the pixels c0..c1-1, r0..r1-1 of a complete tile
+static elevRange_t tileRange(const tile_t *tile, uint32_t c0, uint32_t r0, uint32_t c1, uint32_t r1) {
+    elevRange_t e = { INT32_MAX, INT32_MIN };
+    for (uint32_t r = r0; r < r1; r++) {
+        for (uint32_t c = c0; c < c1; c++) {
+            int16_t v = tilePixel(tile, c, r);
+            if (v == ELEV_NODATA)
+                continue;
+            e.min = std::min(e.min, tile->base + v);
+            e.max = std::max(e.max, tile->base + v);
+        }
+    }
+    return e;
+}
+
+int summarizeDEM(const char *mbtiles) {
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = nullptr, *insert = nullptr;
+    std::vector<elevRange_t> blocks;
+    int rc, zoom = -1, tiles = 0, failed = 0;
+
+    rc = sqlite3_open_v2(mbtiles, &db, SQLITE_OPEN_READWRITE, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, "SELECT max(zoom_level) FROM tiles", -1, &stmt, nullptr);
+    if ((rc == SQLITE_OK) && (sqlite3_step(stmt) == SQLITE_ROW))
+        zoom = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    stmt = nullptr;
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, summaryCreate, NULL, NULL, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, "BEGIN; DELETE FROM elevation_summary", NULL, NULL, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, "SELECT tile_column, tile_row, tile_data FROM tiles WHERE zoom_level = ?",
+                                -1, &stmt, nullptr);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, "INSERT INTO elevation_summary VALUES (?, ?, ?, ?, ?, ?)", -1, &insert, nullptr);
+    uint8_t *chunk = (uint8_t *)heap_caps_malloc(BLOB_CHUNK, MALLOC_CAP_8BIT);
+    if ((rc != SQLITE_OK) || (chunk == NULL)) {
+        LOG_ERROR("can't summarize %s: rc=%d %s", mbtiles, rc, sqlite3_errmsg(db));
+        heap_caps_free(chunk);
+        sqlite3_finalize(stmt);
+        sqlite3_finalize(insert);
+        sqlite3_close(db);
+        return (rc != SQLITE_OK) ? rc : SQLITE_NOMEM;
+    }
+    sqlite3_bind_int(stmt, 1, zoom);
+    while ((rc == SQLITE_OK) && (sqlite3_step(stmt) == SQLITE_ROW)) {
+        xyz_t key = {};
+        key.entry.z = zoom;
+        key.entry.x = sqlite3_column_int(stmt, 0);
+        key.entry.y = sqlite3_column_int(stmt, 1);
+        blobReader_t r = { NULL, (const uint8_t *)sqlite3_column_blob(stmt, 2), sqlite3_column_bytes(stmt, 2), 0, NULL };
+        locInfo_t li = {};
+        tile_t *tile = decodeTile(key, &r, chunk, &li, NULL);
+        if (tile == NULL) {
+            failed++;
+            continue;
+        }
+        blocks.clear();
+        for (uint32_t r0 = 0; r0 < tile->height; r0 += SUMMARY_BLOCK) {
+            for (uint32_t c0 = 0; c0 < tile->width; c0 += SUMMARY_BLOCK) {
+                blocks.push_back(tileRange(tile, c0, r0, std::min<uint32_t>(c0 + SUMMARY_BLOCK, tile->width),
+                                           std::min<uint32_t>(r0 + SUMMARY_BLOCK, tile->height)));
+            }
+        }
+        sqlite3_reset(insert);
+        sqlite3_bind_int(insert, 1, zoom);
+        sqlite3_bind_int(insert, 2, key.entry.x);
+        sqlite3_bind_int(insert, 3, key.entry.y);
+        sqlite3_bind_int(insert, 4, tile->min);
+        sqlite3_bind_int(insert, 5, tile->max);
+        sqlite3_bind_blob(insert, 6, blocks.data(), blocks.size() * sizeof(elevRange_t), SQLITE_STATIC);
+        if (sqlite3_step(insert) != SQLITE_DONE)
+            rc = sqlite3_errcode(db);
+        tileRelease(tile);
+        tiles++;
+    }
+    heap_caps_free(chunk);
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(insert);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    else
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        LOG_ERROR("summarizing %s failed: rc=%d %s", mbtiles, rc, sqlite3_errmsg(db));
+    else
+        LOG_INFO("%s: %d tiles at zoom %d summarized, %d not decoded", mbtiles, tiles, zoom, failed);
+    sqlite3_close(db);
+    return rc;
+}
+
+// note the range of a complete tile for area queries
+static void summaryNote(demInfo_t *di, uint64_t key, const tile_t *tile) {
+    xyz_t k;
+    k.key = key;
+    if (tilePartial(tile) || (k.entry.z != di->max_zoom))
+        return;
+    std::lock_guard<std::mutex> guard(di->summary->lock);
+    di->summary->tiles[key] = { tile->min, tile->max };
+}
+
+// remember a tile which is not in the DEM or failed to decode, so it is not tried again
+static void tileAbsent(demInfo_t *di, xyz_t key, locStatus_t status) {
+    if (status != LS_TILE_NOT_FOUND)
+        di->tile_errors++;
+    std::lock_guard<std::mutex> guard(absent_lock);
+    absent.put(key.key, status);
+}
+
+// a tile remembered as absent, with the reason in *status
+static bool tileIsAbsent(uint64_t key, locStatus_t *status = NULL) {
+    std::lock_guard<std::mutex> guard(absent_lock);
+    locStatus_t st = absent.peek(key);
+    if (st == LS_VALID)
+        return false;
+    if (status != NULL)
+        *status = st;
+    return true;
+}
+
+// a tile loaded off the foreground: by the loader worker or the threads of a batch lookup
+typedef struct {
+    demInfo_t *di;
+    xyz_t key;
+    tile_t *tile;           // NULL if the tile could not be loaded
+    locStatus_t status;
+    bool prefetch;
+    bool upgrade;           // replaces a partially decoded tile
+    uint64_t fetch_us;
+    uint64_t decode_us;
+} load_t;
+
+// enter a tile loaded off the foreground into the cache, or remember it as absent
+// with acquire, return the tile cached for the key with a reference, else NULL
+static tile_t *storeLoad(load_t &p, bool acquire = false) {
+    if (p.prefetch) {
+        p.di->prefetch_us += p.fetch_us + p.decode_us;
+    } else {
+        p.di->cache_misses += !p.upgrade;
+        p.di->fetch_us += p.fetch_us;
+        p.di->decode_us += p.decode_us;
+    }
+    p.di->fetches++;
+    if (p.tile == NULL) {
+        tileAbsent(p.di, p.key, p.status);
+        return NULL;
+    }
+    tileShard_t &shard = shardOf(p.key.key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    tile_t *cached = shard.cache.peek(p.key.key);
+    if ((cached != NULL) && !tilePartial(cached)) {
+        // a lookup got there first
+        tileRelease(p.tile);
+        if (p.prefetch)
+            p.di->prefetch_wasted++;
+    } else {
+        if (cached != NULL) {
+            shard.cache.remove(p.key.key);
+            p.di->partial_upgrades++;
+        }
+        p.tile->prefetched = p.prefetch && !acquire;
+        if (!shardPut(shard, p.key.key, p.tile)) {
+            tileRelease(p.tile);
+            return NULL;
+        }
+        summaryNote(p.di, p.key.key, p.tile);
+        STAT_TILE(p.di, p.tile, 1);
+        cached = p.tile;
+        p.di->uniform_tiles += p.tile->uniform;
+        if (p.tile->prefetched) {
+            prefetch_unused++;
+            p.di->prefetch_loads++;
+        }
+    }
+    if (!acquire)
+        return NULL;
+    cached->refs++;
+    return cached;
+}
+
+// fully decoded in the cache
+static bool tileCached(uint64_t key) {
+    tileShard_t &shard = shardOf(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    tile_t *tile = shard.cache.peek(key);
+    return (tile != NULL) && !tilePartial(tile);
+}
+
+// a lookup is loading key, under loading_lock
+static bool isLoading(uint64_t key) {
+    return std::find(loading.begin(), loading.end(), key) != loading.end();
+}
+
+// a lookup is done loading key: wake the lookups waiting for it
+static void loadingDone(uint64_t key) {
+    std::lock_guard<std::mutex> guard(loading_lock);
+    auto it = std::find(loading.begin(), loading.end(), key);
+    if (it != loading.end()) {
+        *it = loading.back();
+        loading.pop_back();
+    }
+    loading_done.notify_all();
+}
+
+static void loaderUpgrade(demInfo_t *di, xyz_t key);
+
+// return the decoded tile for key from the cache, fetching and decoding it on a miss
+// with a reference for the caller, dropped with tileRelease()
+// roi is the window of pixels the caller reads, NULL for all of the tile
+// on failure, return NULL with the reason in locinfo->status
+// a tile missed by several lookups at once is loaded by the first, the others wait for it
+static tile_t *getTile(demInfo_t *di, xyz_t key, locInfo_t *locinfo, const roi_t *roi = NULL) {
+    tileShard_t &shard = shardOf(key.key);
+    tile_t *tile;
+    bool waited = false;
+    STAT_START(start);
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            tile = shard.cache.get(key.key);
+            if ((tile != NULL) && !tileCovers(tile, roi)) {
+                // partially decoded and the caller needs more: decode all of it
+                LOG_DEBUG("cache entry %s partial", keyStr(key.key).c_str());
+                di->partial_upgrades++;
+                shard.cache.remove(key.key);
+                roi = NULL;
+                tile = NULL;
+            }
+            if (tile != NULL) {
+                LOG_DEBUG("cache entry %s found: ", keyStr(key.key).c_str());
+                tile->refs++;
+                if (tile->prefetched) {
+                    tile->prefetched = false;
+                    prefetch_unused--;
+                    di->prefetch_hits++;
+                }
+                locinfo->status = LS_VALID;
+                di->cache_hits++;
+                STAT_STAGE(di, STAGE_CACHE, start);
+                return tile;
+            }
+        }
+        std::unique_lock<std::mutex> guard(loading_lock);
+        if (!isLoading(key.key)) {
+            loading.push_back(key.key);
+            break;
+        }
+        // another lookup is loading it
+        if (!waited)
+            di->coalesced++;
+        waited = true;
+        while (isLoading(key.key))
+            loading_done.wait(guard);
+    }
+
+    LOG_DEBUG("cache entry %s not found", keyStr(key.key).c_str());
+    di->cache_misses++;
+    if (tileIsAbsent(key.key, &locinfo->status)) {
+        loadingDone(key.key);
+        return NULL;
+    }
+    roi_t window;
+    if (di->partial_decode && (roi != NULL)) {
+        window = { roi->x0 - PARTIAL_MARGIN, roi->y0 - PARTIAL_MARGIN,
+                   roi->x1 + PARTIAL_MARGIN, roi->y1 + PARTIAL_MARGIN
+                 };
+        roi = &window;
+    } else {
+        roi = NULL;
+    }
+    uint64_t fetch_us = 0, decode_us = 0;
+    di->fetches++;
+    tile = loadTile(di, key, locinfo, &fetch_us, &decode_us, false, roi);
+    di->fetch_us += fetch_us;
+    di->decode_us += decode_us;
+    if (tile != NULL) {
+        // one reference for the cache, one for the caller
+        tile->refs++;
+        bool cached;
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            cached = shardPut(shard, key.key, tile);
+        }
+        di->uniform_tiles += tile->uniform;
+        summaryNote(di, key.key, tile);
+        if (cached)
+            STAT_TILE(di, tile, 1);
+        if (!cached) {
+            LOG_ERROR("%s: can't cache tile", keyStr(key.key).c_str());
+            tileRelease(tile);
+        }
+        if (tilePartial(tile)) {
+            di->partial_decodes++;
+            loaderUpgrade(di, key);
+        }
+    } else {
+        tileAbsent(di, key, locinfo->status);
+    }
+    loadingDone(key.key);
+    return tile;
+}
+
+// a cache snapshot: a header, then per tile a record and its pixels, one
+// of them for a uniform tile. Written for and by the same build, so structs
+// go as they are; a file from another build fails the version or the hashes.
+#define SNAPSHOT_VERSION 1
+
+typedef struct {
+    char magic[4];      // "DEMS"
+    uint32_t version;
+    int64_t size;       // of the archive
+    int64_t mtime;
+    uint32_t tiles;
+} snapshotHeader_t;
+
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint16_t z;
+    uint16_t width;
+    uint16_t height;
+    uint16_t uniform;
+    int32_t base;
+    int32_t min;
+    int32_t max;
+    uint64_t hash;      // of the pixels
+} snapshotTile_t;
+
+static std::string snapshotPath(const char *path) {
+    return std::string(path) + DEM_SNAPSHOT;
+}
+
+static inline size_t tilePixels(const tile_t *tile) {
+    return tile->uniform ? 1 : (size_t)tile->width * tile->height;
+}
+
+// write the tiles of di to its snapshot, through a temporary file so a
+// power cut while writing leaves the previous snapshot. FAT does not rename
+// onto an existing file: on the ESP32 the previous one goes first, a cut
+// right then loses it and the next boot decodes
+static bool snapshotWrite(demInfo_t *di, const std::vector<std::pair<uint64_t, tile_t *>> &tiles) {
+    struct stat st;
+    if (stat(di->path, &st) != 0)
+        return false;
+    snapshotHeader_t h = { { 'D', 'E', 'M', 'S' }, SNAPSHOT_VERSION, (int64_t)st.st_size, (int64_t)st.st_mtime, 0 };
+    for (auto &t: tiles) {
+        xyz_t k;
+        k.key = t.first;
+        h.tiles += (k.entry.index == di->index);
+    }
+    std::string path = snapshotPath(di->path), tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == NULL) {
+        LOG_ERROR("%s: can't write snapshot: %s", di->path, strerror(errno));
+        return false;
+    }
+    bool ok = (fwrite(&h, sizeof(h), 1, f) == 1);
+    for (auto &t: tiles) {
+        xyz_t k;
+        k.key = t.first;
+        const tile_t *tile = t.second;
+        if (!ok || (k.entry.index != di->index))
+            continue;
+        size_t n = tilePixels(tile);
+        snapshotTile_t r = { k.entry.x, k.entry.y, k.entry.z, tile->width, tile->height, tile->uniform,
+                             tile->base, tile->min, tile->max,
+                             blobHash((const uint8_t *)tile->buffer, n * sizeof(int16_t))
+                           };
+        ok = (fwrite(&r, sizeof(r), 1, f) == 1) && (fwrite(tile->buffer, sizeof(int16_t), n, f) == n);
+    }
+    ok = (fclose(f) == 0) && ok;
+#ifdef ARDUINO
+    if (ok)
+        remove(path.c_str());
+#endif
+    if (ok)
+        ok = (rename(tmp.c_str(), path.c_str()) == 0);
+    if (!ok) {
+        LOG_ERROR("%s: writing snapshot failed: %s", di->path, strerror(errno));
+        remove(tmp.c_str());
+    }
+    return ok;
+}
+
+int saveCacheSnapshot(void) {
+    std::vector<std::pair<uint64_t, tile_t *>> tiles;
+    bool ok = true;
+
+    if (!*DEM_SNAPSHOT)
+        return 0;
+    // hold the tiles, not the shard locks, while writing
+    for (size_t i = 0; i < nshards; i++) {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        shards[i].cache.for_each([&tiles](uint64_t key, tile_t *tile) {
+            xyz_t k;
+            k.key = key;
+            demInfo_t *di = demByIndex(k.entry.index);
+            if (!tilePartial(tile) && (di != NULL) && (di->raw == NULL)) {
+                tile->refs++;
+                tiles.push_back({ key, tile });
+            }
+        });
+    }
+    // raw containers load as fast as a snapshot
+    for (auto d: dems) {
+        if (d->raw == NULL)
+            ok = snapshotWrite(d, tiles) && ok;
+    }
+    for (auto &t: tiles)
+        tileRelease(t.second);
+    return ok ? (int)tiles.size() : -1;
+}
+
+int loadCacheSnapshot(demInfo_t *di) {
+    struct stat st;
+    snapshotHeader_t h;
+    int loaded = 0;
+
+    if (!*DEM_SNAPSHOT || (di->raw != NULL) || (stat(di->path, &st) != 0))
+        return 0;
+    FILE *f = fopen(snapshotPath(di->path).c_str(), "rb");
+    if (f == NULL)
+        return 0;
+    if ((fread(&h, sizeof(h), 1, f) != 1) || memcmp(h.magic, "DEMS", 4) || (h.version != SNAPSHOT_VERSION) ||
+            (h.size != (int64_t)st.st_size) || (h.mtime != (int64_t)st.st_mtime)) {
+        LOG_DEBUG("%s: stale snapshot", di->path);
+        fclose(f);
+        return 0;
+    }
+    // no more than fit: the cache would evict the ones loaded first
+    for (uint32_t i = 0; (i < h.tiles) && ((size_t)loaded < cache_size); i++) {
+        snapshotTile_t r;
+        if ((fread(&r, sizeof(r), 1, f) != 1) || (r.width != di->tile_size) ||
+                (r.height != di->tile_size))
+            break;
+        tile_t *tile = r.uniform ? newUniformTile(r.width, r.height, r.base, r.min, r.max, 0)
+                       : newTile(r.width, r.height);
+        if (tile == NULL)
+            break;
+        size_t n = tilePixels(tile);
+        if ((fread(tile->buffer, sizeof(int16_t), n, f) != n) ||
+                (blobHash((const uint8_t *)tile->buffer, n * sizeof(int16_t)) != r.hash)) {
+            LOG_ERROR("%s: snapshot corrupt at tile %u", di->path, i);
+            freeTile(tile);
+            break;
+        }
+        tile->base = r.base;
+        tile->min = r.min;
+        tile->max = r.max;
+        xyz_t key;
+        key.entry.index = di->index;
+        key.entry.x = r.x;
+        key.entry.y = r.y;
+        key.entry.z = r.z;
+        tileShard_t &shard = shardOf(key.key);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        if (!shardPut(shard, key.key, tile)) {
+            tileRelease(tile);
+            break;
+        }
+        summaryNote(di, key.key, tile);
+        STAT_TILE(di, tile, 1);
+        di->uniform_tiles += tile->uniform;
+        loaded++;
+    }
+    fclose(f);
+    di->snapshot_tiles += loaded;
+    LOG_DEBUG("%s: %d tiles from the snapshot", di->path, loaded);
+    return loaded;
+}
+
+// offsets just short of the right or bottom edge round to the next tile
+static inline size_t nearestPixel(double offset, size_t size) {
+    size_t p = lround(offset);
+    return (p < size) ? p : size - 1;
+}
+
+static void tileElevation(demInfo_t *, const tile_t *tile, double offset_x, double offset_y,
+                          locInfo_t *locinfo) {
+    size_t x = nearestPixel(offset_x, tile->width);
+    size_t y = nearestPixel(offset_y, tile->height);
+
+    int16_t v = tilePixel(tile, x, y);
+    if (v == ELEV_NODATA) {
+        locinfo->elevation = 0.0;
+        locinfo->status = LS_NODATA;
+    } else {
+        locinfo->elevation = (tile->base + v) / 10.0;
+        locinfo->status = LS_VALID;
+    }
+}
+
+static interp_t interpMode(demInfo_t *di, interp_t interp) {
+    if (interp == INTERP_DEFAULT)
+        interp = di->interpolation;
+    return (interp == INTERP_DEFAULT) ? INTERP_NEAREST : interp;
+}
+
+static xyz_t neighbourKey(xyz_t key, int dx, int dy) {
+    key.entry.x += dx;
+    key.entry.y += dy;
+    return key;
+}
+
+// offsets of the tiles a window with tap 0 at tile pixel col/row reaches into,
+// the sample's own tile included: 1, 2 or 4 tiles
+static int windowTiles(demInfo_t *di, int32_t col, int32_t row, int8_t *dx, int8_t *dy) {
+    int x0 = (col < 0) ? -1 : 0;
+    int x1 = (col + INTERP_WINDOW > di->tile_size) ? 1 : 0;
+    int y0 = (row < 0) ? -1 : 0;
+    int y1 = (row + INTERP_WINDOW > di->tile_size) ? 1 : 0;
+    int n = 0;
+
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            dx[n] = x;
+            dy[n] = y;
+            n++;
+        }
+    }
+    return n;
+}
+
+// copy the taps of window i which fall into tile, dx/dy tiles away from the sample's tile
+static void gatherTaps(const tile_t *tile, int dx, int dy, int32_t col, int32_t row,
+                       window_t *win, size_t i) {
+    int32_t c0 = col - dx * tile->width;
+    int32_t r0 = row - dy * tile->height;
+
+    for (int k = 0; k < INTERP_TAPS; k++) {
+        int32_t c = c0 + k % INTERP_WINDOW;
+        int32_t r = r0 + k / INTERP_WINDOW;
+        if ((c < 0) || (c >= tile->width) || (r < 0) || (r >= tile->height))
+            continue;
+        int16_t v = tilePixel(tile, c, r);
+        if (v != ELEV_NODATA) {
+            win->v[k * win->stride + i] = (tile->base + v) / 10.0f;
+            win->m[k * win->stride + i] = 1.0f;
+        }
+    }
+}
+
+// the pixels of the tile dx/dy tiles away from the sample's one a window
+// with tap 0 at col/row reads
+static roi_t windowRoi(demInfo_t *di, int dx, int dy, int32_t col, int32_t row) {
+    int32_t c0 = col - dx * di->tile_size;
+    int32_t r0 = row - dy * di->tile_size;
+    roi_t roi = { std::max(c0, 0), std::max(r0, 0),
+                  std::min(c0 + INTERP_WINDOW, (int32_t)di->tile_size),
+                  std::min(r0 + INTERP_WINDOW, (int32_t)di->tile_size)
+                };
+    return roi;
+}
+
+static void windowElevation(float value, float weight, locInfo_t *locinfo) {
+    if (weight > 0.0f) {
+        locinfo->elevation = value;
+        locinfo->status = LS_VALID;
+    } else {
+        locinfo->elevation = 0.0;
+        locinfo->status = LS_NODATA;
+    }
+}
+
+// the tile key of a DEM with lower zooms is missing: the elevation at
+// offset_x/y in it from the finest of them which has the point, from the
+// cache only if cached, interpolated within that tile. False if none has
+static bool lookupCoarser(demInfo_t *di, xyz_t key, double offset_x, double offset_y, interp_t interp,
+                          locInfo_t *locinfo, bool cached) {
+    for (int z = key.entry.z - 1; z >= di->min_zoom; z--) {
+        double ox = offset_x, oy = offset_y;
+        xyz_t k = zoomKey(di, key, z, ox, oy);
+        if (cached && !tileCached(k.key))
+            continue;
+        float v[INTERP_TAPS] = {}, m[INTERP_TAPS] = {};
+        float fx, fy, value, weight;
+        window_t win = { v, m, &fx, &fy, 1 };
+        int32_t col = nearestPixel(ox, di->tile_size), row = nearestPixel(oy, di->tile_size);
+        roi_t roi = { col, row, col + 1, row + 1 };
+        if (interp != INTERP_NEAREST) {
+            windowOrigin(ox, oy, col, row, fx, fy);
+            roi = windowRoi(di, 0, 0, col, row);
+        }
+        locInfo_t li = {};
+        tile_t *tile = getTile(di, k, &li, &roi);
+        if (tile == NULL)
+            continue;
+        if (interp == INTERP_NEAREST) {
+            tileElevation(di, tile, ox, oy, locinfo);
+        } else {
+            gatherTaps(tile, 0, 0, col, row, &win, 0);
+            interpolate(interp, &win, 1, &value, &weight);
+            windowElevation(value, weight, locinfo);
+        }
+        tileRelease(tile);
+        locinfo->zoom = z;
+        return true;
+    }
+    return false;
+}
+
+// the finest lower zoom tile lookupCoarser() may read for the missing tile
+// key, not known to be absent; false if there is none
+static bool coarserKey(demInfo_t *di, xyz_t &key, double &offset_x, double &offset_y) {
+    for (int z = key.entry.z - 1; z >= di->min_zoom; z--) {
+        double ox = offset_x, oy = offset_y;
+        xyz_t k = zoomKey(di, key, z, ox, oy);
+        if (!tileIsAbsent(k.key)) {
+            key = k;
+            offset_x = ox;
+            offset_y = oy;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool lookupTile(demInfo_t *di, locInfo_t *locinfo, double lat, double lon, interp_t interp) {
+    double offset_x, offset_y;
+    STAT_START(start);
+    xyz_t key = tileKey(di, lat, lon, offset_x, offset_y);
+    STAT_STAGE(di, STAGE_PROJECT, start);
+
+    interp = interpMode(di, interp);
+    if (interp == INTERP_NEAREST) {
+        int32_t x = nearestPixel(offset_x, di->tile_size);
+        int32_t y = nearestPixel(offset_y, di->tile_size);
+        roi_t roi = { x, y, x + 1, y + 1 };
+        tile_t *tile = getTile(di, key, locinfo, &roi);
+        if (tile == NULL) {
+            return (locinfo->status == LS_TILE_NOT_FOUND) &&
+                   lookupCoarser(di, key, offset_x, offset_y, interp, locinfo, false);
+        }
+        tileElevation(di, tile, offset_x, offset_y, locinfo);
+        tileRelease(tile);
+        locinfo->zoom = key.entry.z;
+        return true;
+    }
+
+    float v[INTERP_TAPS] = {}, m[INTERP_TAPS] = {};
+    float fx, fy, value, weight;
+    window_t win = { v, m, &fx, &fy, 1 };
+    int32_t col, row;
+    int8_t dx[4], dy[4];
+
+    windowOrigin(offset_x, offset_y, col, row, fx, fy);
+    roi_t roi = windowRoi(di, 0, 0, col, row);
+    tile_t *tile = getTile(di, key, locinfo, &roi);
+    if (tile == NULL) {
+        return (locinfo->status == LS_TILE_NOT_FOUND) &&
+               lookupCoarser(di, key, offset_x, offset_y, interp, locinfo, false);
+    }
+    // own tile first, then drop it: a cache of one entry must take the neighbours
+    gatherTaps(tile, 0, 0, col, row, &win, 0);
+    tileRelease(tile);
+    int ntiles = windowTiles(di, col, row, dx, dy);
+    for (int t = 0; t < ntiles; t++) {
+        if ((dx[t] == 0) && (dy[t] == 0))
+            continue;
+        locInfo_t li = {};
+        roi = windowRoi(di, dx[t], dy[t], col, row);
+        tile_t *nb = getTile(di, neighbourKey(key, dx[t], dy[t]), &li, &roi);
+        if (nb != NULL) {
+            gatherTaps(nb, dx[t], dy[t], col, row, &win, 0);
+            tileRelease(nb);
+        }
+    }
+    interpolate(interp, &win, 1, &value, &weight);
+    windowElevation(value, weight, locinfo);
+    locinfo->zoom = key.entry.z;
+    return true;
+}
+
+static void loaderCollect(void);
+
+int getLocInfo(double lat, double lon, locInfo_t *locinfo, interp_t interp) {
+    STAT_START(start);
+    const std::vector<demInfo_t *> *candidates = demCandidates(lat, lon);
+    locInfo_t nodata = {};
+
+    loaderCollect();
+    setHere(lat, lon);
+
+    // finest DEM first, falling through to coarser ones on a missing tile or NODATA
+    if (candidates != NULL) {
+        STAT_START(select);
+        for (auto di: *candidates) {
+            if (demContains(di, lat, lon)) {
+                STAT_STAGE(di, STAGE_SELECT, select);
+                LOG_DEBUG("%F %F contained in %s", lat, lon, di->path);
+                if (lookupTile(di, locinfo, lat, lon, interp)) {
+                    if (locinfo->status == LS_VALID) {
+                        STAT_STAGE(di, STAGE_LOOKUP, start);
+                        return SQLITE_OK;
+                    }
+                    nodata = *locinfo;
+                }
+                STAT_RESTART(select);
+            }
+        }
+    }
+    if (nodata.status == LS_NODATA) {
+        *locinfo = nodata;
+    } else {
+        locinfo->status = LS_TILE_NOT_FOUND;
+    }
+    return SQLITE_OK;
+}
+
+typedef struct {
+    size_t index;       // into the caller's arrays
+    double offset_x;
+    double offset_y;
+    int32_t col;        // window origin, interpolated modes only
+    int32_t row;
+} batchPoint_t;
+
+// load p on the lookup connection, or on a pool connection
+static void batchLoad(load_t &p, bool pool) {
+    locInfo_t li = {};
+    p.tile = loadTile(p.di, p.key, &li, &p.fetch_us, &p.decode_us, pool);
+    p.status = li.status;
+}
+
+#ifndef ARDUINO
+// threads helping a batch lookup fetch, DBPOOL_SIZE - 1 of them started on
+// first use and kept, waiting for the next batch. One batch at a time hands
+// them its loads; a batch meanwhile on another thread fetches on its own.
+// Never freed: the threads wait on it until the process exits
+typedef struct {
+    std::mutex owner;               // held by the batch using the helpers
+    std::mutex lock;                // the rest
+    std::condition_variable wakeup;
+    std::condition_variable idle;
+    std::vector<load_t> *loads;     // of the batch, NULL between batches
+    size_t next;                    // load to take next
+    size_t busy;                    // loads taken, not done yet
+    size_t threads;
+} batchPool_t;
+
+static batchPool_t *batch_pool;
+static std::once_flag batch_once;
+
+// the next load of the batch still to do, under batch_pool->lock; NULL if none
+static load_t *batchNext(batchPool_t *bp) {
+    while ((bp->loads != NULL) && (bp->next < bp->loads->size())) {
+        load_t &p = (*bp->loads)[bp->next++];
+        if (p.status != LS_PENDING) {
+            bp->busy++;
+            return &p;
+        }
+    }
+    return NULL;
+}
+
+static void batchWorker(batchPool_t *bp) {
+    std::unique_lock<std::mutex> guard(bp->lock);
+    while (true) {
+        load_t *p = batchNext(bp);
+        if (p == NULL) {
+            bp->wakeup.wait(guard);
+            continue;
+        }
+        guard.unlock();
+        batchLoad(*p, true);
+        guard.lock();
+        if (--bp->busy == 0)
+            bp->idle.notify_all();
+    }
+}
+
+static void batchPoolStart(void) {
+    batch_pool = new batchPool_t();
+    batch_pool->loads = NULL;
+    batch_pool->next = 0;
+    batch_pool->busy = 0;
+    for (batch_pool->threads = 0; batch_pool->threads + 1 < DBPOOL_SIZE; batch_pool->threads++) {
+        std::thread(batchWorker, batch_pool).detach();
+    }
+}
+#endif
+
+// fetch n tiles at once and enter them into the cache: the first on the
+// lookup connection, the others in parallel on the helper threads with a
+// pool connection each. Returns the loads in keys order, each holding its
+// cached tile with a reference, or NULL; a key another lookup is loading or
+// has loaded meanwhile is left to getTile(), with status LS_PENDING
+static void fetchParallel(demInfo_t *di, const uint64_t *keys, size_t n, std::vector<load_t> &loads) {
+    loads.assign(n, {});
+    {
+        std::lock_guard<std::mutex> guard(loading_lock);
+        for (size_t i = 0; i < n; i++) {
+            load_t &p = loads[i];
+            p.di = di;
+            p.key.key = keys[i];
+            if (isLoading(keys[i])) {
+                // getTile() waits for it
+                p.status = LS_PENDING;
+            } else {
+                loading.push_back(keys[i]);
+            }
+        }
+    }
+    // another lookup may have loaded it since the caller looked
+    for (size_t i = 0; i < n; i++) {
+        load_t &p = loads[i];
+        if ((p.status != LS_PENDING) && (tileCached(keys[i]) || tileIsAbsent(keys[i]))) {
+            p.status = LS_PENDING;
+            loadingDone(keys[i]);
+        }
+    }
+    size_t first = 0;
+    while ((first < n) && (loads[first].status == LS_PENDING))
+        first++;
+#ifndef ARDUINO
+    std::call_once(batch_once, batchPoolStart);
+    batchPool_t *bp = batch_pool;
+    std::unique_lock<std::mutex> owner(bp->owner, std::try_to_lock);
+    if (owner.owns_lock() && (bp->threads > 0) && (first < n)) {
+        {
+            std::lock_guard<std::mutex> guard(bp->lock);
+            bp->loads = &loads;
+            bp->next = first + 1;
+        }
+        bp->wakeup.notify_all();
+        batchLoad(loads[first], false);
+        // then help with the rest
+        std::unique_lock<std::mutex> guard(bp->lock);
+        load_t *p;
+        while ((p = batchNext(bp)) != NULL) {
+            guard.unlock();
+            batchLoad(*p, true);
+            guard.lock();
+            bp->busy--;
+        }
+        while (bp->busy > 0)
+            bp->idle.wait(guard);
+        bp->loads = NULL;
+        first = n;
+    }
+#endif
+    for (size_t i = first; i < n; i++) {
+        if (loads[i].status != LS_PENDING)
+            batchLoad(loads[i], i > first);
+    }
+    for (size_t i = 0; i < n; i++) {
+        load_t &p = loads[i];
+        if (p.status == LS_PENDING)
+            continue;
+        p.tile = storeLoad(p, true);
+        loadingDone(p.key.key);
+    }
+}
+
+// one tile read on behalf of a point: its own tile or a neighbour its window reaches into
+typedef struct {
+    uint64_t key;
+    uint32_t point;
+    int8_t dx;
+    int8_t dy;
+} batchRead_t;
+
+int getLocInfoBatch(const double *lat, const double *lon, size_t n, locInfo_t *out, interp_t interp) {
+    std::vector<batchPoint_t> points;
+    std::vector<batchRead_t> reads;
+    std::vector<uint64_t> misses;
+    std::vector<load_t> group;
+    std::vector<uint8_t> found;
+    std::vector<std::vector<size_t>> perdem(dems.size());
+    std::vector<size_t> candidates;
+    std::vector<double> clat, clon;
+    std::vector<int32_t> tile_x, tile_y;
+    std::vector<float> offset_x, offset_y;
+    std::vector<float> taps, fx, fy, value, weight;
+
+    loaderCollect();
+    for (size_t i = 0; i < n; i++) {
+        const std::vector<demInfo_t *> *cands = demCandidates(lat[i], lon[i]);
+        out[i].status = LS_TILE_NOT_FOUND;
+        if (cands == NULL)
+            continue;
+        for (auto di: *cands) {
+            if (demContains(di, lat[i], lon[i]))
+                perdem[di->rank].push_back(i);
+        }
+    }
+    // same DEM order and fall-through as getLocInfo(), but per DEM the tile
+    // reads are bucketed so every tile is fetched and decoded at most once
+    for (auto di: dems) {
+        interp_t mode = interpMode(di, interp);
+        points.clear();
+        reads.clear();
+        candidates.clear();
+        clat.clear();
+        clon.clear();
+        fx.clear();
+        fy.clear();
+        for (auto i: perdem[di->rank]) {
+            if (out[i].status != LS_VALID) {
+                candidates.push_back(i);
+                clat.push_back(lat[i]);
+                clon.push_back(lon[i]);
+            }
+        }
+        if (candidates.empty())
+            continue;
+        size_t nc = candidates.size();
+        tile_x.resize(nc);
+        tile_y.resize(nc);
+        offset_x.resize(nc);
+        offset_y.resize(nc);
+        project_lat_lon_batch(&di->proj, clat.data(), clon.data(), nc,
+                              tile_x.data(), tile_y.data(), offset_x.data(), offset_y.data());
+
+        for (size_t c = 0; c < nc; c++) {
+            batchPoint_t p;
+            batchRead_t r;
+            xyz_t key = makeKey(di, tile_x[c], tile_y[c]);
+            p.offset_x = offset_x[c];
+            p.offset_y = offset_y[c];
+            p.index = candidates[c];
+            r.key = key.key;
+            r.point = points.size();
+            r.dx = r.dy = 0;
+            reads.push_back(r);
+            if (mode != INTERP_NEAREST) {
+                int8_t dx[4], dy[4];
+                float x, y;
+                windowOrigin(p.offset_x, p.offset_y, p.col, p.row, x, y);
+                fx.push_back(x);
+                fy.push_back(y);
+                int ntiles = windowTiles(di, p.col, p.row, dx, dy);
+                for (int t = 0; t < ntiles; t++) {
+                    if ((dx[t] == 0) && (dy[t] == 0))
+                        continue;
+                    r.key = neighbourKey(key, dx[t], dy[t]).key;
+                    r.dx = dx[t];
+                    r.dy = dy[t];
+                    reads.push_back(r);
+                }
+            }
+            points.push_back(p);
+        }
+        std::sort(reads.begin(), reads.end(),
+        [](const batchRead_t &a, const batchRead_t &b) {
+            return a.key < b.key;
+        });
+
+        // tiles to fetch, DBPOOL_SIZE at a time in parallel just before their reads
+        misses.clear();
+        for (size_t r = 0; r < reads.size(); r++) {
+            if ((r > 0) && (reads[r].key == reads[r - 1].key))
+                continue;
+            if (!tileCached(reads[r].key) && !tileIsAbsent(reads[r].key))
+                misses.push_back(reads[r].key);
+        }
+
+        size_t np = points.size();
+        found.assign(np, 0);
+        window_t win = {};
+        if (mode != INTERP_NEAREST) {
+            taps.assign(2 * INTERP_TAPS * np, 0.0f);
+            win.v = taps.data();
+            win.m = taps.data() + INTERP_TAPS * np;
+            win.fx = fx.data();
+            win.fy = fy.data();
+            win.stride = np;
+        }
+        size_t i = 0, m = 0, fetched = 0;
+        while (i < reads.size()) {
+            xyz_t key;
+            locInfo_t li = {};
+            tile_t *tile;
+            key.key = reads[i].key;
+            if ((m < misses.size()) && (misses[m] == key.key)) {
+                if (m == fetched) {
+                    size_t count = std::min(misses.size() - m, (size_t)DBPOOL_SIZE);
+                    fetchParallel(di, &misses[m], count, group);
+                    fetched = m + count;
+                }
+                load_t &p = group[m++ + group.size() - fetched];
+                tile = (p.status == LS_PENDING) ? getTile(di, key, &li) : p.tile;
+            } else {
+                tile = getTile(di, key, &li);
+            }
+            for (; (i < reads.size()) && (reads[i].key == key.key); i++) {
+                const batchRead_t &r = reads[i];
+                const batchPoint_t &p = points[r.point];
+                if (tile == NULL)
+                    continue;
+                if ((r.dx == 0) && (r.dy == 0)) {
+                    found[r.point] = 1;
+                    out[p.index].zoom = key.entry.z;
+                }
+                if (mode == INTERP_NEAREST) {
+                    tileElevation(di, tile, p.offset_x, p.offset_y, &out[p.index]);
+                } else {
+                    gatherTaps(tile, r.dx, r.dy, p.col, p.row, &win, r.point);
+                }
+            }
+            if (tile != NULL)
+                tileRelease(tile);
+        }
+        // points whose tile is missing, from the lower zooms one by one
+        for (size_t j = 0; (j < np) && (di->min_zoom < di->max_zoom); j++) {
+            locStatus_t status;
+            xyz_t key = makeKey(di, tile_x[j], tile_y[j]);
+            if (!found[j] && tileIsAbsent(key.key, &status) && (status == LS_TILE_NOT_FOUND))
+                lookupCoarser(di, key, points[j].offset_x, points[j].offset_y, mode, &out[points[j].index], false);
+        }
+        if (mode == INTERP_NEAREST)
+            continue;
+
+        value.resize(np);
+        weight.resize(np);
+        interpolate(mode, &win, np, value.data(), weight.data());
+        for (size_t j = 0; j < np; j++) {
+            if (found[j])
+                windowElevation(value[j], weight[j], &out[points[j].index]);
+        }
+    }
+    return SQLITE_OK;
+}
+
+// distance between two nearby points, the earth flat between them
+static double pathLength(double lat0, double lon0, double lat1, double lon1) {
+    double dn = (lat1 - lat0) * metres_per_degree;
+    double de = (lon1 - lon0) * metres_per_degree * cos(to_radians((lat0 + lat1) / 2));
+    return sqrt(dn * dn + de * de);
+}
+
+// samples every spacing m along a polyline, and its last point
+typedef struct {
+    const double *lat;
+    const double *lon;
+    size_t n;
+    double spacing;
+    size_t seg;             // between points seg and seg + 1
+    double seg_start;       // distance of point seg
+    double seg_length;
+    double next;            // distance of the next sample
+    bool done;
+} pathWalk_t;
+
+static void pathStart(pathWalk_t *w, const double *lat, const double *lon, size_t n, double spacing) {
+    *w = { lat, lon, n, spacing, 0, 0.0, 0.0, 0.0, (n == 0) || !(spacing > 0.0) };
+    if (n > 1)
+        w->seg_length = pathLength(lat[0], lon[0], lat[1], lon[1]);
+}
+
+static bool pathNext(pathWalk_t *w, pathSample_t *sample) {
+    if (w->done)
+        return false;
+    while ((w->seg + 1 < w->n) && (w->next > w->seg_start + w->seg_length)) {
+        w->seg_start += w->seg_length;
+        w->seg++;
+        if (w->seg + 1 < w->n)
+            w->seg_length = pathLength(w->lat[w->seg], w->lon[w->seg], w->lat[w->seg + 1], w->lon[w->seg + 1]);
+    }
+    if (w->seg + 1 >= w->n) {
+        // past the end: the last point
+        sample->lat = w->lat[w->n - 1];
+        sample->lon = w->lon[w->n - 1];
+        sample->distance = w->seg_start;
+        w->done = true;
+        return true;
+    }
+    double t = (w->seg_length > 0.0) ? (w->next - w->seg_start) / w->seg_length : 0.0;
+    sample->lat = w->lat[w->seg] + t * (w->lat[w->seg + 1] - w->lat[w->seg]);
+    sample->lon = w->lon[w->seg] + t * (w->lon[w->seg + 1] - w->lon[w->seg]);
+    sample->distance = w->next;
+    w->next += w->spacing;
+    // a sample on the last point ends the path
+    w->done = (w->seg + 2 == w->n) && (t >= 1.0);
+    return true;
+}
+
+// the tile a path walk reads from while its samples fall into it
+typedef struct {
+    demInfo_t *di;
+    uint64_t key;
+    tile_t *tile;       // NULL: none, or not found
+} pathTile_t;
+
+// look up one sample of a path in the pinned tile, pinning its own tile if it
+// left it. Across a tile edge, without a tile or at NODATA with coarser
+// DEMs to fall through to, the lookup is getLocInfo()'s
+static void pathLookup(pathTile_t *pin, pathSample_t *sample, interp_t interp) {
+    const std::vector<demInfo_t *> *candidates = demCandidates(sample->lat, sample->lon);
+    locInfo_t *locinfo = &sample->locinfo;
+    demInfo_t *di = NULL;
+    bool coarser = false;
+
+    locinfo->status = LS_TILE_NOT_FOUND;
+    if (candidates != NULL) {
+        for (auto d: *candidates) {
+            if (!demContains(d, sample->lat, sample->lon))
+                continue;
+            if (di != NULL) {
+                coarser = true;
+                break;
+            }
+            di = d;
+        }
+    }
+    if (di == NULL)
+        return;
+    double offset_x, offset_y;
+    xyz_t key = tileKey(di, sample->lat, sample->lon, offset_x, offset_y);
+    if ((pin->di != di) || (pin->key != key.key)) {
+        locInfo_t li = {};
+        if (pin->tile != NULL)
+            tileRelease(pin->tile);
+        // all of it: a path crossing a tile reads more than a window of it
+        pin->tile = getTile(di, key, &li);
+        pin->di = di;
+        pin->key = key.key;
+    }
+    bool done = false;
+    interp_t mode = interpMode(di, interp);
+    if (pin->tile == NULL) {
+        done = !coarser && (di->min_zoom == di->max_zoom);
+    } else if (mode == INTERP_NEAREST) {
+        tileElevation(di, pin->tile, offset_x, offset_y, locinfo);
+        locinfo->zoom = key.entry.z;
+        done = true;
+    } else {
+        float v[INTERP_TAPS] = {}, m[INTERP_TAPS] = {};
+        float fx, fy, value, weight;
+        window_t win = { v, m, &fx, &fy, 1 };
+        int32_t col, row;
+        int8_t dx[4], dy[4];
+        windowOrigin(offset_x, offset_y, col, row, fx, fy);
+        if (windowTiles(di, col, row, dx, dy) == 1) {
+            gatherTaps(pin->tile, 0, 0, col, row, &win, 0);
+            interpolate(mode, &win, 1, &value, &weight);
+            windowElevation(value, weight, locinfo);
+            locinfo->zoom = key.entry.z;
+            done = true;
+        }
+    }
+    if (!done || ((locinfo->status != LS_VALID) && coarser))
+        getLocInfo(sample->lat, sample->lon, locinfo, interp);
+}
+
+size_t getProfile(const double *lat, const double *lon, size_t n, double spacing,
+                  pathSample_t *out, size_t max, interp_t interp) {
+    pathWalk_t walk;
+    pathTile_t pin = {};
+    size_t count = 0;
+
+    loaderCollect();
+    pathStart(&walk, lat, lon, n, spacing);
+    while ((count < max) && pathNext(&walk, &out[count])) {
+        pathLookup(&pin, &out[count], interp);
+        count++;
+    }
+    if (pin.tile != NULL)
+        tileRelease(pin.tile);
+    return count;
+}
+
+size_t getProfileBearing(double lat, double lon, float bearing, double distance, double spacing,
+                         pathSample_t *out, size_t max, interp_t interp) {
+    double dn = cos(to_radians(bearing)) / metres_per_degree;
+    double de = sin(to_radians(bearing)) / (metres_per_degree * cos(to_radians(lat)));
+    double plat[2] = { lat, lat + distance * dn };
+    double plon[2] = { lon, lon + distance * de };
+
+    return getProfile(plat, plon, 2, spacing, out, max, interp);
+}
+
+bool getTerrainIntersection(const double *lat, const double *lon, size_t n, double spacing,
+                            double alt0, double alt1, pathSample_t *hit, interp_t interp) {
+    pathWalk_t walk;
+    pathTile_t pin = {};
+    double length = 0.0;
+    bool found = false;
+
+    for (size_t i = 1; i < n; i++) {
+        length += pathLength(lat[i - 1], lon[i - 1], lat[i], lon[i]);
+    }
+    loaderCollect();
+    pathStart(&walk, lat, lon, n, spacing);
+    while (pathNext(&walk, hit)) {
+        pathLookup(&pin, hit, interp);
+        double alt = (length > 0.0) ? alt0 + (alt1 - alt0) * hit->distance / length : alt0;
+        if ((hit->locinfo.status == LS_VALID) && (hit->locinfo.elevation > alt)) {
+            found = true;
+            break;
+        }
+    }
+    if (pin.tile != NULL)
+        tileRelease(pin.tile);
+    return found;
+}
+
+// pin the tile getLocInfo() would read lat/lon from, with the local projection
+// to it and whether other DEMs overlap it
+static void sessionPin(lookupSession_t *s, double lat, double lon) {
+    const std::vector<demInfo_t *> *candidates = demCandidates(lat, lon);
+    demInfo_t *di = NULL;
+    double offset_x, offset_y;
+    locInfo_t li = {};
+
+    if (candidates != NULL) {
+        for (auto d: *candidates) {
+            if (demContains(d, lat, lon)) {
+                di = d;
+                break;
+            }
+        }
+    }
+    xyz_t key = (di != NULL) ? tileKey(di, lat, lon, offset_x, offset_y) : xyz_t{};
+    if ((s->tile != NULL) && (s->di == di) && (s->key == key.key))
+        return;
+    if (s->tile != NULL)
+        tileRelease(s->tile);
+    s->tile = (di != NULL) ? getTile(di, key, &li) : NULL;
+    if (s->tile == NULL)
+        return;
+    s->di = di;
+    s->key = key.key;
+
+    uint32_t z = key.entry.z;
+    double world = (double)di->tile_size * (1 << z);
+    double north = tiley2lat(key.entry.y, z), south = tiley2lat(key.entry.y + 1, z);
+    s->lon0 = tilex2long(key.entry.x, z);
+    s->x_per_deg = world / 360.0;
+    // mercator y is R atanh(sin(lat)), whose derivatives are sec, sec tan
+    // and sec (tan^2 + sec^2): within a tile the cubic is exact to 1e-8 pixels
+    double yc = (key.entry.y + 0.5) * di->tile_size;
+    s->lat0 = to_degrees(atan(sinh(M_PI * (1.0 - 2.0 * yc / world))));
+    double phi = to_radians(s->lat0), sec = 1.0 / cos(phi), tan_phi = tan(phi);
+    double k = -world / (2.0 * M_PI) * (M_PI / 180.0);
+    s->y[0] = di->tile_size / 2.0;
+    s->y[1] = k * sec;
+    s->y[2] = k * sec * tan_phi * (M_PI / 180.0) / 2.0;
+    s->y[3] = k * sec * (tan_phi * tan_phi + sec * sec) * (M_PI / 180.0) * (M_PI / 180.0) / 6.0;
+
+    // DEMs before di are finer, those after coarser
+    bool finer = true;
+    s->shadowed = s->coarser = false;
+    for (auto d: dems) {
+        if (d == di) {
+            finer = false;
+            continue;
+        }
+        if ((d->bbox.tr_lat <= south) || (d->bbox.ll_lat >= north) ||
+                (d->bbox.tr_lon <= s->lon0) || (d->bbox.ll_lon >= s->lon0 + 360.0 / (1 << z)))
+            continue;
+        if (finer)
+            s->shadowed = true;
+        else
+            s->coarser = true;
+    }
+}
+
+// a fix from the pinned tile, false if it takes getLocInfo()
+static bool sessionLookup(lookupSession_t *s, double lat, double lon, locInfo_t *locinfo, interp_t interp) {
+    demInfo_t *di = s->di;
+    tile_t *tile = s->tile;
+
+    if ((tile == NULL) || s->shadowed || !demContains(di, lat, lon))
+        return false;
+    double d = lat - s->lat0;
+    double offset_x = (lon - s->lon0) * s->x_per_deg;
+    double offset_y = s->y[0] + d * (s->y[1] + d * (s->y[2] + d * s->y[3]));
+    if ((offset_x < 0.0) || (offset_x >= di->tile_size) || (offset_y < 0.0) || (offset_y >= di->tile_size))
+        return false;
+
+    interp_t mode = interpMode(di, interp);
+    if (mode == INTERP_NEAREST) {
+        tileElevation(di, tile, offset_x, offset_y, locinfo);
+    } else {
+        float v[INTERP_TAPS] = {}, m[INTERP_TAPS] = {};
+        float fx, fy, value, weight;
+        window_t win = { v, m, &fx, &fy, 1 };
+        int32_t col, row;
+        windowOrigin(offset_x, offset_y, col, row, fx, fy);
+        if ((col < 0) || (row < 0) || (col + INTERP_WINDOW > di->tile_size) || (row + INTERP_WINDOW > di->tile_size))
+            return false;
+        gatherTaps(tile, 0, 0, col, row, &win, 0);
+        interpolate(mode, &win, 1, &value, &weight);
+        windowElevation(value, weight, locinfo);
+    }
+    if ((locinfo->status != LS_VALID) && s->coarser)
+        return false;
+    locinfo->zoom = di->max_zoom;
+    setHere(lat, lon);
+    return true;
+}
+
+int getLocInfo(lookupSession_t *session, double lat, double lon, locInfo_t *locinfo, interp_t interp) {
+    if (sessionLookup(session, lat, lon, locinfo, interp)) {
+        session->fast++;
+        return SQLITE_OK;
+    }
+    session->slow++;
+    int rc = getLocInfo(lat, lon, locinfo, interp);
+    sessionPin(session, lat, lon);
+    return rc;
+}
+
+void closeSession(lookupSession_t *session) {
+    if (session->tile != NULL)
+        tileRelease(session->tile);
+    *session = {};
+}
+
+// read the summary table or raw index of di once
+static void summaryLoad(demInfo_t *di) {
+    demSummary_t *s = di->summary;
+    std::unordered_map<uint64_t, elevRange_t> found;
+    bool table = false;
+
+    {
+        std::lock_guard<std::mutex> guard(s->lock);
+        if (s->loaded)
+            return;
+    }
+    if (di->raw != NULL) {
+        bool ok;
+        {
+            std::lock_guard<std::mutex> guard(pool_lock);
+            ok = rawOpen(di);
+        }
+        const rawHeader_t &h = di->raw->header;
+        for (uint32_t row = 0; ok && (row < h.rows); row++) {
+            for (uint32_t col = 0; col < h.columns; col++) {
+                const rawIndex_t &e = di->raw->index[row * h.columns + col];
+                if (e.flags & RAW_PRESENT)
+                    found[makeKey(di, h.x0 + col, h.y0 + row).key] = { e.min, e.max };
+            }
+        }
+        table = ok;
+    } else {
+        dbConn_t *c = connAcquire(di);
+        sqlite3_stmt *stmt = nullptr;
+        if ((c != NULL) && (sqlite3_prepare_v2(c->db, summaryQuery, -1, &stmt, nullptr) == SQLITE_OK)) {
+            sqlite3_bind_int(stmt, 1, di->max_zoom);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                xyz_t key = makeKey(di, sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1));
+                found[key.key] = { sqlite3_column_int(stmt, 2), sqlite3_column_int(stmt, 3) };
+            }
+            table = true;
+        } else {
+            LOG_DEBUG("%s: no elevation summary", di->path);
+        }
+        sqlite3_finalize(stmt);
+        if (c != NULL)
+            connRelease(c);
+    }
+    std::lock_guard<std::mutex> guard(s->lock);
+    for (auto &f: found) {
+        s->tiles.insert(f);
+    }
+    s->loaded = true;
+    s->complete = table;
+    s->blocks = table && (di->raw == NULL);
+}
+
+// the block ranges of a tile from the summary table, false if not there
+static bool summaryBlocks(demInfo_t *di, xyz_t key, std::vector<elevRange_t> &blocks) {
+    size_t n = (di->tile_size + SUMMARY_BLOCK - 1) / SUMMARY_BLOCK;
+    dbConn_t *c = connAcquire(di);
+    sqlite3_stmt *stmt = nullptr;
+    bool ok = false;
+
+    if ((c != NULL) && (sqlite3_prepare_v2(c->db, blocksQuery, -1, &stmt, nullptr) == SQLITE_OK)) {
+        sqlite3_bind_int(stmt, 1, key.entry.z);
+        sqlite3_bind_int(stmt, 2, key.entry.x);
+        sqlite3_bind_int(stmt, 3, key.entry.y);
+        if ((sqlite3_step(stmt) == SQLITE_ROW) &&
+                ((size_t)sqlite3_column_bytes(stmt, 0) == n * n * sizeof(elevRange_t))) {
+            const elevRange_t *b = (const elevRange_t *)sqlite3_column_blob(stmt, 0);
+            blocks.assign(b, b + n * n);
+            ok = true;
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (c != NULL)
+        connRelease(c);
+    return ok;
+}
+
+// an area query: a bbox, or a circle within it
+typedef struct {
+    bbox_t bbox;
+    bool circle;
+    double lat;
+    double lon;
+    double radius;      // m
+} areaQuery_t;
+
+// the area in world pixels at a DEM's zoom: pixel p covers p..p+1
+typedef struct {
+    double x0;
+    double y0;
+    double x1;
+    double y1;
+    bool circle;
+    double cx;
+    double cy;
+    double r;
+} area_t;
+
+typedef enum {
+    AREA_OUT,
+    AREA_PARTIAL,
+    AREA_IN,
+} areaCover_t;
+
+static area_t areaPixels(demInfo_t *di, const areaQuery_t *q) {
+    area_t a = {};
+    lat_lon_to_pixel(q->bbox.tr_lat, q->bbox.ll_lon, di->max_zoom, di->tile_size, a.x0, a.y0);
+    lat_lon_to_pixel(q->bbox.ll_lat, q->bbox.tr_lon, di->max_zoom, di->tile_size, a.x1, a.y1);
+    a.circle = q->circle;
+    if (a.circle) {
+        // mercator scale grows poleward: the widest extent of the bbox, on the safe side
+        lat_lon_to_pixel(q->lat, q->lon, di->max_zoom, di->tile_size, a.cx, a.cy);
+        a.r = std::max(std::max(a.cy - a.y0, a.y1 - a.cy), a.x1 - a.cx);
+    }
+    return a;
+}
+
+// where the world pixel rectangle x0..x1, y0..y1 lies in the area
+static areaCover_t areaCover(const area_t *a, double x0, double y0, double x1, double y1) {
+    if ((x1 <= a->x0) || (x0 >= a->x1) || (y1 <= a->y0) || (y0 >= a->y1))
+        return AREA_OUT;
+    if (a->circle) {
+        double nx = std::max(std::max(x0 - a->cx, a->cx - x1), 0.0);
+        double ny = std::max(std::max(y0 - a->cy, a->cy - y1), 0.0);
+        if (nx * nx + ny * ny > a->r * a->r)
+            return AREA_OUT;
+        double fx = std::max(fabs(a->cx - x0), fabs(x1 - a->cx));
+        double fy = std::max(fabs(a->cy - y0), fabs(y1 - a->cy));
+        return (fx * fx + fy * fy <= a->r * a->r) ? AREA_IN : AREA_PARTIAL;
+    }
+    return ((x0 >= a->x0) && (x1 <= a->x1) && (y0 >= a->y0) && (y1 <= a->y1)) ? AREA_IN : AREA_PARTIAL;
+}
+
+// raise best to the highest pixel of a decoded tile in the area, a block at a
+// time: whole blocks inside from their range if known, pixel by pixel on the border
+static void areaScanTile(const area_t *a, const tile_t *tile, double tx, double ty,
+                         const std::vector<elevRange_t> *blocks, int32_t &best) {
+    uint32_t nb = (tile->width + SUMMARY_BLOCK - 1) / SUMMARY_BLOCK;
+
+    if ((tile->min > tile->max) || (tile->max <= best))
+        return;
+    for (uint32_t by = 0; by * SUMMARY_BLOCK < tile->height; by++) {
+        for (uint32_t bx = 0; bx < nb; bx++) {
+            uint32_t c0 = bx * SUMMARY_BLOCK, r0 = by * SUMMARY_BLOCK;
+            uint32_t c1 = std::min(c0 + SUMMARY_BLOCK, (uint32_t)tile->width);
+            uint32_t r1 = std::min(r0 + SUMMARY_BLOCK, (uint32_t)tile->height);
+            areaCover_t cover = areaCover(a, tx + c0, ty + r0, tx + c1, ty + r1);
+            if (cover == AREA_OUT)
+                continue;
+            if (blocks != NULL) {
+                const elevRange_t &b = (*blocks)[by * nb + bx];
+                if ((b.min > b.max) || (b.max <= best))
+                    continue;
+                if (cover == AREA_IN) {
+                    best = b.max;
+                    continue;
+                }
+            }
+            for (uint32_t r = r0; r < r1; r++) {
+                for (uint32_t c = c0; c < c1; c++) {
+                    int16_t v = tilePixel(tile, c, r);
+                    if ((v == ELEV_NODATA) || (tile->base + v <= best))
+                        continue;
+                    if ((cover == AREA_IN) || (areaCover(a, tx + c, ty + r, tx + c + 1, ty + r + 1) != AREA_OUT))
+                        best = tile->base + v;
+                }
+            }
+        }
+    }
+}
+
+// the tile key of a DEM with lower zooms is missing: raise best from the finest
+// of them which has it, by every pixel a nearest lookup in key within the area
+// reads there (lookupCoarser()), each around its centre. False if none has
+static bool areaCoarser(demInfo_t *di, const area_t *a, xyz_t key, int32_t &best) {
+    double ts = di->tile_size;
+    double x0 = key.entry.x * ts, y0 = key.entry.y * ts;
+
+    for (int z = key.entry.z - 1; z >= di->min_zoom; z--) {
+        double ox = 0.0, oy = 0.0;
+        xyz_t k = zoomKey(di, key, z, ox, oy);
+        locInfo_t li = {};
+        tile_t *tile = getTile(di, k, &li);
+        if (tile == NULL)
+            continue;
+        double scale = 1 << (key.entry.z - z);
+        double kx = k.entry.x * ts, ky = k.entry.y * ts;
+        int32_t c0 = lround(ox), c1 = std::min<int32_t>(lround(ox + ts / scale), tile->width - 1);
+        int32_t r0 = lround(oy), r1 = std::min<int32_t>(lround(oy + ts / scale), tile->height - 1);
+        for (int32_t r = r0; (tile->min <= tile->max) && (tile->max > best) && (r <= r1); r++) {
+            // the last row and column also take the lookups past their centre
+            double py0 = std::max((ky + r - 0.5) * scale, y0);
+            double py1 = std::min((ky + r + ((r == tile->height - 1) ? 1.0 : 0.5)) * scale, y0 + ts);
+            for (int32_t c = c0; (py0 < py1) && (c <= c1); c++) {
+                int16_t v = tilePixel(tile, c, r);
+                if ((v == ELEV_NODATA) || (tile->base + v <= best))
+                    continue;
+                double px0 = std::max((kx + c - 0.5) * scale, x0);
+                double px1 = std::min((kx + c + ((c == tile->width - 1) ? 1.0 : 0.5)) * scale, x0 + ts);
+                if ((px0 < px1) && (areaCover(a, px0, py0, px1, py1) != AREA_OUT))
+                    best = tile->base + v;
+            }
+        }
+        tileRelease(tile);
+        return true;
+    }
+    return false;
+}
+
+// a tile the area reaches into, but not all of whose summary counts
+typedef struct {
+    xyz_t key;
+    areaCover_t cover;
+    bool known;
+    elevRange_t range;
+} areaTile_t;
+
+// raise best to the highest elevation of di in the area; any tells if there were tiles
+static void areaMaxDEM(demInfo_t *di, const areaQuery_t *q, int32_t &best, bool &any) {
+    demSummary_t *s = di->summary;
+    std::vector<areaTile_t> todo;
+    std::vector<elevRange_t> blocks;
+    bool have_blocks;
+
+    summaryLoad(di);
+    area_t a = areaPixels(di, q);
+    double ts = di->tile_size;
+    double dx0, dy0, dx1, dy1;
+    lat_lon_to_pixel(di->bbox.tr_lat, di->bbox.ll_lon, di->max_zoom, di->tile_size, dx0, dy0);
+    lat_lon_to_pixel(di->bbox.ll_lat, di->bbox.tr_lon, di->max_zoom, di->tile_size, dx1, dy1);
+    int32_t tx0 = floor(std::max(a.x0, dx0) / ts), tx1 = ceil(std::min(a.x1, dx1) / ts);
+    int32_t ty0 = floor(std::max(a.y0, dy0) / ts), ty1 = ceil(std::min(a.y1, dy1) / ts);
+    {
+        // tiles wholly inside count by their range, the others are looked at below
+        std::lock_guard<std::mutex> guard(s->lock);
+        have_blocks = s->blocks;
+        for (int32_t ty = ty0; ty < ty1; ty++) {
+            for (int32_t tx = tx0; tx < tx1; tx++) {
+                areaCover_t cover = areaCover(&a, tx * ts, ty * ts, (tx + 1) * ts, (ty + 1) * ts);
+                if (cover == AREA_OUT)
+                    continue;
+                xyz_t key = makeKey(di, tx, ty);
+                auto it = s->tiles.find(key.key);
+                if (it == s->tiles.end()) {
+                    // not there, or only at lower zooms
+                    if (!s->complete || (di->min_zoom < di->max_zoom))
+                        todo.push_back({ key, cover, false, {} });
+                    continue;
+                }
+                const elevRange_t &r = it->second;
+                any = true;
+                if (r.min > r.max)
+                    continue;
+                if (cover == AREA_IN)
+                    best = std::max(best, r.max);
+                else
+                    todo.push_back({ key, cover, true, r });
+            }
+        }
+    }
+    // unknown tiles first, then the highest: stop at the first which can't raise best
+    std::sort(todo.begin(), todo.end(), [](const areaTile_t &l, const areaTile_t &r) {
+        if (l.known != r.known)
+            return !l.known;
+        return l.range.max > r.range.max;
+    });
+    for (auto &t: todo) {
+        if (t.known && (t.range.max <= best))
+            break;
+        locInfo_t li = {};
+        double tx = t.key.entry.x * ts, ty = t.key.entry.y * ts;
+        bool with_blocks = t.known && have_blocks && summaryBlocks(di, t.key, blocks);
+        if (with_blocks) {
+            // blocks wholly inside may settle it without decoding
+            uint32_t nb = (di->tile_size + SUMMARY_BLOCK - 1) / SUMMARY_BLOCK;
+            bool border = false;
+            for (uint32_t i = 0; i < blocks.size(); i++) {
+                const elevRange_t &b = blocks[i];
+                double bx = tx + (i % nb) * SUMMARY_BLOCK, by = ty + (i / nb) * SUMMARY_BLOCK;
+                areaCover_t cover = areaCover(&a, bx, by, bx + SUMMARY_BLOCK, by + SUMMARY_BLOCK);
+                if ((cover == AREA_OUT) || (b.min > b.max) || (b.max <= best))
+                    continue;
+                if (cover == AREA_IN)
+                    best = b.max;
+                else
+                    border = true;
+            }
+            if (!border)
+                continue;
+        }
+        tile_t *tile = getTile(di, t.key, &li);
+        if (tile == NULL) {
+            if ((li.status == LS_TILE_NOT_FOUND) && areaCoarser(di, &a, t.key, best))
+                any = true;
+            continue;
+        }
+        any = true;
+        if (t.cover == AREA_IN)
+            best = ((tile->min <= tile->max) && (tile->max > best)) ? tile->max : best;
+        else
+            areaScanTile(&a, tile, tx, ty, with_blocks ? &blocks : NULL, best);
+        tileRelease(tile);
+    }
+}
+
+static int areaMax(const areaQuery_t *q, locInfo_t *locinfo) {
+    int32_t best = INT32_MIN;
+    bool any = false;
+
+    loaderCollect();
+    for (auto di: dems) {
+        if ((di->bbox.tr_lat <= q->bbox.ll_lat) || (di->bbox.ll_lat >= q->bbox.tr_lat) ||
+                (di->bbox.tr_lon <= q->bbox.ll_lon) || (di->bbox.ll_lon >= q->bbox.tr_lon))
+            continue;
+        areaMaxDEM(di, q, best, any);
+    }
+    if (best > INT32_MIN) {
+        locinfo->elevation = best / 10.0;
+        locinfo->status = LS_VALID;
+    } else {
+        locinfo->elevation = 0.0;
+        locinfo->status = any ? LS_NODATA : LS_TILE_NOT_FOUND;
+    }
+    return SQLITE_OK;
+}
+
+int getAreaMaxElevation(const bbox_t *bbox, locInfo_t *locinfo) {
+    areaQuery_t q = {};
+    q.bbox = *bbox;
+    return areaMax(&q, locinfo);
+}
+
+int getAreaMaxElevation(double lat, double lon, double radius, locInfo_t *locinfo) {
+    double dlat = radius / metres_per_degree;
+    double edge = std::min(fabs(lat) + dlat, 89.0);
+    double dlon = radius / (metres_per_degree * cos(to_radians(edge)));
+    areaQuery_t q = { { lat - dlat, lon - dlon, lat + dlat, lon + dlon }, true, lat, lon, radius };
+    return areaMax(&q, locinfo);
+}
+
+// like getLocInfo(), but only from tiles in the cache: if the tiles needed
+// are missing, return false with them in missing and status LS_PENDING
+static bool lookupCached(double lat, double lon, interp_t interp, locInfo_t *locinfo,
+                         std::vector<xyz_t> &missing) {
+    const std::vector<demInfo_t *> *candidates = demCandidates(lat, lon);
+    locInfo_t nodata = {};
+
+    missing.clear();
+    if (candidates != NULL) {
+        for (auto di: *candidates) {
+            if (!demContains(di, lat, lon))
+                continue;
+            double offset_x, offset_y;
+            locStatus_t status;
+            xyz_t key = tileKey(di, lat, lon, offset_x, offset_y);
+            if (tileIsAbsent(key.key, &status)) {
+                // the lower zoom lookupTile() reads instead
+                if ((status != LS_TILE_NOT_FOUND) || !coarserKey(di, key, offset_x, offset_y))
+                    continue;
+            }
+            if (!tileCached(key.key))
+                missing.push_back(key);
+            if ((key.entry.z == di->max_zoom) && (interpMode(di, interp) != INTERP_NEAREST)) {
+                int32_t col, row;
+                int8_t dx[4], dy[4];
+                float fx, fy;
+                windowOrigin(offset_x, offset_y, col, row, fx, fy);
+                int ntiles = windowTiles(di, col, row, dx, dy);
+                for (int t = 0; t < ntiles; t++) {
+                    xyz_t nb = neighbourKey(key, dx[t], dy[t]);
+                    if (((dx[t] != 0) || (dy[t] != 0)) && !tileCached(nb.key) &&
+                            !tileIsAbsent(nb.key))
+                        missing.push_back(nb);
+                }
+            }
+            // coarser DEMs only count once this one is decided
+            if (!missing.empty()) {
+                locinfo->status = LS_PENDING;
+                return false;
+            }
+            if (lookupTile(di, locinfo, lat, lon, interp)) {
+                if (locinfo->status == LS_VALID)
+                    return true;
+                nodata = *locinfo;
+            }
+        }
+    }
+    if (nodata.status == LS_NODATA) {
+        *locinfo = nodata;
+    } else {
+        locinfo->status = LS_TILE_NOT_FOUND;
+    }
+    return true;
+}
+
+// the loader worker serves getLocInfoAsync() and the prefetcher. It shares
+// only the queues below with the foreground, under loader_lock; it never
+// touches the tile cache, finished tiles are entered into it by the next
+// lookup in loaderCollect()
+typedef struct {
+    double lat;
+    double lon;
+    interp_t interp;
+    locInfoCb_t cb;
+    void *arg;
+    uint32_t waiting;       // tile loads outstanding
+    locInfo_t locinfo;
+} asyncLookup_t;
+
+static std::mutex loader_lock;
+static std::condition_variable loader_wakeup;
+static std::vector<load_t> load_wanted;       // for lookups, oldest first
+static std::vector<load_t> prefetch_wanted;   // nearest last
+static std::vector<load_t> loader_ready;
+static uint64_t loader_busy;                  // key the worker is loading, 0 if idle
+static bool loader_running;
+static bool loader_stopping;
+#ifndef ARDUINO
+static std::thread loader_thread;
+#endif
+
+// the thread doing non-blocking lookups and prefetch; the rest under async_lock,
+// loaderCollect() may run on any thread doing lookups
+static std::mutex async_lock;
+static bool prefetch_enabled;
+static float prefetch_horizon;
+static std::list<asyncLookup_t> lookups_pending;
+static std::list<asyncLookup_t> lookups_done;
+static std::unordered_map<uint64_t, std::vector<asyncLookup_t *>> loads_inflight;
+
+// the worker reads through the DEM's connection pool
+static void loaderWorker(void) {
+    std::unique_lock<std::mutex> guard(loader_lock);
+
+    while (!loader_stopping) {
+        load_t p;
+        if (!load_wanted.empty()) {
+            p = load_wanted.front();
+            load_wanted.erase(load_wanted.begin());
+        } else if (!prefetch_wanted.empty()) {
+            p = prefetch_wanted.back();
+            prefetch_wanted.pop_back();
+        } else {
+            loader_wakeup.wait(guard);
+            continue;
+        }
+        loader_busy = p.key.key;
+        guard.unlock();
+
+        locInfo_t li = {};
+        p.tile = loadTile(p.di, p.key, &li, &p.fetch_us, &p.decode_us, true);
+        p.status = li.status;
+
+        guard.lock();
+        loader_busy = 0;
+        loader_ready.push_back(p);
+    }
+    loader_running = false;
+    loader_wakeup.notify_all();
+}
+
+#ifdef ARDUINO
+static void loaderTask(void *) {
+    loaderWorker();
+    vTaskDelete(NULL);
+}
+#endif
+
+static int loaderStart(void) {
+    std::lock_guard<std::mutex> guard(loader_lock);
+    if (loader_running)
+        return 0;
+    loader_stopping = false;
+    loader_running = true;
+#ifdef ARDUINO
+    if (xTaskCreatePinnedToCore(loaderTask, "tileloader", LOADER_STACK, NULL,
+                                LOADER_PRIORITY, NULL, LOADER_CORE) != pdPASS) {
+        LOG_ERROR("loader: can't create task");
+        loader_running = false;
+        return -1;
+    }
+#else
+    loader_thread = std::thread(loaderWorker);
+#ifdef SCHED_IDLE
+    // like the low priority task on the ESP32: run when lookups leave the CPU idle
+    sched_param sp = {};
+    pthread_setschedparam(loader_thread.native_handle(), SCHED_IDLE, &sp);
+#endif
+#endif
+    return 0;
+}
+
+// waits for a load in progress to finish
+static void loaderStop(void) {
+    std::unique_lock<std::mutex> guard(loader_lock);
+    if (!loader_running)
+        return;
+    loader_stopping = true;
+    loader_wakeup.notify_all();
+    while (loader_running) {
+        loader_wakeup.wait(guard);
+    }
+    guard.unlock();
+#ifndef ARDUINO
+    loader_thread.join();
+#endif
+    loaderCollect();
+}
+
+// key is being loaded, done or queued for a lookup; under loader_lock
+static bool loadUnderWay(uint64_t key) {
+    bool under_way = (key == loader_busy);
+    for (auto &r: loader_ready) {
+        under_way |= (r.key.key == key);
+    }
+    for (auto &r: load_wanted) {
+        under_way |= (r.key.key == key);
+    }
+    return under_way;
+}
+
+// queue the tiles an asynchronous lookup misses, joining loads already under way
+static void asyncWait(asyncLookup_t *al, const std::vector<xyz_t> &missing) {
+    std::lock_guard<std::mutex> guard(loader_lock);
+
+    al->waiting = missing.size();
+    for (auto key: missing) {
+        demInfo_t *di = demByIndex(key.entry.index);
+        auto it = loads_inflight.find(key.key);
+        if (it != loads_inflight.end()) {
+            it->second.push_back(al);
+            di->coalesced++;
+            continue;
+        }
+        loads_inflight[key.key].push_back(al);
+        // a prefetch of the tile under way or done does as well
+        bool under_way = loadUnderWay(key.key);
+        for (size_t i = 0; i < prefetch_wanted.size(); i++) {
+            if (prefetch_wanted[i].key.key == key.key)
+                prefetch_wanted.erase(prefetch_wanted.begin() + i--);
+        }
+        if (!under_way)
+            load_wanted.push_back({ di, key, NULL, LS_INVALID, false, false, 0, 0 });
+    }
+    loader_wakeup.notify_one();
+}
+
+// a progressive lookup waiting for key of di: an estimate from a lower zoom
+// in the cache, and the tile PROGRESSIVE_LEVELS zooms down queued behind
+// the loads lookups wait for, for the estimates of the lookups around
+static void asyncEstimate(demInfo_t *di, double lat, double lon, interp_t interp, locInfo_t *locinfo) {
+    double offset_x, offset_y;
+    xyz_t key = tileKey(di, lat, lon, offset_x, offset_y);
+
+    if (lookupCoarser(di, key, offset_x, offset_y, interpMode(di, interp), locinfo, true))
+        locinfo->status = (locinfo->status == LS_VALID) ? LS_ESTIMATE : LS_PENDING;
+    int z = std::max((int)di->min_zoom, di->max_zoom - PROGRESSIVE_LEVELS);
+    if (z == di->max_zoom)
+        return;
+    key = zoomKey(di, key, z, offset_x, offset_y);
+    if (tileCached(key.key) || tileIsAbsent(key.key))
+        return;
+    std::lock_guard<std::mutex> guard(loader_lock);
+    if (loads_inflight.count(key.key) || loadUnderWay(key.key))
+        return;
+    load_wanted.push_back({ di, key, NULL, LS_INVALID, false, false, 0, 0 });
+    loader_wakeup.notify_one();
+}
+
+// all tiles waited for are in: done, or wait for the tiles of the next DEM in line
+static void asyncResolve(asyncLookup_t *al) {
+    std::vector<xyz_t> missing;
+
+    if (!lookupCached(al->lat, al->lon, al->interp, &al->locinfo, missing)) {
+        asyncWait(al, missing);
+        return;
+    }
+    for (auto it = lookups_pending.begin(); it != lookups_pending.end(); it++) {
+        if (&*it == al) {
+            lookups_done.splice(lookups_done.end(), lookups_pending, it);
+            break;
+        }
+    }
+}
+
+// move tiles loaded by the worker into the cache and resolve the lookups
+// waiting for them; never waits for the worker, nor for another thread collecting
+static void loaderCollect(void) {
+    std::unique_lock<std::mutex> collecting(async_lock, std::try_to_lock);
+    std::vector<load_t> ready;
+
+    if (!collecting.owns_lock())
+        return;
+    {
+        std::unique_lock<std::mutex> guard(loader_lock, std::try_to_lock);
+        if (!guard.owns_lock() || loader_ready.empty())
+            return;
+        ready.swap(loader_ready);
+    }
+    for (auto &p: ready) {
+        storeLoad(p);
+        // resolve right away, the next tile may evict this one
+        auto it = loads_inflight.find(p.key.key);
+        if (it == loads_inflight.end())
+            continue;
+        std::vector<asyncLookup_t *> waiters;
+        waiters.swap(it->second);
+        loads_inflight.erase(it);
+        for (auto al: waiters) {
+            if (--al->waiting == 0)
+                asyncResolve(al);
+        }
+    }
+}
+
+// have the worker decode all of a partially decoded tile, if it is running
+static void loaderUpgrade(demInfo_t *di, xyz_t key) {
+    std::lock_guard<std::mutex> guard(loader_lock);
+    if (!loader_running || (key.key == loader_busy))
+        return;
+    for (auto &r: load_wanted) {
+        if (r.key.key == key.key)
+            return;
+    }
+    load_wanted.push_back({ di, key, NULL, LS_INVALID, false, true, 0, 0 });
+    loader_wakeup.notify_one();
+}
+
+static int asyncLookup(double lat, double lon, locInfo_t *locinfo, locInfoCb_t cb, void *arg,
+                       interp_t interp, bool progressive) {
+    std::vector<xyz_t> missing;
+
+    loaderCollect();
+    setHere(lat, lon);
+    std::unique_lock<std::mutex> guard(async_lock);
+    if (lookupCached(lat, lon, interp, locinfo, missing))
+        return SQLITE_OK;
+    if (loaderStart() != 0) {
+        // no worker: fall back to a blocking lookup, which collects under async_lock
+        guard.unlock();
+        return getLocInfo(lat, lon, locinfo, interp);
+    }
+    lookups_pending.push_back({ lat, lon, interp, cb, arg, 0, {} });
+    asyncWait(&lookups_pending.back(), missing);
+    if (progressive)
+        asyncEstimate(demByIndex(missing[0].entry.index), lat, lon, interp, locinfo);
+    return SQLITE_OK;
+}
+
+int getLocInfoAsync(double lat, double lon, locInfo_t *locinfo, locInfoCb_t cb, void *arg,
+                    interp_t interp) {
+    return asyncLookup(lat, lon, locinfo, cb, arg, interp, false);
+}
+
+int getLocInfoProgressive(double lat, double lon, locInfo_t *locinfo, locInfoCb_t cb, void *arg,
+                          interp_t interp) {
+    return asyncLookup(lat, lon, locinfo, cb, arg, interp, true);
+}
+
+int pollLocInfo(void) {
+    int n = 0;
+
+    loaderCollect();
+    while (true) {
+        asyncLookup_t al;
+        {
+            std::lock_guard<std::mutex> guard(async_lock);
+            if (lookups_done.empty())
+                break;
+            al = lookups_done.front();
+            lookups_done.pop_front();
+        }
+        // callbacks may look up more
+        if (al.cb != NULL)
+            al.cb(al.lat, al.lon, &al.locinfo, al.arg);
+        n++;
+    }
+    return n;
+}
+
+void asyncStop(void) {
+    prefetch_enabled = false;
+    loaderStop();
+    {
+        std::lock_guard<std::mutex> guard(loader_lock);
+        load_wanted.clear();
+        prefetch_wanted.clear();
+        // not collected: another thread was collecting
+        for (auto &p: loader_ready) {
+            if (p.tile != NULL)
+                tileRelease(p.tile);
+        }
+        loader_ready.clear();
+    }
+    std::lock_guard<std::mutex> guard(async_lock);
+    loads_inflight.clear();
+    lookups_pending.clear();
+}
+
+#ifndef ARDUINO
+// a program leaving main() with the worker running would abort in ~thread;
+// defined after the state asyncStop() uses, so destroyed before it
+static struct loaderJoin_t {
+    ~loaderJoin_t() {
+        asyncStop();
+    }
+} loader_join;
+#endif
+
+int prefetchStart(float horizon_s) {
+    prefetch_horizon = horizon_s;
+    prefetch_enabled = (loaderStart() == 0);
+    return prefetch_enabled ? 0 : -1;
+}
+
+void prefetchStop(void) {
+    prefetch_enabled = false;
+    {
+        std::lock_guard<std::mutex> guard(loader_lock);
+        prefetch_wanted.clear();
+    }
+    // asynchronous lookups still need the worker
+    bool idle;
+    {
+        std::lock_guard<std::mutex> guard(async_lock);
+        idle = lookups_pending.empty();
+    }
+    if (idle)
+        loaderStop();
+}
+
+void prefetchUpdate(double lat, double lon, float track, float speed) {
+    std::vector<load_t> plan;
+    // prefetched tiles not used yet count against the budget, else they evict each other
+    size_t unused = prefetch_unused;
+    size_t limit = (cache_size / 2 > unused) ? cache_size / 2 - unused : 0;
+    double distance = (speed > 0.0f) ? (double)speed * (double)prefetch_horizon : 0.0;
+    double dn = cos((double)track * (M_PI / 180.0)) / metres_per_degree;
+    double de = sin((double)track * (M_PI / 180.0)) / (metres_per_degree * cos(lat * (M_PI / 180.0)));
+
+    // metres to fractions of the world, which is 360 degrees of longitude wide
+    double lead = (speed > 0.0f) ? (double)speed * SPATIAL_HORIZON /
+                  (metres_per_degree * 360.0 * cos(lat * (M_PI / 180.0))) : 0.0;
+    here.lead_x.store((float)(lead * sin((double)track * (M_PI / 180.0))), std::memory_order_relaxed);
+    here.lead_y.store((float)(-lead * cos((double)track * (M_PI / 180.0))), std::memory_order_relaxed);
+    setHere(lat, lon);
+    if (!prefetch_enabled)
+        return;
+    loaderCollect();
+
+    std::lock_guard<std::mutex> collecting(async_lock);
+    // sample the track at half a tile of the DEM found there
+    for (double d = 0.0; (d <= distance) && (plan.size() < limit);) {
+        double plat = lat + d * dn, plon = lon + d * de;
+        const std::vector<demInfo_t *> *candidates = demCandidates(plat, plon);
+        double step = PREFETCH_STEP;
+
+        if (candidates != NULL) {
+            for (auto di: *candidates) {
+                if (!demContains(di, plat, plon))
+                    continue;
+                double offset_x, offset_y;
+                xyz_t key = tileKey(di, plat, plon, offset_x, offset_y);
+                step = resolution(plat, di->max_zoom) * di->tile_size / 2;
+                if (tileCached(key.key) || tileIsAbsent(key.key) || loads_inflight.count(key.key))
+                    break;
+                bool queued = false;
+                for (auto &q: plan) {
+                    queued |= (q.key.key == key.key);
+                }
+                if (!queued)
+                    plan.push_back({ di, key, NULL, LS_INVALID, true, false, 0, 0 });
+                break;
+            }
+        }
+        d += step;
+    }
+    std::reverse(plan.begin(), plan.end());
+
+    std::lock_guard<std::mutex> guard(loader_lock);
+    prefetch_wanted.clear();
+    for (auto &p: plan) {
+        bool loaded = (p.key.key == loader_busy);
+        for (auto &r: loader_ready) {
+            loaded |= (r.key.key == p.key.key);
+        }
+        if (!loaded)
+            prefetch_wanted.push_back(p);
+    }
+    loader_wakeup.notify_one();
 }
 
 std::string string_format(const std::string fmt, ...) {
@@ -2,19 +2,182 @@
 
 #include <sqlite3.h>
 #include <vector>
-#include "lrucache.hpp"
+#include <string>
+#include <atomic>
+#include "fixedcache.hpp"
+#include "interpolate.hpp"
+#include "slippytiles.hpp"
 
 #ifndef TILESIZE
     #define TILESIZE 256
 #endif
 
+// DEM selection grid cell size in degrees
+#ifndef DEMGRID_CELL
+    #define DEMGRID_CELL 1.0
+#endif
+#define DEMGRID_ROWS    ((int32_t)(180.0 / DEMGRID_CELL))
+#define DEMGRID_COLUMNS ((int32_t)(360.0 / DEMGRID_CELL))
+// DEMs over more cells than this are kept in one list instead of the grid
+#ifndef DEMGRID_WIDE
+    #define DEMGRID_WIDE 64
+#endif
+
 #ifndef TILECACHE_SIZE
-    #define TILECACHE_SIZE 5
+    #define TILECACHE_SIZE 8
+#endif
+// the tile cache is split by key into shards, each with its own lock and
+// eviction order, so lookups on several threads hit in parallel
+#ifndef TILECACHE_SHARDS
+    #ifdef ARDUINO
+        #define TILECACHE_SHARDS 2
+    #else
+        #define TILECACHE_SHARDS 4
+    #endif
+#endif
+// tiles of one value throughout - empty, NODATA, a lake - take no slab: the
+// cache holds this many of them on top of TILECACHE_SIZE tiles
+#ifndef TILECACHE_UNIFORM
+    #define TILECACHE_UNIFORM 16
+#endif
+// blobs of uniform tiles remembered, so their copies are not decoded again
+#ifndef UNIFORM_BLOBS
+    #define UNIFORM_BLOBS 8
+#endif
+// a shard holds a bilinear window's tiles at least: small caches have fewer shards
+#ifndef TILECACHE_SHARD_MIN
+    #define TILECACHE_SHARD_MIN 4
+#endif
+// tile cache eviction: cache::lru_policy, clock_policy, twoq_policy or spatial_policy
+// (see src/fixedcache.hpp); bench -T compares them on recorded tracks
+#ifndef TILECACHE_POLICY
+    #define TILECACHE_POLICY cache::lru_policy
+#endif
+// spatial_policy: evict the tiles farthest from the position and from where
+// the track leads within this many seconds
+#ifndef SPATIAL_HORIZON
+    #define SPATIAL_HORIZON 60.0
+#endif
+// and weigh tiles behind the position by this, which pays off on circuits
+// and costs on fields worked in rows (see bench)
+#ifndef SPATIAL_BEHIND
+    #define SPATIAL_BEHIND 2.0
 #endif
 
+// second cache tier: compressed blobs of tiles evicted from the tile cache,
+// so a revisit costs a decode but no database read. Off by default: each
+// blob kept is a heap block per miss and PSRAM taken from the tile cache
+#ifndef BLOBCACHE_BYTES
+    #define BLOBCACHE_BYTES 0
+#endif
+#ifndef BLOBCACHE_ENTRIES
+    #define BLOBCACHE_ENTRIES 64
+#endif
+
+// decoded tiles live in slabs of TILESIZE x TILESIZE elevations reserved for
+// the cache entries plus TILESLAB_SPARE tiles being decoded outside the cache
+#ifndef TILESLAB_SPARE
+    #define TILESLAB_SPARE (DBPOOL_SIZE + 1)
+#endif
+
+// tile loader task for prefetch and asynchronous lookups, ESP32 only
+#ifndef LOADER_STACK
+    #define LOADER_STACK 8192
+#endif
+#ifndef LOADER_PRIORITY
+    #define LOADER_PRIORITY 1
+#endif
+#ifndef LOADER_CORE
+    #define LOADER_CORE 0
+#endif
+// partial decodes: pixels decoded around the window a lookup needs
+#ifndef PARTIAL_MARGIN
+    #define PARTIAL_MARGIN 16
+#endif
+// tile blobs are read from the database and fed to the decoders in chunks of this size
+#ifndef BLOB_CHUNK
+    #define BLOB_CHUNK 1024
+#endif
+// read-only database connections per DEM for the loader worker and for
+// batch lookups fetching several tiles in parallel
+#ifndef DBPOOL_SIZE
+    #ifdef ARDUINO
+        #define DBPOOL_SIZE 1
+    #else
+        #define DBPOOL_SIZE 4
+    #endif
+#endif
+// bbox, zooms and tile size a DEM had to be scanned for, or read from its metadata,
+// are kept in <path>DEM_SIDECAR for the next addDEM(); "" turns this off
+#ifndef DEM_SIDECAR
+    #define DEM_SIDECAR ".meta"
+#endif
+// decoded tiles saved by saveCacheSnapshot() to <path>DEM_SNAPSHOT, loaded
+// into the cache by addDEM() after a restart; "" turns this off
+#ifndef DEM_SNAPSHOT
+    #define DEM_SNAPSHOT ".tiles"
+#endif
+// raw DEM containers are mapped on the host, read with one pread() per tile on the ESP32
+#ifndef RAWDEM_MMAP
+    #ifdef ARDUINO
+        #define RAWDEM_MMAP 0
+    #else
+        #define RAWDEM_MMAP 1
+    #endif
+#endif
+// rowids of tiles remembered for streaming them again
+#ifndef ROWID_CACHE_MAX
+    #define ROWID_CACHE_MAX 1024
+#endif
+
+// area queries: min/max elevations per block of this many pixels square,
+// as summarizeDEM() stores them
+#ifndef SUMMARY_BLOCK
+    #define SUMMARY_BLOCK 32
+#endif
+
+// tiles remembered as missing from their DEM or undecodable
+#ifndef ABSENT_MAX
+    #define ABSENT_MAX 256
+#endif
+// prefetch sampling step along the track where no DEM is known, in metres
+#ifndef PREFETCH_STEP
+    #define PREFETCH_STEP 500.0
+#endif
+// getLocInfoProgressive(): the zoom of the tiles loaded for estimates, this
+// many below a DEM's max_zoom; each covers 4^PROGRESSIVE_LEVELS of its tiles
+#ifndef PROGRESSIVE_LEVELS
+    #define PROGRESSIVE_LEVELS 3
+#endif
+// per DEM latency histograms of the lookup stages, bytes read and decoded
+// and the DEM's share of the tile cache, read with getDemStats(); 0 compiles
+// all of it out
+#ifndef DEM_STATS
+    #define DEM_STATS 0
+#endif
+
+// decoded tiles hold elevations in decimetres relative to a per-tile base,
+// which covers +-3276.7m around the base - plenty for a tile's terrain
+#define ELEV_NODATA INT16_MIN
+#define ELEV_RANGE  INT16_MAX
+
 typedef struct {
-    uint8_t *buffer;
-    size_t width; // of a line in pixels
+    int16_t *buffer;  // width * height elevations, or ELEV_NODATA
+    int32_t base;     // decimetres
+    int32_t min;      // lowest and highest elevation in decimetres
+    int32_t max;      // min > max: no elevation data in tile
+    uint16_t width;   // of a line in pixels
+    uint16_t height;
+    uint16_t x0;      // decoded window x0..x1-1, y0..y1-1:
+    uint16_t y0;      // all of the tile unless partially decoded
+    uint16_t x1;
+    uint16_t y1;
+    bool slab;        // in a reserved slab, else a heap block
+    bool header;      // pixels elsewhere or all the same, a pooled header
+    bool uniform;     // every pixel is buffer[0], there is no more
+    bool prefetched;  // loaded by the prefetcher, not used by a lookup yet
+    void *blob;       // compressed tile, moves to the blob cache on eviction
+    std::atomic<int32_t> refs;  // the cache and each lookup reading it
 } tile_t;
 
 typedef struct  {
@@ -39,7 +202,11 @@ typedef enum {
     LS_PNG_COMPRESSED,
     LS_WEBP_COMPRESSED,
     LS_UNKNOWN_IMAGE_FORMAT,
-    LS_DB_ERROR
+    LS_DB_ERROR,
+    LS_DPK_DECODE_ERROR,
+    LS_PENDING,         // getLocInfoAsync(): result delivered to the callback
+    LS_ESTIMATE,        // getLocInfoProgressive(): elevation from a lower zoom,
+                        // the full resolution one delivered to the callback
 } locStatus_t;
 
 typedef enum {
@@ -48,13 +215,24 @@ typedef enum {
     ENC_PNG,
     ENC_WEBP,
     ENC_BAD_FORMAT,
+    ENC_DPK,
 } encoding_t;
 
 typedef struct {
     double elevation;
     locStatus_t status;
+    uint8_t zoom;       // of the tile a point lookup read, below the DEM's
+                        // max_zoom where that tile is missing or for an estimate
 } locInfo_t;
 
+// where addDEM() found bbox and zooms
+typedef enum {
+    BBOX_SCAN,          // min/max over the tiles
+    BBOX_METADATA,      // the MBTiles metadata table
+    BBOX_SIDECAR,       // the DEM_SIDECAR file of an earlier addDEM()
+    BBOX_HEADER,        // the header of a raw container
+} bboxSource_t;
+
 typedef struct {
     double ll_lat;
     double ll_lon;
@@ -62,24 +240,349 @@ typedef struct {
     double tr_lon;
 } bbox_t;
 
+// raw DEM container, an alternative to MBTiles for a grid of tiles at one
+// zoom: a header, an index of columns x rows tiles, row by row, then the
+// elevations of each tile as tile_t holds them, 16 byte aligned. Tiles are
+// mapped or read without decoding. Host byte order, little endian on both
+// the ESP32 and x86. convertDEM() writes one from an MBTiles archive.
+#define RAWDEM_MAGIC    "DEMRAW1"
+#define RAWDEM_VERSION  1
+#define RAWDEM_ALIGN    16
+
+typedef struct {
+    char magic[8];      // RAWDEM_MAGIC
+    uint16_t version;
+    uint16_t tile_size;
+    uint8_t zoom;
+    uint8_t codec;      // RAW_CODEC_NONE
+    uint16_t reserved;
+    int32_t x0;         // top left tile, xyz scheme
+    int32_t y0;
+    uint32_t columns;
+    uint32_t rows;
+    bbox_t bbox;
+} rawHeader_t;
+
+typedef enum {
+    RAW_CODEC_NONE,     // tile_size x tile_size int16_t
+} rawCodec_t;
+
+#define RAW_PRESENT     1
+#define RAW_UNIFORM     2   // every pixel is value, no elevations stored
+
+typedef struct {
+    uint64_t offset;    // of the elevations
+    uint32_t bytes;
+    uint16_t flags;
+    int16_t value;      // RAW_UNIFORM
+    int32_t base;       // dm, as tile_t
+    int32_t min;        // min > max: all NODATA
+    int32_t max;
+    uint32_t reserved;
+} rawIndex_t;
+
+struct rawDem;
+struct demSummary;
+struct demCounters;
+
+// elevations of a tile or block in dm, min > max: all NODATA
+typedef struct {
+    int32_t min;
+    int32_t max;
+} elevRange_t;
+
+// DPK tiles, a lossless alternative to PNG and WebP inside MBTiles (format
+// "dpk"): the header, then the elevations in dm as rgb2dm() gives them, row
+// by row. Each is predicted from its neighbours (left + up - up left; the
+// first row from the left, the first column from above), the residuals
+// zigzag coded and bit packed in blocks of DPK_BLOCK, each block a byte
+// with the bit width, then DPK_BLOCK x width bits, least significant first.
+// A byte DPK_ZEROS | n stands for n + 1 blocks of zero residuals.
+// NODATA is DPK_NODATA, the value of RGB 0/0/0. Little endian.
+// transcodeDEM() writes a DPK archive from a PNG or WebP one.
+#define DPK_VERSION     1
+#define DPK_BLOCK       32
+#define DPK_ZEROS       0x80
+#define DPK_NODATA      (-100000)
+
+typedef struct {
+    uint8_t magic[4];   // 0x89 'D' 'P' 'K'
+    uint8_t version;
+    uint8_t predictor;  // DPK_PREDICT_GRADIENT
+    uint16_t width;
+    uint16_t height;
+    uint16_t reserved;
+    int32_t min;        // of the elevations, min > max: all NODATA
+    int32_t max;
+} dpkHeader_t;
+
+typedef enum {
+    DPK_PREDICT_GRADIENT = 1,
+} dpkPredictor_t;
+
+// a database connection with the tile queries prepared once,
+// reset and rebound for every fetch
 typedef struct {
-    const char *path;
     sqlite3 *db;
+    sqlite3_stmt *tile_stmt;
+    sqlite3_stmt *rowid_stmt;   // NULL unless tiles is a table
+    uint8_t *chunk;             // BLOB_CHUNK bytes blobs are streamed through
+    bool busy;                  // in use, under pool_lock
+} dbConn_t;
+
+// statistics counter bumped by concurrent lookups: relaxed atomic, reads as T
+template<typename T>
+class counter_t {
+  public:
+    counter_t(T v = 0) : _v(v) {}
+    operator T() const {
+        return _v.load(std::memory_order_relaxed);
+    }
+    counter_t &operator=(T v) {
+        _v.store(v, std::memory_order_relaxed);
+        return *this;
+    }
+    counter_t &operator+=(T d) {
+        _v.fetch_add(d, std::memory_order_relaxed);
+        return *this;
+    }
+    counter_t &operator++() {
+        return *this += 1;
+    }
+    T operator++(int) {
+        return _v.fetch_add(1, std::memory_order_relaxed);
+    }
+  private:
+    std::atomic<T> _v;
+};
+
+typedef struct {
+    const char *path;
+    dbConn_t conn;              // lookups, opened on first use; the pool takes over while it is busy
+    dbConn_t pool[DBPOOL_SIZE]; // opened on first use
     bbox_t bbox;
-    uint32_t db_errors;
-    uint32_t tile_errors;
-    uint32_t cache_hits;
-    uint32_t cache_misses;
+    counter_t<uint32_t> db_errors;
+    counter_t<uint32_t> tile_errors;
+    counter_t<uint32_t> cache_hits;
+    counter_t<uint32_t> cache_misses;
+    counter_t<uint64_t> fetch_us;    // cumulative time in sqlite3 on cache misses
+    counter_t<uint64_t> decode_us;   // cumulative time decoding tiles
+    counter_t<uint32_t> fetches;     // tiles read from the database
+    counter_t<uint32_t> stmt_prepares;   // statements prepared, on all connections
+    counter_t<uint32_t> pool_opens;      // pool connections opened
+    counter_t<uint32_t> pool_waits;      // fetches which waited for a free pool connection
+    counter_t<uint32_t> prefetch_loads;   // tiles the prefetch worker put into the cache
+    counter_t<uint32_t> prefetch_hits;    // prefetched tiles subsequently used by a lookup
+    counter_t<uint32_t> prefetch_wasted;  // prefetched tiles evicted unused or loaded by a lookup first
+    counter_t<uint64_t> prefetch_us;      // cumulative time the prefetch worker spent on this DEM
+    counter_t<uint32_t> coalesced;        // lookups which joined a tile load under way instead of loading it too
+    counter_t<uint32_t> partial_decodes;  // cold misses decoding only part of a tile
+    counter_t<uint32_t> partial_upgrades; // partial tiles replaced by a full decode
+    counter_t<uint32_t> uniform_tiles;    // loaded as one value without pixels
+    counter_t<uint32_t> snapshot_tiles;   // loaded from the cache snapshot
     uint16_t tile_size;
     encoding_t encoding;
+    interp_t interpolation;   // used by lookups passing INTERP_DEFAULT
+    bool partial_decode;      // cold misses decode only around the pixels needed
+    bool tile_blobs;          // tiles is a table: blobs are streamed into the decoders
+    bool opened;              // the database was opened for lookups, tile_blobs is known
+    struct rawDem *raw;       // a raw container instead of SQLite, NULL for MBTiles
+    struct demSummary *summary;   // min/max per tile, for area queries
+    struct demCounters *stats;    // DEM_STATS only, else NULL
+    bboxSource_t bbox_source;
+    projection_t proj;        // float projection anchored at the bbox centre
     uint8_t index;
+    uint8_t min_zoom;
     uint8_t max_zoom;
+    uint16_t rank;            // position in DEM priority order
 } demInfo_t;
 
+// add the DEMs before lookups start on other threads
+// the database is opened by the first lookup within the DEM's bbox
 int addDEM(const char *path, demInfo_t **demInfo = NULL);
-int getLocInfo(double lat, double lon, locInfo_t *locinfo);
+// getLocInfo() and getLocInfoBatch() may be called from several threads at once:
+// they share cached tiles, and a tile missed by several is loaded once
+// a tile missing from a DEM with lower zooms is stood in for by the finest
+// of them which has the point, interpolated within that tile only
+int getLocInfo(double lat, double lon, locInfo_t *locinfo, interp_t interp = INTERP_DEFAULT);
+// look up n points; fetches and decodes every tile involved at most once
+// results are stored in out[] in input order
+int getLocInfoBatch(const double *lat, const double *lon, size_t n, locInfo_t *out,
+                    interp_t interp = INTERP_DEFAULT);
+
+// a stream of lookups which mostly fall into the tile of the one before, as
+// GPS fixes do: the session keeps that tile pinned, and a fix inside it costs
+// a local projection and a pixel read, without the DEM scan, cache probe or
+// logging of getLocInfo(). A fix elsewhere, in a tile a finer DEM overlaps, or
+// at NODATA with a coarser DEM below takes getLocInfo()'s path and pins its
+// tile. Zero a session before its first lookup; closeSession() unpins.
+typedef struct {
+    demInfo_t *di;
+    tile_t *tile;       // pinned, NULL: none
+    uint64_t key;
+    double lon0;        // tile offsets: x linear in lon from the west edge,
+    double lat0;        // y a cubic in lat about the tile centre
+    double x_per_deg;
+    double y[4];
+    bool shadowed;      // a finer DEM overlaps the tile
+    bool coarser;       // and a coarser one
+    uint32_t fast;      // fixes answered from the pinned tile
+    uint32_t slow;      // fixes which took getLocInfo()
+} lookupSession_t;
+
+int getLocInfo(lookupSession_t *session, double lat, double lon, locInfo_t *locinfo,
+               interp_t interp = INTERP_DEFAULT);
+void closeSession(lookupSession_t *session);
+
+// highest terrain within bbox, or within radius m of lat/lon, over every
+// DEM there: from min/max summaries of tiles and blocks, decoding only tiles
+// on the border of the area whose summary could raise the answer.
+// Conservative: pixels the area touches count whole, and a tile missing
+// from a DEM with lower zooms counts by what its lookups read there.
+// LS_NODATA if the tiles there hold none, LS_TILE_NOT_FOUND without tiles
+int getAreaMaxElevation(const bbox_t *bbox, locInfo_t *locinfo);
+int getAreaMaxElevation(double lat, double lon, double radius, locInfo_t *locinfo);
+
+// a sample along a path
+typedef struct {
+    double lat;
+    double lon;
+    double distance;    // m from the start of the path
+    locInfo_t locinfo;
+} pathSample_t;
+
+// elevation profile along the polyline lat/lon[0..n-1]: a sample every
+// spacing m from the first point, and the last point. The path is walked
+// tile by tile, its samples read from the tile they fall into while it
+// stays pinned. Returns the samples stored in out, at most max.
+size_t getProfile(const double *lat, const double *lon, size_t n, double spacing,
+                  pathSample_t *out, size_t max, interp_t interp = INTERP_DEFAULT);
+// the same for distance m from lat/lon on bearing, in degrees true
+size_t getProfileBearing(double lat, double lon, float bearing, double distance, double spacing,
+                         pathSample_t *out, size_t max, interp_t interp = INTERP_DEFAULT);
+// line of sight: walk the path as getProfile() does, stopping at the first
+// sample with terrain above the line from alt0 at the first point to alt1
+// at the last (m; the same for a level path). True if there is one, in *hit
+bool getTerrainIntersection(const double *lat, const double *lon, size_t n, double spacing,
+                            double alt0, double alt1, pathSample_t *hit,
+                            interp_t interp = INTERP_DEFAULT);
+
+typedef void (*locInfoCb_t)(double lat, double lon, const locInfo_t *locinfo, void *arg);
+
+// non-blocking lookup: if the tiles needed are cached, the result is in
+// locinfo on return. Otherwise locinfo->status is LS_PENDING, the tiles are
+// loaded by a worker and cb is called with the result from a later
+// pollLocInfo(). Lookups waiting for the same tile share one load.
+int getLocInfoAsync(double lat, double lon, locInfo_t *locinfo, locInfoCb_t cb, void *arg = NULL,
+                    interp_t interp = INTERP_DEFAULT);
+// like getLocInfoAsync(), but a lookup the tiles are missing for is answered
+// at once from the finest lower zoom of its DEM in the cache, with status
+// LS_ESTIMATE, before cb gets the full resolution result; LS_PENDING if no
+// lower zoom is cached. The tile PROGRESSIVE_LEVELS zooms down is loaded
+// after the missing ones, for estimates of the lookups around.
+int getLocInfoProgressive(double lat, double lon, locInfo_t *locinfo, locInfoCb_t cb, void *arg = NULL,
+                          interp_t interp = INTERP_DEFAULT);
+// call the callbacks of completed asynchronous lookups, return their number
+int pollLocInfo(void);
+// stop the worker getLocInfoAsync() and prefetchStart() start, waiting for
+// a load in progress, before exiting or closing the DEMs. Lookups still
+// pending are dropped without their callbacks; completed ones are left to
+// pollLocInfo(). The next asynchronous lookup starts the worker again.
+void asyncStop(void);
+
+// background prefetch: the same worker (FreeRTOS task on the ESP32, a
+// thread on the host) loads the tiles ahead on the current track into the
+// tile cache using its own database connections, so lookups crossing a tile
+// boundary find the tile already decoded. getLocInfo() never waits for the
+// worker: a tile still being prefetched is loaded by the lookup itself,
+// getLocInfoAsync() joins the load.
+// Like getLocInfoAsync() and pollLocInfo(), call these from one thread.
+int prefetchStart(float horizon_s);
+void prefetchStop(void);
+// position fix: track in degrees true, ground speed in m/s
+// also steers spatial_policy eviction, even with prefetch stopped
+// queues the tiles passed within horizon_s, nearest first, replacing
+// the previous queue; at most half the tile cache is used for prefetching
+void prefetchUpdate(double lat, double lon, float track, float speed);
+
+// per tier: decoded tiles and compressed blobs
+typedef struct {
+    size_t tile_bytes;          // budget, in slabs of TILESIZE x TILESIZE tiles
+    size_t tile_entries;
+    size_t uniform_entries;     // of these, one value without pixels
+    uint32_t uniform_known;     // uniform tiles recognized by their blob, not decoded
+    uint32_t tile_hits;         // all DEMs
+    uint32_t tile_misses;
+    size_t blob_bytes;          // budget
+    size_t blob_used;
+    size_t blob_entries;
+    uint32_t blob_hits;         // tile misses decoded from a cached blob: promotions
+    uint32_t blob_misses;       // tiles read from the database
+    uint32_t blob_demotions;    // blobs of evicted tiles kept
+    uint32_t blob_evictions;    // blobs dropped for the budget
+} cacheStats_t;
+
+// lookup stages DEM_STATS times
+typedef enum {
+    STAGE_LOOKUP,       // getLocInfo(), when the DEM answered it
+    STAGE_SELECT,       // finding the DEM containing the point
+    STAGE_PROJECT,      // lat/lon to tile and pixel offsets
+    STAGE_CACHE,        // tile cache hits
+    STAGE_FETCH,        // reading a tile: SQLite, the blob cache or a raw container
+    STAGE_DECODE,       // PNG, WebP or DPK to elevations
+    STAGE_COUNT
+} stage_t;
+
+// log2 buckets: bucket i counts calls of 2^i..2^(i+1)-1 ns, bucket 0 from 0 ns
+#define STATS_BUCKETS 32
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_ns;
+    uint64_t total_ns;
+    uint32_t buckets[STATS_BUCKETS];
+} stageStats_t;
+
+typedef struct {
+    stageStats_t stage[STAGE_COUNT];
+    uint64_t bytes_read;        // compressed tiles read from the database, raw tiles read
+    uint64_t bytes_decoded;     // elevations out of the decoders
+    uint32_t tiles_cached;      // in the tile cache now
+    uint32_t tiles_dropped;     // evicted, replaced or flushed
+    size_t tile_bytes;          // held by the cached tiles now
+    size_t tile_bytes_peak;
+} demStats_t;
+
+// a snapshot of the statistics of di: false, all zero, without DEM_STATS
+bool getDemStats(const demInfo_t *di, demStats_t *stats);
+// the snapshot as a JSON object, "{}" without DEM_STATS
+std::string demStatsJSON(const demInfo_t *di);
+// the upper bound in ns of the bucket holding the call at fraction p, 0..1
+uint32_t stagePercentile(const stageStats_t *stage, double p);
+// zero the histograms and byte counts; residency is kept
+void resetDemStats(demInfo_t *di);
 
+// resize the caches while no lookups run
+void setCacheSize(size_t entries);
+// size both tiers in bytes; blob_bytes 0 turns the blob cache off
+void setCacheBytes(size_t tile_bytes, size_t blob_bytes);
+void getCacheStats(cacheStats_t *stats);
+void flushCache(void);
+// save the fully decoded tiles of the cache, per DEM, for addDEM() to load
+// after a restart: on shutdown or periodically. Returns the tiles saved, -1 on error
+int saveCacheSnapshot(void);
+// load the snapshot of di into the cache, if it is of the archive as it is now
+// addDEM() does this; returns the tiles loaded
+int loadCacheSnapshot(demInfo_t *di);
 void printCache(void);
 void printDems(void);
+// write the tiles of an MBTiles archive at its highest zoom into a raw container
+int convertDEM(const char *mbtiles, const char *raw);
+// copy a PNG or WebP MBTiles archive with every tile re-encoded as DPK,
+// checking each decodes to the same elevations
+int transcodeDEM(const char *src, const char *dst);
+// add the min/max summary per tile and per SUMMARY_BLOCK block at the highest
+// zoom to an MBTiles archive, so area queries need not decode its tiles
+int summarizeDEM(const char *mbtiles);
 
 std::string string_format(const std::string fmt, ...);
@@ -0,0 +1,87 @@
+#ifndef ARDUINO
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include <atomic>
+
+#include "platform.hpp"
+#include "logging.hpp"
+
+// every block carries its size in front so heap_caps_free can account for it
+typedef struct {
+    size_t size;
+    size_t pad;
+} blockhdr_t;
+
+// atomic: the prefetch worker allocates tiles too
+static std::atomic<size_t> heap_used;
+static std::atomic<size_t> heap_peak;
+static std::atomic<size_t> heap_allocs;
+int host_log_level = LOG_LEVEL;
+
+void *heap_caps_malloc(size_t size, uint32_t) {
+    blockhdr_t *hdr = (blockhdr_t *)malloc(sizeof(blockhdr_t) + size);
+    if (hdr == NULL)
+        return NULL;
+    hdr->size = size;
+    heap_allocs++;
+    size_t used = heap_used += size;
+    size_t peak = heap_peak;
+    while ((used > peak) && !heap_peak.compare_exchange_weak(peak, used))
+        ;
+    return hdr + 1;
+}
+
+void heap_caps_free(void *ptr) {
+    if (ptr == NULL)
+        return;
+    blockhdr_t *hdr = (blockhdr_t *)ptr - 1;
+    heap_used -= hdr->size;
+    free(hdr);
+}
+
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t hostFineTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+size_t hostHeapUsed(void) {
+    return heap_used;
+}
+
+size_t hostHeapPeak(void) {
+    return heap_peak;
+}
+
+void hostHeapResetPeak(void) {
+    heap_peak = heap_used.load();
+}
+
+size_t hostHeapAllocs(void) {
+    return heap_allocs;
+}
+
+void hostLogLevel(int level) {
+    host_log_level = level;
+}
+
+void hostLog(int level, const char *fmt, ...) {
+    if (level > host_log_level)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+// platform shim: the lookup code is written against ESP-IDF heap and
+// timer calls. On the ESP32 these come from the SDK, a host (Linux) build
+// gets stand-ins from platform.cpp.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+// a fine clock for latency histograms, in ticks which wrap: only differences count
+#define FINETIME()      ESP.getCycleCount()
+#define FINE_PER_US     ((uint32_t)getCpuFreqMHz())
+
+#else
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void heap_caps_free(void *ptr);
+int64_t esp_timer_get_time(void);
+
+// allocation accounting for heap_caps_malloc'ed memory - host only
+size_t hostHeapUsed(void);
+size_t hostHeapPeak(void);
+void hostHeapResetPeak(void);
+// number of heap_caps_malloc calls so far
+size_t hostHeapAllocs(void);
+
+// nanoseconds, wrapping
+uint32_t hostFineTime(void);
+#define FINETIME()      hostFineTime()
+#define FINE_PER_US     1000u
+
+#endif
+
+#define STARTTIME(x) { x = esp_timer_get_time();}
+#define LAPTIME(x)  (uint32_t) (esp_timer_get_time() - x)
@@ -27,17 +27,82 @@ void lat_lon_to_pixel(double lat, double  lon, uint32_t zoom, int32_t tile_size,
 void lat_lon_to_tile(double lat, double  lon, uint32_t zoom, int32_t tile_size, int32_t&tile_x, int32_t&tile_y) {
     double pixel_x, pixel_y;
     lat_lon_to_pixel(lat, lon, zoom, tile_size, pixel_x, pixel_y);
-    tile_x = pixel_x / 256;
-    tile_y = pixel_y / 256;
+    tile_x = pixel_x / tile_size;
+    tile_y = pixel_y / tile_size;
     LOG_DEBUG("tile_x=%d  tile_y=%d pixel_x=%F pixel-y=%F", tile_x,tile_y,pixel_x,pixel_y);
 }
 
 void compute_pixel_offset(double lat, double  lon, uint32_t zoom, int32_t tile_size,
                           int32_t&tile_x, int32_t&tile_y, double &offset_x, double &offset_y) {
     double pixel_x, pixel_y;
-    lat_lon_to_tile(lat, lon, zoom, tile_size,  tile_x, tile_y);
     lat_lon_to_pixel(lat, lon, zoom, tile_size, pixel_x, pixel_y);
-    offset_x = pixel_x - tile_x * 256;
-    offset_y = pixel_y - tile_y * 256;
+    tile_x = pixel_x / tile_size;
+    tile_y = pixel_y / tile_size;
+    offset_x = pixel_x - tile_x * tile_size;
+    offset_y = pixel_y - tile_y * tile_size;
     LOG_DEBUG("offset_x=%F offset_y=%F", offset_x, offset_y);
 }
+
+void projection_init(projection_t *p, double ll_lat, double ll_lon, double tr_lat, double tr_lon,
+                     uint32_t zoom, int32_t tile_size) {
+    double x, y, x1, y1;
+    double world = (double)(1 << zoom) * tile_size;
+    double lat0 = (ll_lat + tr_lat) / 2;
+    double lon0 = (ll_lon + tr_lon) / 2;
+
+    lat_lon_to_pixel(lat0, lon0, zoom, tile_size, x, y);
+    lat_lon_to_pixel(ll_lat, ll_lon, zoom, tile_size, x1, y1);
+    p->lat0 = lat0;
+    p->lon0 = lon0;
+    p->px0 = (int32_t)floor(x);
+    p->py0 = (int32_t)floor(y);
+    p->fx0 = (float)(x - p->px0);
+    p->fy0 = (float)(y - p->py0);
+    p->phi0 = (float)to_radians(lat0);
+    p->sin0 = (float)sin(to_radians(lat0));
+    p->cos0 = (float)cos(to_radians(lat0));
+    p->px_per_deg = (float)(world / 360.0);
+    p->px_per_rad = (float)(world / (2.0 * M_PI));
+    p->tile_size = tile_size;
+    p->zoom = zoom;
+    p->use_double = (fabs(x1 - x) > PROJECTION_FLOAT_SPAN) || (fabs(y1 - y) > PROJECTION_FLOAT_SPAN);
+}
+
+// mercator y is atanh(sin(lat)), so relative to the anchor
+//   y - y0 = atanh((sin(lat) - sin(lat0)) / (1 - sin(lat) * sin(lat0)))
+// with the difference of sines as 2 cos((lat + lat0)/2) sin((lat - lat0)/2),
+// which keeps full float precision for small distances
+void project_lat_lon(const projection_t *p, double lat, double lon,
+                     int32_t &tile_x, int32_t &tile_y, float &offset_x, float &offset_y) {
+    if (p->use_double) {
+        double ox, oy;
+        compute_pixel_offset(lat, lon, p->zoom, p->tile_size, tile_x, tile_y, ox, oy);
+        offset_x = ox;
+        offset_y = oy;
+        return;
+    }
+    float dphi = (float)(lat - p->lat0) * (float)(M_PI / 180.0);
+    float half = 0.5f * dphi;
+    float sin_lat = p->sin0 * cosf(dphi) + p->cos0 * sinf(dphi);
+    float dsin = 2.0f * cosf(p->phi0 + half) * sinf(half);
+    float dy = atanhf(dsin / (1.0f - sin_lat * p->sin0));
+
+    float x = p->fx0 + (float)(lon - p->lon0) * p->px_per_deg;
+    float y = p->fy0 - dy * p->px_per_rad;
+    float ix = floorf(x);
+    float iy = floorf(y);
+    int32_t px = p->px0 + (int32_t)ix;
+    int32_t py = p->py0 + (int32_t)iy;
+
+    tile_x = px / p->tile_size;
+    tile_y = py / p->tile_size;
+    offset_x = (float)(px - tile_x * p->tile_size) + (x - ix);
+    offset_y = (float)(py - tile_y * p->tile_size) + (y - iy);
+}
+
+void project_lat_lon_batch(const projection_t *p, const double *lat, const double *lon, size_t n,
+                           int32_t *tile_x, int32_t *tile_y, float *offset_x, float *offset_y) {
+    for (size_t i = 0; i < n; i++) {
+        project_lat_lon(p, lat[i], lon[i], tile_x[i], tile_y[i], offset_x[i], offset_y[i]);
+    }
+}
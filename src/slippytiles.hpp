@@ -1,6 +1,8 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
+#include <math.h>
 #include "logging.hpp"
 
 static inline double to_radians(double degrees) {
@@ -22,6 +24,11 @@ static inline double rgb2alt(const uint8_t *px) {
     return  -10000 + ((px[0] * 256 * 256 + px[1] * 256 + px[2]) * 0.1);
 }
 
+// Terrain-RGB to integer decimetres, exact
+static inline int32_t rgb2dm(const uint8_t *px) {
+    return (px[0] << 16) + (px[1] << 8) + px[2] - 100000;
+}
+
 double resolution(double latitude, uint32_t zoom);
 double tilex2long(int32_t x, uint32_t zoom);
 double tiley2lat(int32_t y, uint32_t zoom);
@@ -29,3 +36,34 @@ void compute_pixel_offset(double lat, double  lon, uint32_t zoom, int32_t tile_s
                           int32_t&tile_x, int32_t&tile_y, double &offset_x, double &offset_y);
 void lat_lon_to_tile(double lat, double  lon, uint32_t zoom, int32_t tile_size, int32_t&tile_x, int32_t&tile_y);
 void lat_lon_to_pixel(double lat, double  lon, uint32_t zoom, int32_t tile_size, double &x, double &y);
+
+// single precision projection relative to an anchor at the centre of a bbox,
+// for lookups within it: one pass, float transcendentals only. The error grows
+// with the distance from the anchor in pixels, about 0.004 pixel at 32768 pixels
+// (Austria at zoom 13); larger areas use the double path - see the projection
+// check in bench/.
+#define PROJECTION_FLOAT_SPAN 32768
+
+typedef struct {
+    double lat0;        // anchor, degrees
+    double lon0;
+    int32_t px0;        // anchor world pixel, integer part
+    int32_t py0;
+    float fx0;          // and fractional part
+    float fy0;
+    float phi0;         // anchor latitude in radians
+    float sin0;         // and its sine and cosine
+    float cos0;
+    float px_per_deg;   // world pixels per degree of longitude
+    float px_per_rad;   // world pixels per unit of mercator y
+    int32_t tile_size;
+    uint32_t zoom;
+    bool use_double;    // bbox too large for float precision
+} projection_t;
+
+void projection_init(projection_t *p, double ll_lat, double ll_lon, double tr_lat, double tr_lon,
+                     uint32_t zoom, int32_t tile_size);
+void project_lat_lon(const projection_t *p, double lat, double lon,
+                     int32_t &tile_x, int32_t &tile_y, float &offset_x, float &offset_y);
+void project_lat_lon_batch(const projection_t *p, const double *lat, const double *lon, size_t n,
+                           int32_t *tile_x, int32_t *tile_y, float *offset_x, float *offset_y);
@@ -0,0 +1,30 @@
+// transcode a Terrain-RGB MBTiles archive to DPK tiles
+//
+// copies the archive with every PNG or WebP tile re-encoded losslessly as
+// DPK, which decodes an order of magnitude faster. A tile is replaced only
+// once its DPK blob decodes to the same elevations; the few which do not
+// are reported and left as they were.
+//
+// usage: mbtiles2dpk in.mbtiles out.mbtiles
+
+#include <stdio.h>
+#include <sqlite3.h>
+
+#include "platform.hpp"
+#include "logging.hpp"
+#include "mbtiles.hpp"
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s in.mbtiles out.mbtiles\n", argv[0]);
+        return 1;
+    }
+    hostLogLevel(LOG_LEVEL_NOTICE);
+    sqlite3_initialize();
+    int rc = transcodeDEM(argv[1], argv[2]);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "%s: transcoding failed rc=%d\n", argv[1], rc);
+        return 1;
+    }
+    return 0;
+}
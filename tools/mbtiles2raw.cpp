@@ -0,0 +1,29 @@
+// convert a Terrain-RGB MBTiles archive into a raw DEM container
+//
+// decodes every tile at the archive's highest zoom once and writes the
+// elevations as lookups hold them, so addDEM() can map the result (or read
+// it a tile at a time with pread() on the ESP32) without decoding.
+//
+// usage: mbtiles2raw in.mbtiles out.dem
+
+#include <stdio.h>
+#include <sqlite3.h>
+
+#include "platform.hpp"
+#include "logging.hpp"
+#include "mbtiles.hpp"
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s in.mbtiles out.dem\n", argv[0]);
+        return 1;
+    }
+    hostLogLevel(LOG_LEVEL_ERROR);
+    sqlite3_initialize();
+    int rc = convertDEM(argv[1], argv[2]);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "%s: conversion failed rc=%d\n", argv[1], rc);
+        return 1;
+    }
+    return 0;
+}
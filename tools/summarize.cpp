@@ -0,0 +1,30 @@
+// add the elevation_summary table to an MBTiles archive
+//
+// records the lowest and highest elevation of every tile at the highest
+// zoom, and of each SUMMARY_BLOCK square within it, so getAreaMaxElevation()
+// answers without decoding the tiles wholly inside or well below the area.
+// Run it again after the tiles change.
+//
+// usage: summarize in.mbtiles
+
+#include <stdio.h>
+#include <sqlite3.h>
+
+#include "platform.hpp"
+#include "logging.hpp"
+#include "mbtiles.hpp"
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s in.mbtiles\n", argv[0]);
+        return 1;
+    }
+    hostLogLevel(LOG_LEVEL_NOTICE);
+    sqlite3_initialize();
+    int rc = summarizeDEM(argv[1]);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "%s: summary failed rc=%d\n", argv[1], rc);
+        return 1;
+    }
+    return 0;
+}